@@ -173,6 +173,14 @@ typedef enum {
     /* Return the physical size in allocation */
     VIR_STORAGE_VOL_GET_PHYSICAL = 1 << 0,
 
+    /* Return the progress of a running wipe: total bytes to be wiped
+     * in capacity and bytes wiped so far in allocation */
+    VIR_STORAGE_VOL_GET_WIPE_PROGRESS = 1 << 1,
+
+    /* Request cancellation of a running wipe (implies
+     * VIR_STORAGE_VOL_GET_WIPE_PROGRESS) */
+    VIR_STORAGE_VOL_GET_WIPE_CANCEL = 1 << 2,
+
 } virStorageVolInfoFlags;
 
 typedef struct _virStorageVolInfo virStorageVolInfo;
@@ -295,6 +303,12 @@ int                     virStoragePoolDelete            (virStoragePoolPtr pool,
                                                          unsigned int flags);
 int                     virStoragePoolRef               (virStoragePoolPtr pool);
 int                     virStoragePoolFree              (virStoragePoolPtr pool);
+
+typedef enum {
+    /* Re-probe only volumes which changed since the last refresh */
+    VIR_STORAGE_POOL_REFRESH_INCREMENTAL = 1 << 0,
+} virStoragePoolRefreshFlags;
+
 int                     virStoragePoolRefresh           (virStoragePoolPtr pool,
                                                          unsigned int flags);
 
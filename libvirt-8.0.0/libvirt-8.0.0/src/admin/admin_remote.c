@@ -493,3 +493,42 @@ remoteAdminConnectGetLoggingFilters(virAdmConnectPtr conn,
     virObjectUnlock(priv);
     return rv;
 }
+
+static int
+remoteAdminConnectGetDomainLogStats(virAdmConnectPtr conn,
+                                    virTypedParameterPtr *params,
+                                    int *nparams,
+                                    unsigned int flags)
+{
+    int rv = -1;
+    remoteAdminPriv *priv = conn->privateData;
+    admin_connect_get_domain_log_stats_args args;
+    admin_connect_get_domain_log_stats_ret ret;
+
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn, 0, ADMIN_PROC_CONNECT_GET_DOMAIN_LOG_STATS,
+             (xdrproc_t) xdr_admin_connect_get_domain_log_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_domain_log_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_CONNECT_DOMAIN_LOG_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_connect_get_domain_log_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
@@ -36,6 +36,10 @@
 
 VIR_LOG_INIT("daemon.admin_server");
 
+/* Only set by daemons which handle domain log files, i.e. virtlogd */
+static adminDomainLogStatsFunc adminDomainLogStats;
+static void *adminDomainLogStatsOpaque;
+
 int
 adminConnectListServers(virNetDaemon *dmn,
                         virNetServer ***servers,
@@ -374,3 +378,27 @@ adminServerUpdateTlsFiles(virNetServer *srv,
 
     return virNetServerUpdateTlsFiles(srv);
 }
+
+void
+adminSetDomainLogStatsFunc(adminDomainLogStatsFunc func,
+                           void *opaque)
+{
+    adminDomainLogStats = func;
+    adminDomainLogStatsOpaque = opaque;
+}
+
+int
+adminConnectGetDomainLogStats(virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    if (!adminDomainLogStats) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("daemon doesn't handle domain log files"));
+        return -1;
+    }
+
+    return adminDomainLogStats(params, nparams, adminDomainLogStatsOpaque);
+}
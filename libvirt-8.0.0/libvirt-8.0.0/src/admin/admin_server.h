@@ -70,3 +70,14 @@ int adminServerSetClientLimits(virNetServer *srv,
 
 int adminServerUpdateTlsFiles(virNetServer *srv,
                               unsigned int flags);
+
+typedef int (*adminDomainLogStatsFunc)(virTypedParameterPtr *params,
+                                       int *nparams,
+                                       void *opaque);
+
+void adminSetDomainLogStatsFunc(adminDomainLogStatsFunc func,
+                                void *opaque);
+
+int adminConnectGetDomainLogStats(virTypedParameterPtr *params,
+                                  int *nparams,
+                                  unsigned int flags);
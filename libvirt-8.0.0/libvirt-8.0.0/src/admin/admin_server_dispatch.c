@@ -518,4 +518,34 @@ adminDispatchConnectGetLoggingFilters(virNetServer *server G_GNUC_UNUSED,
 
     return 0;
 }
+
+static int
+adminDispatchConnectGetDomainLogStats(virNetServer *server G_GNUC_UNUSED,
+                                      virNetServerClient *client G_GNUC_UNUSED,
+                                      virNetMessage *msg G_GNUC_UNUSED,
+                                      struct virNetMessageError *rerr,
+                                      admin_connect_get_domain_log_stats_args *args,
+                                      admin_connect_get_domain_log_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetDomainLogStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_CONNECT_DOMAIN_LOG_STATS_MAX,
+                                (struct _virTypedParameterRemote **) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
 #include "admin_server_dispatch_stubs.h"
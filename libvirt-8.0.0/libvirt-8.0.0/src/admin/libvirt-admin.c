@@ -1267,3 +1267,58 @@ virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
     virDispatchError(NULL);
     return -1;
 }
+
+/**
+ * virAdmConnectGetDomainLogStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to a list of statistics (return value, allocated
+ *          automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve the throughput of the domain log files handled by the daemon,
+ * i.e. the output of the domains' consoles collected by virtlogd. Daemons
+ * which don't handle domain log files report VIR_ERR_OPERATION_UNSUPPORTED.
+ *
+ * The statistics are reported as:
+ *
+ *  "log.count" - number of log files currently open as unsigned int
+ *  "log.<num>.path" - path of the log file as string
+ *  "log.<num>.driver" - name of the hypervisor driver as string
+ *  "log.<num>.domain.name" - name of the domain as string
+ *  "log.<num>.domain.uuid" - UUID of the domain as string
+ *  "log.<num>.written" - bytes written to the log file since it was opened
+ *                        as unsigned long long
+ *  "log.<num>.dropped" - bytes of output dropped because they exceeded
+ *                        the configured rate limit, as unsigned long long
+ *  "log.<num>.rate" - bytes written per second, measured over the last
+ *                     second or more, as unsigned long long
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetDomainLogStats(virAdmConnectPtr conn,
+                               virTypedParameterPtr *params,
+                               int *nparams,
+                               unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetDomainLogStats(conn, params, nparams,
+                                                   flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
@@ -3019,6 +3019,11 @@ virNodeDeviceGetPCIVPDDynamicCap(virNodeDevCapPCIDev *devCapPCIDev)
     virPCIDeviceAddress devAddr;
     g_autoptr(virPCIVPDResource) res = NULL;
 
+    /* Reading VPD is slow and its contents only change together with the
+     * device, in which case udev hands us a freshly probed definition */
+    if (devCapPCIDev->vpdProbed)
+        return 0;
+
     devAddr.domain = devCapPCIDev->domain;
     devAddr.bus = devCapPCIDev->bus;
     devAddr.slot = devCapPCIDev->slot;
@@ -3036,6 +3041,8 @@ virNodeDeviceGetPCIVPDDynamicCap(virNodeDevCapPCIDev *devCapPCIDev)
             virPCIVPDResourceFree(g_steal_pointer(&devCapPCIDev->vpd));
         }
     }
+
+    devCapPCIDev->vpdProbed = true;
     return 0;
 }
 
@@ -3045,6 +3052,7 @@ virNodeDeviceGetPCIVPDDynamicCap(virNodeDevCapPCIDev *devCapPCIDev)
  * without this device itself changing. These must be refreshed
  * anytime full XML of the device is requested, because they can
  * change with no corresponding notification from the kernel/udev.
+ * The VPD is the exception, it is read only once per definition.
  */
 int
 virNodeDeviceGetPCIDynamicCaps(const char *sysfsPath,
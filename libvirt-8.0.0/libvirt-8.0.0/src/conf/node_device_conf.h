@@ -185,6 +185,7 @@ struct _virNodeDevCapPCIDev {
     virMediatedDeviceType **mdev_types;
     size_t nmdev_types;
     virPCIVPDResource *vpd;
+    bool vpdProbed; /* @vpd is only read once per udev add/change event */
 };
 
 typedef struct _virNodeDevCapUSBDev virNodeDevCapUSBDev;
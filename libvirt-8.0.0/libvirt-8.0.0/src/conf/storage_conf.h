@@ -83,6 +83,12 @@ struct _virStorageVolDef {
     bool building;
     unsigned int in_use;
 
+    /* State of a running wipe, accessed with the pool object locked */
+    bool wiping;
+    bool wipeCancel;
+    unsigned long long wipeTotal;
+    unsigned long long wipeProcessed;
+
     virStorageVolSource source;
     virStorageSource target;
 };
@@ -312,6 +312,10 @@ struct _virStorageSource {
     unsigned long long capacity; /* in bytes, 0 if unknown */
     unsigned long long allocation; /* in bytes, 0 if unknown */
     unsigned long long physical; /* in bytes, 0 if unknown */
+    /* st_dev and st_ino of a local file when it was last probed,
+     * used to notice a replaced file; not part of the XML */
+    unsigned long long dev;
+    unsigned long long ino;
     unsigned long long clusterSize; /* in bytes, 0 if unknown */
     bool has_allocation; /* Set to true when provided in XML */
 
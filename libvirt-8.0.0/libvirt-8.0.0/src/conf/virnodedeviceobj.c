@@ -51,6 +51,10 @@ struct _virNodeDeviceObjList {
      * for O(1), lockless lookup-by-name */
     GHashTable *objs;
 
+    /* sysfs path string -> name string mapping for O(1) lookup-by-sysfs-path.
+     * The sysfs path of a device may be cleared in place when it goes away,
+     * so entries are only hints which are checked against the device found */
+    GHashTable *sysfsPaths;
 };
 
 
@@ -200,21 +204,11 @@ virNodeDeviceObjListSearch(virNodeDeviceObjList *devs,
 }
 
 
-static int
-virNodeDeviceObjListFindBySysfsPathCallback(const void *payload,
-                                            const char *name G_GNUC_UNUSED,
-                                            const void *opaque)
+static virNodeDeviceObj *
+virNodeDeviceObjListFindByNameLocked(virNodeDeviceObjList *devs,
+                                     const char *name)
 {
-    virNodeDeviceObj *obj = (virNodeDeviceObj *) payload;
-    const char *sysfs_path = opaque;
-    int want = 0;
-
-    virObjectLock(obj);
-    if (obj->def->sysfs_path &&
-        STREQ_NULLABLE(obj->def->sysfs_path, sysfs_path))
-        want = 1;
-    virObjectUnlock(obj);
-    return want;
+    return virObjectRef(virHashLookup(devs->objs, name));
 }
 
 
@@ -222,17 +216,22 @@ virNodeDeviceObj *
 virNodeDeviceObjListFindBySysfsPath(virNodeDeviceObjList *devs,
                                     const char *sysfs_path)
 {
-    return virNodeDeviceObjListSearch(devs,
-                                      virNodeDeviceObjListFindBySysfsPathCallback,
-                                      sysfs_path);
-}
+    virNodeDeviceObj *obj = NULL;
+    const char *name;
 
+    virObjectRWLockRead(devs);
+    if ((name = virHashLookup(devs->sysfsPaths, sysfs_path)))
+        obj = virNodeDeviceObjListFindByNameLocked(devs, name);
+    virObjectRWUnlock(devs);
 
-static virNodeDeviceObj *
-virNodeDeviceObjListFindByNameLocked(virNodeDeviceObjList *devs,
-                                     const char *name)
-{
-    return virObjectRef(virHashLookup(devs->objs, name));
+    if (!obj)
+        return NULL;
+
+    virObjectLock(obj);
+    if (STRNEQ_NULLABLE(obj->def->sysfs_path, sysfs_path))
+        virNodeDeviceObjEndAPI(&obj);
+
+    return obj;
 }
 
 
@@ -454,6 +453,7 @@ virNodeDeviceObjListDispose(void *obj)
     virNodeDeviceObjList *devs = obj;
 
     g_clear_pointer(&devs->objs, g_hash_table_unref);
+    g_clear_pointer(&devs->sysfsPaths, g_hash_table_unref);
 }
 
 
@@ -469,6 +469,7 @@ virNodeDeviceObjListNew(void)
         return NULL;
 
     devs->objs = virHashNew(virObjectFreeHashData);
+    devs->sysfsPaths = virHashNew(g_free);
 
     return devs;
 }
@@ -481,6 +482,34 @@ virNodeDeviceObjListFree(virNodeDeviceObjList *devs)
 }
 
 
+/* The caller must hold write lock on 'devs' */
+static void
+virNodeDeviceObjListIndexAdd(virNodeDeviceObjList *devs,
+                             virNodeDeviceDef *def)
+{
+    if (!def->sysfs_path)
+        return;
+
+    ignore_value(virHashUpdateEntry(devs->sysfsPaths, def->sysfs_path,
+                                    g_strdup(def->name)));
+}
+
+
+/* The caller must hold write lock on 'devs' */
+static void
+virNodeDeviceObjListIndexRemove(virNodeDeviceObjList *devs,
+                                virNodeDeviceDef *def)
+{
+    if (!def->sysfs_path)
+        return;
+
+    /* Another device may have taken over the path in the meantime */
+    if (STREQ_NULLABLE(virHashLookup(devs->sysfsPaths, def->sysfs_path),
+                       def->name))
+        virHashRemoveEntry(devs->sysfsPaths, def->sysfs_path);
+}
+
+
 virNodeDeviceObj *
 virNodeDeviceObjListAssignDef(virNodeDeviceObjList *devs,
                               virNodeDeviceDef *def)
@@ -491,6 +520,7 @@ virNodeDeviceObjListAssignDef(virNodeDeviceObjList *devs,
 
     if ((obj = virNodeDeviceObjListFindByNameLocked(devs, def->name))) {
         virObjectLock(obj);
+        virNodeDeviceObjListIndexRemove(devs, obj->def);
         virNodeDeviceDefFree(obj->def);
         obj->def = def;
     } else {
@@ -506,6 +536,8 @@ virNodeDeviceObjListAssignDef(virNodeDeviceObjList *devs,
         virObjectRef(obj);
     }
 
+    virNodeDeviceObjListIndexAdd(devs, def);
+
  cleanup:
     virObjectRWUnlock(devs);
     return obj;
@@ -534,6 +566,7 @@ void
 virNodeDeviceObjListRemoveLocked(virNodeDeviceObjList *devs,
                                  virNodeDeviceObj *dev)
 {
+    virNodeDeviceObjListIndexRemove(devs, dev->def);
     virHashRemoveEntry(devs->objs, dev->def->name);
 }
 
@@ -1058,6 +1091,7 @@ typedef struct _PredicateHelperData PredicateHelperData;
 struct _PredicateHelperData {
     virNodeDeviceObjListPredicate predicate;
     void *opaque;
+    virNodeDeviceObjList *devs;
 };
 
 static int virNodeDeviceObjListRemoveHelper(void *key G_GNUC_UNUSED,
@@ -1065,8 +1099,13 @@ static int virNodeDeviceObjListRemoveHelper(void *key G_GNUC_UNUSED,
                                             void *opaque)
 {
     PredicateHelperData *data = opaque;
+    virNodeDeviceObj *obj = value;
 
-    return data->predicate(value, data->opaque);
+    if (!data->predicate(obj, data->opaque))
+        return 0;
+
+    virNodeDeviceObjListIndexRemove(data->devs, obj->def);
+    return 1;
 }
 
 
@@ -1087,7 +1126,8 @@ virNodeDeviceObjListForEachRemove(virNodeDeviceObjList *devs,
 {
     PredicateHelperData data = {
         .predicate = callback,
-        .opaque = opaque
+        .opaque = opaque,
+        .devs = devs,
     };
 
     virObjectRWLockWrite(devs);
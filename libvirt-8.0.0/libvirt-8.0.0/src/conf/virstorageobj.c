@@ -92,6 +92,10 @@ struct _virStoragePoolObj {
     virStoragePoolDef *newDef;
 
     virStorageVolObjList *volumes;
+
+    /* name string -> virStorageVolDef of volumes known before
+     * the current refresh, see virStoragePoolObjStashVols */
+    GHashTable *stashedVols;
 };
 
 struct _virStoragePoolObjList {
@@ -368,6 +372,7 @@ virStoragePoolObjDispose(void *opaque)
 
     virStoragePoolObjClearVols(obj);
     virObjectUnref(obj->volumes);
+    virStoragePoolObjClearStashedVols(obj);
 
     virStoragePoolDefFree(obj->def);
     virStoragePoolDefFree(obj->newDef);
@@ -629,6 +634,71 @@ virStoragePoolObjClearVols(virStoragePoolObj *obj)
 }
 
 
+/**
+ * virStoragePoolObjStashVols:
+ * @obj: pool object
+ *
+ * Like virStoragePoolObjClearVols, but instead of freeing the volume
+ * definitions keep them aside so that a following refresh can reuse
+ * the ones which are still up to date through
+ * virStoragePoolObjTakeStashedVol. Whatever is not taken is freed by
+ * virStoragePoolObjClearStashedVols.
+ */
+void
+virStoragePoolObjStashVols(virStoragePoolObj *obj)
+{
+    GHashTableIter iter;
+    virStorageVolObj *volobj;
+
+    virStoragePoolObjClearStashedVols(obj);
+
+    if (!obj->volumes)
+        return;
+
+    obj->stashedVols = virHashNew((GDestroyNotify) virStorageVolDefFree);
+
+    virObjectRWLockWrite(obj->volumes);
+    g_hash_table_iter_init(&iter, obj->volumes->objsName);
+    while (g_hash_table_iter_next(&iter, NULL, (void **) &volobj)) {
+        virStorageVolDef *voldef;
+
+        virObjectLock(volobj);
+        voldef = g_steal_pointer(&volobj->voldef);
+        virObjectUnlock(volobj);
+
+        if (voldef &&
+            virHashAddEntry(obj->stashedVols, voldef->name, voldef) < 0)
+            virStorageVolDefFree(voldef);
+    }
+    virObjectRWUnlock(obj->volumes);
+
+    virStoragePoolObjClearVols(obj);
+}
+
+
+/**
+ * virStoragePoolObjTakeStashedVol:
+ * @obj: pool object
+ * @name: volume name
+ *
+ * Returns the stashed definition of volume @name, passing its
+ * ownership to the caller, or NULL if there is none.
+ */
+virStorageVolDef *
+virStoragePoolObjTakeStashedVol(virStoragePoolObj *obj,
+                                const char *name)
+{
+    return virHashSteal(obj->stashedVols, name);
+}
+
+
+void
+virStoragePoolObjClearStashedVols(virStoragePoolObj *obj)
+{
+    g_clear_pointer(&obj->stashedVols, g_hash_table_unref);
+}
+
+
 int
 virStoragePoolObjAddVol(virStoragePoolObj *obj,
                         virStorageVolDef *voldef)
@@ -888,12 +888,18 @@ virStoragePoolRef(virStoragePoolPtr pool)
 /**
  * virStoragePoolRefresh:
  * @pool: pointer to storage pool
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virStoragePoolRefreshFlags
  *
  * Request that the pool refresh its list of volumes. This may
  * involve communicating with a remote server, and/or initializing
  * new devices at the OS layer
  *
+ * If @flags contains VIR_STORAGE_POOL_REFRESH_INCREMENTAL, backends
+ * which support it keep the details of volumes which did not change
+ * since the previous refresh (as judged by their modification and
+ * change times) instead of probing them again. Other backends
+ * perform a full refresh.
+ *
  * Returns 0 if the volume list was refreshed, -1 on failure
  */
 int
@@ -1987,6 +1993,17 @@ virStorageVolGetInfo(virStorageVolPtr vol,
  * physical on disk usage can be different than the calculated allocation value
  * as is the case with qcow2 files.
  *
+ * If @flags contains VIR_STORAGE_VOL_GET_WIPE_PROGRESS, the progress of
+ * a wipe running on the volume is returned instead: the @info capacity
+ * field holds the number of bytes to be wiped and the allocation field
+ * the number of bytes wiped so far. Adding VIR_STORAGE_VOL_GET_WIPE_CANCEL
+ * additionally asks the wipe to stop; the virStorageVolWipe() or
+ * virStorageVolWipePattern() call then fails with
+ * VIR_ERR_OPERATION_ABORTED. Either flag fails with
+ * VIR_ERR_OPERATION_INVALID if no wipe is running, and neither may be
+ * combined with VIR_STORAGE_VOL_GET_PHYSICAL. The progress covers all
+ * passes of the wipe algorithm.
+ *
  * Returns 0 on success, or -1 on failure
  */
 int
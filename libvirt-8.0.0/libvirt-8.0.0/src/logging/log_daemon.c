@@ -29,6 +29,7 @@
 
 #include "log_daemon.h"
 #include "log_daemon_config.h"
+#include "admin/admin_server.h"
 #include "admin/admin_server_dispatch.h"
 #include "virutil.h"
 #include "virfile.h"
@@ -154,6 +155,7 @@ virLogDaemonNew(virLogDaemonConfig *config, bool privileged)
     if (!(logd->handler = virLogHandlerNew(privileged,
                                            config->max_size,
                                            config->max_backups,
+                                           config->max_rate,
                                            virLogDaemonInhibitor,
                                            logd)))
         goto error;
@@ -240,6 +242,7 @@ virLogDaemonNewPostExecRestart(virJSONValue *object, bool privileged,
                                                           privileged,
                                                           config->max_size,
                                                           config->max_backups,
+                                                          config->max_rate,
                                                           virLogDaemonInhibitor,
                                                           logd)))
         goto error;
@@ -252,6 +255,17 @@ virLogDaemonNewPostExecRestart(virJSONValue *object, bool privileged,
 }
 
 
+static int
+virLogDaemonGetDomainLogStats(virTypedParameterPtr *params,
+                              int *nparams,
+                              void *opaque)
+{
+    virLogDaemon *logd = opaque;
+
+    return virLogHandlerGetStats(virLogDaemonGetHandler(logd), params, nparams);
+}
+
+
 static void
 virLogDaemonErrorHandler(void *opaque G_GNUC_UNUSED,
                          virErrorPtr err G_GNUC_UNUSED)
@@ -901,6 +915,8 @@ int main(int argc, char **argv) {
             ret = VIR_DAEMON_ERR_INIT;
             goto cleanup;
         }
+
+        adminSetDomainLogStatsFunc(virLogDaemonGetDomainLogStats, logDaemon);
     }
 
     /* Disable error func, now logging is setup */
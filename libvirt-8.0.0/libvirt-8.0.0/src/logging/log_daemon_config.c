@@ -98,6 +98,8 @@ virLogDaemonConfigLoadOptions(virLogDaemonConfig *data,
         return -1;
     if (virConfGetValueSizeT(conf, "max_backups", &data->max_backups) < 0)
         return -1;
+    if (virConfGetValueSizeT(conf, "max_rate", &data->max_rate) < 0)
+        return -1;
 
     return 0;
 }
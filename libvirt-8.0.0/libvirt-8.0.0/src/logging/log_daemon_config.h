@@ -33,6 +33,7 @@ struct _virLogDaemonConfig {
 
     size_t max_backups;
     size_t max_size;
+    size_t max_rate;
 };
 
 
@@ -28,6 +28,7 @@
 #include "virstring.h"
 #include "virlog.h"
 #include "virrotatingfile.h"
+#include "virtypedparam.h"
 #include "viruuid.h"
 #include "virutil.h"
 
@@ -43,6 +44,22 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Data is moved from the pipes in chunks of up to this size, so that
+ * chatty guests result in a few large writes rather than many small
+ * ones */
+#define VIR_LOG_HANDLER_BUF_SIZE (64 * 1024)
+
+/* Upper bound on the data moved from a single pipe per event so that
+ * one guest can't starve the others */
+#define VIR_LOG_HANDLER_MAX_PER_EVENT (1024 * 1024)
+
+/* Smaller chunks of output are collected in a buffer of this size per
+ * log file, which is written once full or after the delay in
+ * milliseconds, so that a guest printing line by line doesn't cost a
+ * write() per line */
+#define VIR_LOG_HANDLER_FILE_BUF_SIZE (16 * 1024)
+#define VIR_LOG_HANDLER_FLUSH_DELAY 100
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 struct _virLogHandlerLogFile {
     virRotatingFileWriter *file;
@@ -50,6 +67,23 @@ struct _virLogHandlerLogFile {
     int pipefd; /* Read from QEMU via this */
     bool drained;
 
+    char *buf; /* VIR_LOG_HANDLER_FILE_BUF_SIZE bytes, allocated on use */
+    size_t buflen;
+    int timer; /* Flushes @buf */
+
+    /* Token bucket enforcing max_rate */
+    unsigned long long tokens;
+    unsigned long long lastRefill;
+    unsigned long long dropping; /* bytes dropped since rate got exceeded */
+
+    unsigned long long written;
+    unsigned long long dropped;
+
+    /* Throughput measured over windows of at least a second */
+    unsigned long long rateStart;
+    unsigned long long rateWritten;
+    unsigned long long rate;
+
     char *driver;
     unsigned char domuuid[VIR_UUID_BUFLEN];
     char *domname;
@@ -61,6 +95,9 @@ struct _virLogHandler {
     bool privileged;
     size_t max_size;
     size_t max_backups;
+    size_t max_rate;
+
+    char *buf; /* VIR_LOG_HANDLER_BUF_SIZE bytes */
 
     virLogHandlerLogFile **files;
     size_t nfiles;
@@ -84,6 +121,30 @@ virLogHandlerOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(virLogHandler);
 
 
+/*
+ * Write the output buffered for @file to the log file.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+virLogHandlerLogFileFlush(virLogHandlerLogFile *file)
+{
+    size_t buflen = file->buflen;
+
+    if (file->timer != -1)
+        virEventUpdateTimeout(file->timer, -1);
+
+    if (buflen == 0)
+        return 0;
+
+    file->buflen = 0;
+    if (virRotatingFileWriterAppend(file->file, file->buf, buflen) != (ssize_t) buflen)
+        return -1;
+
+    return 0;
+}
+
+
 static void
 virLogHandlerLogFileFree(virLogHandlerLogFile *file)
 {
@@ -91,11 +152,22 @@ virLogHandlerLogFileFree(virLogHandlerLogFile *file)
         return;
 
     VIR_FORCE_CLOSE(file->pipefd);
+    if (file->file && virLogHandlerLogFileFlush(file) < 0)
+        VIR_WARN("Unable to write buffered output of domain %s",
+                 NULLSTR(file->domname));
     virRotatingFileWriterFree(file->file);
 
     if (file->watch != -1)
         virEventRemoveHandle(file->watch);
 
+    if (file->timer != -1)
+        virEventRemoveTimeout(file->timer);
+
+    if (file->written || file->dropped)
+        VIR_INFO("Closing log of domain %s: %llu bytes written, %llu dropped",
+                 NULLSTR(file->domname), file->written, file->dropped);
+
+    g_free(file->buf);
     g_free(file->driver);
     g_free(file->domname);
     g_free(file);
@@ -133,6 +205,169 @@ virLogHandlerGetLogFileFromWatch(virLogHandler *handler,
 }
 
 
+static virLogHandlerLogFile *
+virLogHandlerGetLogFileFromTimer(virLogHandler *handler,
+                                 int timer)
+{
+    size_t i;
+
+    for (i = 0; i < handler->nfiles; i++) {
+        if (handler->files[i]->timer == timer)
+            return handler->files[i];
+    }
+
+    return NULL;
+}
+
+
+static virLogHandlerLogFile *
+virLogHandlerGetLogFileFromPath(virLogHandler *handler,
+                                const char *path)
+{
+    size_t i;
+
+    for (i = 0; i < handler->nfiles; i++) {
+        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file), path))
+            return handler->files[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Returns the number of bytes @file may write now without exceeding
+ * the configured rate.
+ */
+static size_t
+virLogHandlerLogFileQuota(virLogHandler *handler,
+                          virLogHandlerLogFile *file)
+{
+    unsigned long long now;
+    unsigned long long elapsed;
+
+    if (handler->max_rate == 0)
+        return SIZE_MAX;
+
+    now = g_get_monotonic_time();
+    if (file->lastRefill == 0) {
+        file->tokens = handler->max_rate;
+    } else {
+        elapsed = MIN(now - file->lastRefill, G_USEC_PER_SEC);
+        file->tokens += elapsed * handler->max_rate / G_USEC_PER_SEC;
+        file->tokens = MIN(file->tokens, handler->max_rate);
+    }
+    file->lastRefill = now;
+
+    return MIN(file->tokens, SIZE_MAX);
+}
+
+
+static void
+virLogHandlerLogFileAccount(virLogHandler *handler,
+                            virLogHandlerLogFile *file,
+                            size_t written,
+                            size_t dropped)
+{
+    unsigned long long now = g_get_monotonic_time();
+
+    file->written += written;
+    file->rateWritten += written;
+    if (file->rateStart == 0) {
+        file->rateStart = now;
+    } else if (now - file->rateStart >= G_USEC_PER_SEC) {
+        file->rate = file->rateWritten * G_USEC_PER_SEC / (now - file->rateStart);
+        file->rateStart = now;
+        file->rateWritten = 0;
+    }
+
+    if (handler->max_rate)
+        file->tokens -= MIN(file->tokens, written);
+
+    if (dropped) {
+        if (file->dropping == 0)
+            VIR_WARN("Output of domain %s exceeds %zu bytes/s, dropping it",
+                     NULLSTR(file->domname), handler->max_rate);
+        file->dropping += dropped;
+        file->dropped += dropped;
+    }
+}
+
+
+/*
+ * Move the data available in the pipe of @file to the log file. The
+ * data goes through the O_APPEND descriptor of the file rather than
+ * being spliced, as splice() refuses append-only files and writing at
+ * a cached offset would clobber anything else appended to the log.
+ * Small chunks are collected in the buffer of @file first.
+ *
+ * Unless @unlimited is true, data exceeding the rate limit is read
+ * and dropped so that the guest is never stalled.
+ *
+ * Returns the number of bytes consumed from the pipe, 0 if the pipe
+ * was empty, -1 on error or EOF.
+ */
+static ssize_t
+virLogHandlerLogFileMove(virLogHandler *handler,
+                         virLogHandlerLogFile *file,
+                         bool unlimited)
+{
+    size_t quota = virLogHandlerLogFileQuota(handler, file);
+    size_t towrite;
+    ssize_t len;
+
+    if (unlimited)
+        quota = SIZE_MAX;
+
+    if (quota > 0 && file->dropping > 0) {
+        g_autofree char *msg = NULL;
+
+        msg = g_strdup_printf("\nvirtlogd: dropped %llu bytes of output "
+                              "exceeding the rate limit\n", file->dropping);
+        file->dropping = 0;
+        if (virLogHandlerLogFileFlush(file) < 0 ||
+            virRotatingFileWriterAppend(file->file, msg, strlen(msg)) < 0)
+            return -1;
+    }
+
+ reread:
+    len = read(file->pipefd, handler->buf, VIR_LOG_HANDLER_BUF_SIZE);
+    if (len < 0) {
+        if (errno == EINTR)
+            goto reread;
+        if (errno == EAGAIN)
+            return 0;
+
+        virReportSystemError(errno, "%s",
+                             _("Unable to read from log pipe"));
+        return -1;
+    } else if (len == 0) {
+        return -1;
+    }
+
+    towrite = MIN((size_t) len, quota);
+
+    if (file->buflen + towrite > VIR_LOG_HANDLER_FILE_BUF_SIZE &&
+        virLogHandlerLogFileFlush(file) < 0)
+        return -1;
+
+    if (towrite >= VIR_LOG_HANDLER_FILE_BUF_SIZE) {
+        if (virRotatingFileWriterAppend(file->file, handler->buf, towrite) != (ssize_t) towrite)
+            return -1;
+    } else if (towrite > 0) {
+        if (!file->buf)
+            file->buf = g_new0(char, VIR_LOG_HANDLER_FILE_BUF_SIZE);
+        memcpy(file->buf + file->buflen, handler->buf, towrite);
+        if (file->buflen == 0)
+            virEventUpdateTimeout(file->timer, VIR_LOG_HANDLER_FLUSH_DELAY);
+        file->buflen += towrite;
+    }
+
+    virLogHandlerLogFileAccount(handler, file, towrite, len - towrite);
+    return len;
+}
+
+
 static void
 virLogHandlerDomainLogFileEvent(int watch,
                                 int fd,
@@ -141,7 +376,7 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandler *handler = opaque;
     virLogHandlerLogFile *logfile;
-    char buf[1024];
+    size_t moved = 0;
     ssize_t len;
 
     virObjectLock(handler);
@@ -157,22 +392,14 @@ virLogHandlerDomainLogFileEvent(int watch,
         goto cleanup;
     }
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
-
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
-    } else if (len == 0) {
-        goto error;
+    while (moved < VIR_LOG_HANDLER_MAX_PER_EVENT) {
+        if ((len = virLogHandlerLogFileMove(handler, logfile, false)) < 0)
+            goto error;
+        if (len == 0)
+            break;
+        moved += len;
     }
 
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
-        goto error;
-
  cleanup:
     virObjectUnlock(handler);
     return;
@@ -184,10 +411,35 @@ virLogHandlerDomainLogFileEvent(int watch,
 }
 
 
+static void
+virLogHandlerDomainLogFileTimer(int timer,
+                                void *opaque)
+{
+    virLogHandler *handler = opaque;
+    virLogHandlerLogFile *logfile;
+
+    virObjectLock(handler);
+    logfile = virLogHandlerGetLogFileFromTimer(handler, timer);
+    if (!logfile) {
+        virEventUpdateTimeout(timer, -1);
+        virObjectUnlock(handler);
+        return;
+    }
+
+    if (virLogHandlerLogFileFlush(logfile) < 0) {
+        handler->inhibitor(false, handler->opaque);
+        virLogHandlerLogFileClose(handler, logfile);
+    }
+
+    virObjectUnlock(handler);
+}
+
+
 virLogHandler *
 virLogHandlerNew(bool privileged,
                  size_t max_size,
                  size_t max_backups,
+                 size_t max_rate,
                  virLogHandlerShutdownInhibitor inhibitor,
                  void *opaque)
 {
@@ -202,6 +454,8 @@ virLogHandlerNew(bool privileged,
     handler->privileged = privileged;
     handler->max_size = max_size;
     handler->max_backups = max_backups;
+    handler->max_rate = max_rate;
+    handler->buf = g_new0(char, VIR_LOG_HANDLER_BUF_SIZE);
     handler->inhibitor = inhibitor;
     handler->opaque = opaque;
 
@@ -219,6 +473,7 @@ virLogHandlerLogFilePostExecRestart(virLogHandler *handler,
     const char *tmp;
 
     file = g_new0(virLogHandlerLogFile, 1);
+    file->timer = -1;
 
     handler->inhibitor(true, handler->opaque);
 
@@ -270,6 +525,11 @@ virLogHandlerLogFilePostExecRestart(virLogHandler *handler,
                              _("Cannot enable close-on-exec flag"));
         goto error;
     }
+    if (virSetNonBlock(file->pipefd) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot enable non-blocking mode on log pipe"));
+        goto error;
+    }
 
     return file;
 
@@ -285,6 +545,7 @@ virLogHandlerNewPostExecRestart(virJSONValue *object,
                                 bool privileged,
                                 size_t max_size,
                                 size_t max_backups,
+                                size_t max_rate,
                                 virLogHandlerShutdownInhibitor inhibitor,
                                 void *opaque)
 {
@@ -295,6 +556,7 @@ virLogHandlerNewPostExecRestart(virJSONValue *object,
     if (!(handler = virLogHandlerNew(privileged,
                                      max_size,
                                      max_backups,
+                                     max_rate,
                                      inhibitor,
                                      opaque)))
         return NULL;
@@ -324,7 +586,11 @@ virLogHandlerNewPostExecRestart(virJSONValue *object,
                                              VIR_EVENT_HANDLE_READABLE,
                                              virLogHandlerDomainLogFileEvent,
                                              handler,
-                                             NULL)) < 0) {
+                                             NULL)) < 0 ||
+            (file->timer = virEventAddTimeout(-1,
+                                              virLogHandlerDomainLogFileTimer,
+                                              handler,
+                                              NULL)) < 0) {
             VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
             goto error;
         }
@@ -350,6 +616,7 @@ virLogHandlerDispose(void *obj)
         virLogHandlerLogFileFree(handler->files[i]);
     }
     g_free(handler->files);
+    g_free(handler->buf);
 }
 
 
@@ -384,9 +651,17 @@ virLogHandlerDomainOpenLogFile(virLogHandler *handler,
     if (virPipe(pipefd) < 0)
         goto error;
 
+    /* The write end is handed to QEMU and stays blocking */
+    if (virSetNonBlock(pipefd[0]) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot enable non-blocking mode on log pipe"));
+        goto error;
+    }
+
     file = g_new0(virLogHandlerLogFile, 1);
 
     file->watch = -1;
+    file->timer = -1;
     file->pipefd = pipefd[0];
     pipefd[0] = -1;
     memcpy(file->domuuid, domuuid, VIR_UUID_BUFLEN);
@@ -406,7 +681,11 @@ virLogHandlerDomainOpenLogFile(virLogHandler *handler,
                                          VIR_EVENT_HANDLE_READABLE,
                                          virLogHandlerDomainLogFileEvent,
                                          handler,
-                                         NULL)) < 0) {
+                                         NULL)) < 0 ||
+        (file->timer = virEventAddTimeout(-1,
+                                          virLogHandlerDomainLogFileTimer,
+                                          handler,
+                                          NULL)) < 0) {
         VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
         goto error;
     }
@@ -427,11 +706,15 @@ virLogHandlerDomainOpenLogFile(virLogHandler *handler,
 }
 
 
+/*
+ * Write everything QEMU has output so far to the log file, so that the
+ * position reported afterwards covers it. The rate limit doesn't apply
+ * here, as the caller is waiting for exactly this output.
+ */
 static void
-virLogHandlerDomainLogFileDrain(virLogHandlerLogFile *file)
+virLogHandlerDomainLogFileDrain(virLogHandler *handler,
+                                virLogHandlerLogFile *file)
 {
-    char buf[1024];
-    ssize_t len;
     struct pollfd pfd;
     int ret;
 
@@ -445,25 +728,18 @@ virLogHandlerDomainLogFileDrain(virLogHandlerLogFile *file)
             if (errno == EINTR)
                 continue;
 
-            return;
+            break;
         }
 
         if (ret == 0)
-            return;
+            break;
 
-        len = read(file->pipefd, buf, sizeof(buf));
         file->drained = true;
-        if (len < 0) {
-            if (errno == EINTR)
-                continue;
-            return;
-        } else if (len == 0) {
-            return;
-        }
-
-        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
-            return;
+        if (virLogHandlerLogFileMove(handler, file, true) <= 0)
+            break;
     }
+
+    ignore_value(virLogHandlerLogFileFlush(file));
 }
 
 
@@ -476,28 +752,19 @@ virLogHandlerDomainGetLogFilePosition(virLogHandler *handler,
 {
     virLogHandlerLogFile *file = NULL;
     int ret = -1;
-    size_t i;
 
     virCheckFlags(0, -1);
 
     virObjectLock(handler);
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
-                  path)) {
-            file = handler->files[i];
-            break;
-        }
-    }
-
-    if (!file) {
+    if (!(file = virLogHandlerGetLogFileFromPath(handler, path))) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("No open log file %s"),
                        path);
         goto cleanup;
     }
 
-    virLogHandlerDomainLogFileDrain(file);
+    virLogHandlerDomainLogFileDrain(handler, file);
 
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
@@ -519,6 +786,7 @@ virLogHandlerDomainReadLogFile(virLogHandler *handler,
                                unsigned int flags)
 {
     virRotatingFileReader *file = NULL;
+    virLogHandlerLogFile *logfile;
     char *data = NULL;
     ssize_t got;
 
@@ -526,6 +794,10 @@ virLogHandlerDomainReadLogFile(virLogHandler *handler,
 
     virObjectLock(handler);
 
+    if ((logfile = virLogHandlerGetLogFileFromPath(handler, path)) &&
+        virLogHandlerLogFileFlush(logfile) < 0)
+        goto error;
+
     if (!(file = virRotatingFileReaderNew(path, handler->max_backups)))
         goto error;
 
@@ -560,7 +832,7 @@ virLogHandlerDomainAppendLogFile(virLogHandler *handler,
                                  const char *message,
                                  unsigned int flags)
 {
-    size_t i;
+    virLogHandlerLogFile *file;
     virRotatingFileWriter *writer = NULL;
     virRotatingFileWriter *newwriter = NULL;
     int ret = -1;
@@ -571,14 +843,12 @@ virLogHandlerDomainAppendLogFile(virLogHandler *handler,
 
     virObjectLock(handler);
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file), path)) {
-            writer = handler->files[i]->file;
-            break;
-        }
-    }
-
-    if (!writer) {
+    /* Keep the message after the output QEMU wrote before it */
+    if ((file = virLogHandlerGetLogFileFromPath(handler, path))) {
+        if (virLogHandlerLogFileFlush(file) < 0)
+            goto cleanup;
+        writer = file->file;
+    } else {
         if (!(newwriter = virRotatingFileWriterNew(path,
                                                    handler->max_size,
                                                    handler->max_backups,
@@ -601,6 +871,63 @@ virLogHandlerDomainAppendLogFile(virLogHandler *handler,
 }
 
 
+/*
+ * Report the throughput of the guest log files currently open, in
+ * the form of "log.<num>.<field>" parameters
+ */
+int
+virLogHandlerGetStats(virLogHandler *handler,
+                      virTypedParameterPtr *params,
+                      int *nparams)
+{
+    g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+    unsigned long long now = g_get_monotonic_time();
+    char domuuid[VIR_UUID_STRING_BUFLEN];
+    size_t i;
+    int ret = -1;
+
+    virObjectLock(handler);
+
+    if (virTypedParamListAddUInt(list, handler->nfiles, "log.count") < 0)
+        goto cleanup;
+
+    for (i = 0; i < handler->nfiles; i++) {
+        virLogHandlerLogFile *file = handler->files[i];
+        unsigned long long rate = file->rate;
+
+        /* Don't report a stale rate for a guest which went quiet */
+        if (file->rateStart && now - file->rateStart >= G_USEC_PER_SEC)
+            rate = file->rateWritten * G_USEC_PER_SEC / (now - file->rateStart);
+
+        virUUIDFormat(file->domuuid, domuuid);
+
+        if (virTypedParamListAddString(list,
+                                       virRotatingFileWriterGetPath(file->file),
+                                       "log.%zu.path", i) < 0 ||
+            virTypedParamListAddString(list, NULLSTR_EMPTY(file->driver),
+                                       "log.%zu.driver", i) < 0 ||
+            virTypedParamListAddString(list, NULLSTR_EMPTY(file->domname),
+                                       "log.%zu.domain.name", i) < 0 ||
+            virTypedParamListAddString(list, domuuid,
+                                       "log.%zu.domain.uuid", i) < 0 ||
+            virTypedParamListAddULLong(list, file->written,
+                                       "log.%zu.written", i) < 0 ||
+            virTypedParamListAddULLong(list, file->dropped,
+                                       "log.%zu.dropped", i) < 0 ||
+            virTypedParamListAddULLong(list, rate,
+                                       "log.%zu.rate", i) < 0)
+            goto cleanup;
+    }
+
+    *nparams = virTypedParamListStealParams(list, params);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(handler);
+    return ret;
+}
+
+
 virJSONValue *
 virLogHandlerPreExecRestart(virLogHandler *handler)
 {
@@ -612,6 +939,10 @@ virLogHandlerPreExecRestart(virLogHandler *handler)
     for (i = 0; i < handler->nfiles; i++) {
         g_autoptr(virJSONValue) file = virJSONValueNewObject();
 
+        /* The buffer doesn't survive the re-exec */
+        if (virLogHandlerLogFileFlush(handler->files[i]) < 0)
+            return NULL;
+
         if (virJSONValueObjectAppendNumberInt(file, "pipefd",
                                               handler->files[i]->pipefd) < 0)
             return NULL;
@@ -32,12 +32,14 @@ typedef void (*virLogHandlerShutdownInhibitor)(bool inhibit,
 virLogHandler *virLogHandlerNew(bool privileged,
                                   size_t max_size,
                                   size_t max_backups,
+                                  size_t max_rate,
                                   virLogHandlerShutdownInhibitor inhibitor,
                                   void *opaque);
 virLogHandler *virLogHandlerNewPostExecRestart(virJSONValue *child,
                                                  bool privileged,
                                                  size_t max_size,
                                                  size_t max_backups,
+                                                 size_t max_rate,
                                                  virLogHandlerShutdownInhibitor inhibitor,
                                                  void *opaque);
 
@@ -73,4 +75,8 @@ int virLogHandlerDomainAppendLogFile(virLogHandler *handler,
                                      const char *message,
                                      unsigned int flags);
 
+int virLogHandlerGetStats(virLogHandler *handler,
+                          virTypedParameterPtr *params,
+                          int *nparams);
+
 virJSONValue *virLogHandlerPreExecRestart(virLogHandler *handler);
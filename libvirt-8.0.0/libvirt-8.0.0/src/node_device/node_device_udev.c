@@ -1491,20 +1491,12 @@ udevSetParent(struct udev_device *device,
     return 0;
 }
 
-static int
-udevAddOneDevice(struct udev_device *device)
+/* Gather everything about @device which doesn't depend on other devices.
+ * Returns the new definition or NULL if @device is not interesting. */
+static virNodeDeviceDef *
+udevNewDeviceDef(struct udev_device *device)
 {
-    virNodeDeviceDef *def = NULL;
-    virNodeDeviceObj *obj = NULL;
-    virNodeDeviceDef *objdef;
-    virObjectEvent *event = NULL;
-    bool new_device = true;
-    int ret = -1;
-    bool persistent = false;
-    bool autostart = false;
-    bool is_mdev;
-
-    def = g_new0(virNodeDeviceDef, 1);
+    g_autoptr(virNodeDeviceDef) def = g_new0(virNodeDeviceDef, 1);
 
     def->sysfs_path = g_strdup(udev_device_get_syspath(device));
 
@@ -1512,14 +1504,30 @@ udevAddOneDevice(struct udev_device *device)
 
     def->caps = g_new0(virNodeDevCapsDef, 1);
 
-    if (udevGetDeviceType(device, &def->caps->data.type) != 0)
-        goto cleanup;
+    if (udevGetDeviceType(device, &def->caps->data.type) != 0 ||
+        udevGetDeviceNodes(device, def) != 0 ||
+        udevGetDeviceDetails(device, def) != 0) {
+        VIR_DEBUG("Discarding device %p %s", def, def->sysfs_path);
+        return NULL;
+    }
 
-    if (udevGetDeviceNodes(device, def) != 0)
-        goto cleanup;
+    return g_steal_pointer(&def);
+}
 
-    if (udevGetDeviceDetails(device, def) != 0)
-        goto cleanup;
+
+/* Consumes @def */
+static int
+udevAddOneDeviceDef(struct udev_device *device,
+                    virNodeDeviceDef *def)
+{
+    virNodeDeviceObj *obj = NULL;
+    virNodeDeviceDef *objdef;
+    virObjectEvent *event = NULL;
+    bool new_device = true;
+    int ret = -1;
+    bool persistent = false;
+    bool autostart = false;
+    bool is_mdev;
 
     if (udevSetParent(device, def) != 0)
         goto cleanup;
@@ -1567,7 +1575,7 @@ udevAddOneDevice(struct udev_device *device)
 
     if (ret != 0) {
         VIR_DEBUG("Discarding device %d %p %s", ret, def,
-                  def ? NULLSTR(def->sysfs_path) : "");
+                  NULLSTR(def->sysfs_path));
         virNodeDeviceDefFree(def);
     }
 
@@ -1576,28 +1584,14 @@ udevAddOneDevice(struct udev_device *device)
 
 
 static int
-udevProcessDeviceListEntry(struct udev *udev,
-                           struct udev_list_entry *list_entry)
+udevAddOneDevice(struct udev_device *device)
 {
-    struct udev_device *device;
-    const char *name = NULL;
-    int ret = -1;
-
-    name = udev_list_entry_get_name(list_entry);
-
-    device = udev_device_new_from_syspath(udev, name);
-
-    if (device != NULL) {
-        if (udevAddOneDevice(device) != 0) {
-            VIR_DEBUG("Failed to create node device for udev device '%s'",
-                      name);
-        }
-        ret = 0;
-    }
+    virNodeDeviceDef *def;
 
-    udev_device_unref(device);
+    if (!(def = udevNewDeviceDef(device)))
+        return -1;
 
-    return ret;
+    return udevAddOneDeviceDef(device, def);
 }
 
 
@@ -1625,11 +1619,63 @@ udevEnumerateAddMatches(struct udev_enumerate *udev_enumerate)
 }
 
 
+/* Upper bound on the number of threads gathering device details
+ * during the initial enumeration */
+#define UDEV_ENUMERATE_WORKERS 8
+
+typedef struct _udevEnumerateEntry udevEnumerateEntry;
+struct _udevEnumerateEntry {
+    char *syspath;
+    struct udev_device *device;
+    virNodeDeviceDef *def;
+};
+
+typedef struct _udevEnumerateData udevEnumerateData;
+struct _udevEnumerateData {
+    udevEnumerateEntry *entries;
+    size_t nentries;
+    int next;       /* index of the next entry to process, atomic */
+
+    /* libudev objects must not be shared between threads, so each
+     * thread claims a context of its own from here */
+    struct udev *udevs[UDEV_ENUMERATE_WORKERS];
+    int nextUdev;   /* index of the next unclaimed context, atomic */
+};
+
+
+static void
+udevEnumerateWorker(void *opaque)
+{
+    udevEnumerateData *data = opaque;
+    struct udev *udev = data->udevs[g_atomic_int_add(&data->nextUdev, 1)];
+    int idx;
+
+    while ((idx = g_atomic_int_add(&data->next, 1)) < (int) data->nentries) {
+        udevEnumerateEntry *entry = &data->entries[idx];
+
+        if (!(entry->device = udev_device_new_from_syspath(udev, entry->syspath)))
+            continue;
+
+        entry->def = udevNewDeviceDef(entry->device);
+    }
+}
+
+
+/*
+ * Probing a device depends on nothing but the device itself, except for
+ * finding its parent. The details of all devices are therefore gathered
+ * by up to UDEV_ENUMERATE_WORKERS threads first, then the devices are
+ * added one by one in the order udev listed them, which has parents first.
+ */
 static int
 udevEnumerateDevices(struct udev *udev)
 {
     struct udev_enumerate *udev_enumerate = NULL;
     struct udev_list_entry *list_entry = NULL;
+    udevEnumerateData data = { 0 };
+    virThread threads[UDEV_ENUMERATE_WORKERS - 1];
+    size_t nthreads = 0;
+    size_t i;
     int ret = -1;
 
     udev_enumerate = udev_enumerate_new(udev);
@@ -1641,12 +1687,55 @@ udevEnumerateDevices(struct udev *udev)
 
     udev_list_entry_foreach(list_entry,
                             udev_enumerate_get_list_entry(udev_enumerate)) {
+        udevEnumerateEntry entry = { 0 };
+
+        entry.syspath = g_strdup(udev_list_entry_get_name(list_entry));
+        VIR_APPEND_ELEMENT(data.entries, data.nentries, entry);
+    }
+
+    VIR_DEBUG("Enumerating %zu devices", data.nentries);
+
+    data.udevs[0] = udev;
+    while (nthreads + 1 < MIN(data.nentries, UDEV_ENUMERATE_WORKERS)) {
+        if (!(data.udevs[nthreads + 1] = udev_new()))
+            break;
+
+        if (virThreadCreateFull(&threads[nthreads], true, udevEnumerateWorker,
+                                "udev-enumerate", false, &data) < 0) {
+            VIR_WARN("Failed to start device enumeration thread, continuing with %zu",
+                     nthreads + 1);
+            virResetLastError();
+            g_clear_pointer(&data.udevs[nthreads + 1], udev_unref);
+            break;
+        }
+        nthreads++;
+    }
 
-        udevProcessDeviceListEntry(udev, list_entry);
+    udevEnumerateWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    for (i = 0; i < data.nentries; i++) {
+        udevEnumerateEntry *entry = &data.entries[i];
+
+        if (!entry->def ||
+            udevAddOneDeviceDef(entry->device, g_steal_pointer(&entry->def)) != 0) {
+            VIR_DEBUG("Failed to create node device for udev device '%s'",
+                      entry->syspath);
+        }
     }
 
     ret = 0;
  cleanup:
+    for (i = 0; i < data.nentries; i++) {
+        if (data.entries[i].device)
+            udev_device_unref(data.entries[i].device);
+        g_free(data.entries[i].syspath);
+    }
+    g_free(data.entries);
+    for (i = 1; i <= nthreads; i++)
+        udev_unref(data.udevs[i]);
     udev_enumerate_unref(udev_enumerate);
     return ret;
 }
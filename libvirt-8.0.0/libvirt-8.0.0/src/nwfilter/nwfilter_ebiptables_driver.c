@@ -90,6 +90,11 @@ static enum ctdirStatus iptables_ctdir_corrected;
 
 static bool newMatchState;
 
+/* Flags for the transactions which build a VM's filter; set to
+ * VIR_FIREWALL_TRANSACTION_BATCH when all the *-restore tools are
+ * available so the rules are loaded in bulk */
+static unsigned int ebiptablesTransactionFlags;
+
 #define MATCH_PHYSDEV_IN_FW   "-m", "physdev", "--physdev-in"
 #define MATCH_PHYSDEV_OUT_FW  "-m", "physdev", "--physdev-is-bridged", "--physdev-out"
 #define MATCH_PHYSDEV_OUT_OLD_FW  "-m", "physdev", "--physdev-out"
@@ -2860,7 +2865,7 @@ ebtablesApplyBasicRules(const char *ifname,
     if (ebiptablesAllTeardown(ifname) < 0)
         return -1;
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, ebiptablesTransactionFlags);
 
     ebtablesCreateTmpRootChainFW(fw, true, ifname);
 
@@ -2930,7 +2935,7 @@ ebtablesApplyDHCPOnlyRules(const char *ifname,
     if (ebiptablesAllTeardown(ifname) < 0)
         return -1;
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, ebiptablesTransactionFlags);
 
     ebtablesCreateTmpRootChainFW(fw, true, ifname);
     ebtablesCreateTmpRootChainFW(fw, false, ifname);
@@ -3030,7 +3035,7 @@ ebtablesApplyDropAllRules(const char *ifname)
     if (ebiptablesAllTeardown(ifname) < 0)
         return -1;
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, ebiptablesTransactionFlags);
 
     ebtablesCreateTmpRootChainFW(fw, true, ifname);
     ebtablesCreateTmpRootChainFW(fw, false, ifname);
@@ -3335,6 +3340,7 @@ ebiptablesApplyNewRules(const char *ifname,
     bool haveIp6tables = false;
     g_autofree ebtablesSubChainInst **subchains = NULL;
     size_t nsubchains = 0;
+    unsigned long long start = g_get_monotonic_time();
     int ret = -1;
 
     if (nrules)
@@ -3349,7 +3355,7 @@ ebiptablesApplyNewRules(const char *ifname,
     ebtablesRemoveTmpRootChainFW(fw, true, ifname);
     ebtablesRemoveTmpRootChainFW(fw, false, ifname);
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, ebiptablesTransactionFlags);
 
     /* walk the list of rules and increase the priority
      * of rules in case the chain priority is of higher value;
@@ -3519,6 +3525,10 @@ ebiptablesApplyNewRules(const char *ifname,
     if (virFirewallApply(fw) < 0)
         goto cleanup;
 
+    VIR_INFO("Applied %zu filter rules for '%s' in %llu us (flags=0x%x)",
+             nrules, ifname, g_get_monotonic_time() - start,
+             ebiptablesTransactionFlags);
+
     ret = 0;
 
  cleanup:
@@ -3723,6 +3733,35 @@ ebiptablesDriverProbeStateMatch(void)
     return 0;
 }
 
+/*
+ * Check whether the ebtables-restore, iptables-restore and
+ * ip6tables-restore tools are installed, in which case whole
+ * filter transactions can be loaded with one process per layer.
+ */
+static void
+ebiptablesDriverProbeRestore(void)
+{
+    const char *const progs[] = {
+        EBTABLES_RESTORE, IPTABLES_RESTORE, IP6TABLES_RESTORE,
+    };
+    size_t i;
+
+    ebiptablesTransactionFlags = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(progs); i++) {
+        g_autofree char *path = virFindFileInPath(progs[i]);
+
+        if (!path) {
+            VIR_INFO("'%s' not found, applying filter rules individually",
+                     progs[i]);
+            return;
+        }
+    }
+
+    ebiptablesTransactionFlags = VIR_FIREWALL_TRANSACTION_BATCH;
+}
+
+
 static int
 ebiptablesDriverInit(bool privileged)
 {
@@ -3732,6 +3771,7 @@ ebiptablesDriverInit(bool privileged)
     ebiptablesDriverProbeCtdir();
     if (ebiptablesDriverProbeStateMatch() < 0)
         return -1;
+    ebiptablesDriverProbeRestore();
 
     ebiptables_driver.flags = TECHDRV_FLAG_INITIALIZED;
 
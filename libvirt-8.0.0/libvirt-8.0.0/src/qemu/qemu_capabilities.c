@@ -1109,6 +1109,35 @@ virQEMUCapsProbeHostCPU(virArch hostArch,
 }
 
 
+/*
+ * Populate @cache with capabilities of the default emulator binaries
+ * for all guest architectures. Binaries which need to be probed are
+ * probed in parallel rather than launching QEMU for each of them in
+ * turn.
+ */
+static void
+virQEMUCapsCachePrefetch(virFileCache *cache,
+                         virArch hostarch)
+{
+    g_auto(GStrv) binaries = g_new0(char *, VIR_ARCH_LAST + 1);
+    size_t nbinaries = 0;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        g_autofree char *binary = virQEMUCapsGetDefaultEmulator(hostarch, i);
+
+        if (!binary ||
+            !virFileIsExecutable(binary) ||
+            g_strv_contains((const char **)binaries, binary))
+            continue;
+
+        binaries[nbinaries++] = g_steal_pointer(&binary);
+    }
+
+    virFileCachePrefetch(cache, (const char **)binaries, nbinaries);
+}
+
+
 virCaps *
 virQEMUCapsInit(virFileCache *cache)
 {
@@ -1142,6 +1171,8 @@ virQEMUCapsInit(virFileCache *cache)
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
      */
+    virQEMUCapsCachePrefetch(cache, hostarch);
+
     for (i = 0; i < VIR_ARCH_LAST; i++)
         if (virQEMUCapsInitGuest(caps, cache,
                                  hostarch,
@@ -4055,7 +4086,10 @@ struct _virQEMUCapsCachePriv {
     char *kernelVersion;
     char *hostCPUSignature;
 
-    /* cache whether /dev/kvm is usable as runUid:runGuid */
+    /* cache whether /dev/kvm is usable as runUid:runGuid,
+     * guarded by kvmLock as capabilities may be validated
+     * from several threads at once */
+    virMutex kvmLock;
     virTristateBool kvmUsable;
     time_t kvmCtime;
 };
@@ -4071,6 +4105,7 @@ virQEMUCapsCachePrivFree(void *privData)
     g_free(priv->kernelVersion);
     virCPUDataFree(priv->cpuData);
     g_free(priv->hostCPUSignature);
+    virMutexDestroy(&priv->kvmLock);
     g_free(priv);
 }
 
@@ -4833,9 +4868,14 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePriv *priv)
     struct stat sb;
     static const char *kvm_device = "/dev/kvm";
     virTristateBool value;
-    virTristateBool cached_value = priv->kvmUsable;
+    virTristateBool cached_value;
     time_t kvm_ctime;
-    time_t cached_kvm_ctime = priv->kvmCtime;
+    time_t cached_kvm_ctime;
+
+    virMutexLock(&priv->kvmLock);
+    cached_value = priv->kvmUsable;
+    cached_kvm_ctime = priv->kvmCtime;
+    virMutexUnlock(&priv->kvmLock);
 
     if (stat(kvm_device, &sb) < 0) {
         if (errno != ENOENT) {
@@ -4867,8 +4907,10 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePriv *priv)
      * detecting changes *after* the virFileAccessibleAs check, we can
      * neglect this here.
      */
+    virMutexLock(&priv->kvmLock);
     priv->kvmCtime = kvm_ctime;
     priv->kvmUsable = value;
+    virMutexUnlock(&priv->kvmLock);
 
     return value == VIR_TRISTATE_BOOL_YES;
 }
@@ -5642,6 +5684,12 @@ virQEMUCapsCacheNew(const char *libDir,
         goto error;
 
     priv = g_new0(virQEMUCapsCachePriv, 1);
+    if (virMutexInit(&priv->kvmLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize mutex"));
+        g_free(priv);
+        goto error;
+    }
     virFileCacheSetPriv(cache, priv);
 
     priv->libDir = g_strdup(libDir);
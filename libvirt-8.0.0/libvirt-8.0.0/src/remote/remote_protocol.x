@@ -6512,6 +6512,7 @@ enum remote_procedure {
      * @generate: server
      * @priority: high
      * @acl: storage_vol:read
+     * @acl: storage_vol:format:VIR_STORAGE_VOL_GET_WIPE_CANCEL
      */
     REMOTE_PROC_STORAGE_VOL_GET_INFO_FLAGS = 378,
 
@@ -111,6 +111,25 @@ virSecurityDACChownListAppend(virSecurityDACChownList *list,
                               bool restore)
 {
     g_autoptr(virSecurityDACChownItem) item = NULL;
+    size_t i;
+
+    /* The same path is often relabelled several times within one
+     * transaction, e.g. an image shared by more backing chains. Doing
+     * it once is enough, unless the original owner is remembered as
+     * the refcount kept in XATTRs has to stay balanced. */
+    if (!remember && path) {
+        for (i = list->nItems; i > 0; i--) {
+            virSecurityDACChownItem *tmp = list->items[i - 1];
+
+            if (STRNEQ_NULLABLE(tmp->path, path))
+                continue;
+
+            if (!tmp->remember && tmp->restore == restore &&
+                tmp->src == src && tmp->uid == uid && tmp->gid == gid)
+                return 0;
+            break;
+        }
+    }
 
     item = g_new0(virSecurityDACChownItem, 1);
 
@@ -195,6 +214,85 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManager *mgr,
                                                   const virStorageSource *src,
                                                   const char *path,
                                                   bool recall);
+static int
+virSecurityDACTransactionApplyItem(size_t idx,
+                                   void *opaque)
+{
+    virSecurityDACChownList *list = opaque;
+    virSecurityDACChownItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid,
+                                          remember);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path,
+                                                  remember);
+}
+
+
+static int
+virSecurityDACTransactionRollbackItem(size_t idx,
+                                      void *opaque)
+{
+    virSecurityDACChownList *list = opaque;
+    virSecurityDACChownItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                      item->src,
+                                                      item->path,
+                                                      remember);
+    }
+
+    VIR_WARN("Ignoring failed restore attempt on %s",
+             NULLSTR(item->src ? item->src->path : item->path));
+    return 0;
+}
+
+
+/*
+ * Items can be relabelled in parallel only if no file is touched by
+ * more of them. Files are compared by inode, as different paths may
+ * lead to the same file and the remembered owner is updated by a
+ * read-modify-write of its XATTRs. Items without a path are chowned
+ * via a callback on their storage source instead.
+ *
+ * With mount namespaces or remembering of owners, which is the
+ * default, this runs in a child made by virFork(). Starting the
+ * workers there is fine: virFork() holds the logging lock across
+ * fork(), the child takes no other lock before the workers exist and
+ * the metadata locks are fcntl() locks owned by the whole process.
+ */
+static bool
+virSecurityDACTransactionIsParallel(virSecurityDACChownList *list)
+{
+    g_autoptr(GHashTable) srcs = g_hash_table_new(NULL, NULL);
+    g_autofree const char **paths = g_new0(const char *, list->nItems);
+    size_t npaths = 0;
+    size_t i;
+
+    for (i = 0; i < list->nItems; i++) {
+        virSecurityDACChownItem *item = list->items[i];
+
+        if (item->path)
+            paths[npaths++] = item->path;
+        else if (!g_hash_table_add(srcs, (void *) item->src))
+            return false;
+    }
+
+    return virSecurityPathsAreDistinct(paths, npaths);
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -217,6 +315,7 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
     g_autofree const char **paths = NULL;
     size_t npaths = 0;
     size_t i;
+    bool parallel;
     int rv = 0;
 
     if (list->lock) {
@@ -248,42 +347,12 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    for (i = 0; i < list->nItems; i++) {
-        virSecurityDACChownItem *item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid,
-                                            remember);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path,
-                                                        remember);
-        }
-
-        if (rv < 0)
-            break;
-    }
-
-    for (; rv < 0 && i > 0; i--) {
-        virSecurityDACChownItem *item = list->items[i - 1];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                   item->src,
-                                                   item->path,
-                                                   remember);
-        } else {
-            VIR_WARN("Ignoring failed restore attempt on %s",
-                     NULLSTR(item->src ? item->src->path : item->path));
-        }
-    }
+    parallel = virSecurityDACTransactionIsParallel(list);
+    rv = virSecurityTransactionApply(list->nItems,
+                                     parallel,
+                                     virSecurityDACTransactionApplyItem,
+                                     virSecurityDACTransactionRollbackItem,
+                                     list);
 
     if (list->lock)
         virSecurityManagerMetadataUnlock(list->manager, &state);
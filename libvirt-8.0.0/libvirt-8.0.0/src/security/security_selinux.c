@@ -115,6 +115,25 @@ virSecuritySELinuxContextListAppend(virSecuritySELinuxContextList *list,
                                     bool restore)
 {
     virSecuritySELinuxContextItem *item = NULL;
+    size_t i;
+
+    /* The same path is often relabelled several times within one
+     * transaction. Doing it once is enough, unless the original label
+     * is remembered as the refcount kept in XATTRs has to stay
+     * balanced. */
+    if (!remember) {
+        for (i = list->nItems; i > 0; i--) {
+            virSecuritySELinuxContextItem *tmp = list->items[i - 1];
+
+            if (STRNEQ(tmp->path, path))
+                continue;
+
+            if (!tmp->remember && tmp->restore == restore &&
+                STREQ_NULLABLE(tmp->tcon, tcon))
+                return 0;
+            break;
+        }
+    }
 
     item = g_new0(virSecuritySELinuxContextItem, 1);
 
@@ -221,6 +240,63 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManager *mgr,
                                               bool recall);
 
 
+static int
+virSecuritySELinuxTransactionApplyItem(size_t idx,
+                                       void *opaque)
+{
+    virSecuritySELinuxContextList *list = opaque;
+    virSecuritySELinuxContextItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecuritySELinuxSetFilecon(list->manager,
+                                            item->path,
+                                            item->tcon,
+                                            remember);
+    }
+
+    return virSecuritySELinuxRestoreFileLabel(list->manager,
+                                              item->path,
+                                              remember);
+}
+
+
+static int
+virSecuritySELinuxTransactionRollbackItem(size_t idx,
+                                          void *opaque)
+{
+    virSecuritySELinuxContextList *list = opaque;
+    virSecuritySELinuxContextItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecuritySELinuxRestoreFileLabel(list->manager,
+                                                  item->path,
+                                                  remember);
+    }
+
+    VIR_WARN("Ignoring failed restore attempt on %s", item->path);
+    return 0;
+}
+
+
+/* Items can be relabelled in parallel only if no file is touched
+ * by more of them. Files are compared by inode, as different paths
+ * may lead to the same file. Like for DAC, the workers may be started
+ * in the child made by virFork() the transaction usually runs in. */
+static bool
+virSecuritySELinuxTransactionIsParallel(virSecuritySELinuxContextList *list)
+{
+    g_autofree const char **paths = g_new0(const char *, list->nItems);
+    size_t i;
+
+    for (i = 0; i < list->nItems; i++)
+        paths[i] = list->items[i]->path;
+
+    return virSecurityPathsAreDistinct(paths, list->nItems);
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -242,6 +318,7 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
     const char **paths = NULL;
     size_t npaths = 0;
     size_t i;
+    bool parallel;
     int rv;
     int ret = -1;
 
@@ -274,38 +351,12 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    rv = 0;
-    for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItem *item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecuritySELinuxSetFilecon(list->manager,
-                                              item->path,
-                                              item->tcon,
-                                              remember);
-        } else {
-            rv = virSecuritySELinuxRestoreFileLabel(list->manager,
-                                                    item->path,
-                                                    remember);
-        }
-
-        if (rv < 0)
-            break;
-    }
-
-    for (; rv < 0 && i > 0; i--) {
-        virSecuritySELinuxContextItem *item = list->items[i - 1];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            virSecuritySELinuxRestoreFileLabel(list->manager,
-                                               item->path,
-                                               remember);
-        } else {
-            VIR_WARN("Ignoring failed restore attempt on %s", item->path);
-        }
-    }
+    parallel = virSecuritySELinuxTransactionIsParallel(list);
+    rv = virSecurityTransactionApply(list->nItems,
+                                     parallel,
+                                     virSecuritySELinuxTransactionApplyItem,
+                                     virSecuritySELinuxTransactionRollbackItem,
+                                     list);
 
     if (list->lock)
         virSecurityManagerMetadataUnlock(list->manager, &state);
@@ -1253,6 +1304,21 @@ virSecuritySELinuxSetFileconImpl(const char *path,
     /* Be aware that this function might run in a separate process.
      * Therefore, any driver state changes would be thrown away. */
 
+    char *econ = NULL;
+    bool same;
+
+    /* Relabelling is expensive on network file systems and often
+     * unnecessary, e.g. when the image was labelled by a previous
+     * run or on the source host of a migration. */
+    if (getfilecon_raw(path, &econ) >= 0) {
+        same = STREQ_NULLABLE(econ, tcon);
+        freecon(econ);
+        if (same) {
+            VIR_DEBUG("SELinux context on '%s' is already '%s'", path, tcon);
+            return 0;
+        }
+    }
+
     VIR_INFO("Setting SELinux context on '%s' to '%s'", path, tcon);
 
     if (setfilecon_raw(path, (const char *)tcon) < 0) {
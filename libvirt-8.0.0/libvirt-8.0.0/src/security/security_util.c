@@ -18,6 +18,8 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
@@ -25,6 +27,7 @@
 #include "virlog.h"
 #include "viruuid.h"
 #include "virhostuptime.h"
+#include "virthread.h"
 
 #include "security_util.h"
 
@@ -545,3 +548,167 @@ virSecurityMoveRememberedLabel(const char *name,
 
     return 0;
 }
+
+
+typedef struct _virSecurityFileID virSecurityFileID;
+struct _virSecurityFileID {
+    dev_t dev;
+    ino_t ino;
+};
+
+
+static int
+virSecurityFileIDCompare(const void *a,
+                         const void *b)
+{
+    const virSecurityFileID *ida = a;
+    const virSecurityFileID *idb = b;
+
+    if (ida->dev != idb->dev)
+        return ida->dev < idb->dev ? -1 : 1;
+    if (ida->ino != idb->ino)
+        return ida->ino < idb->ino ? -1 : 1;
+    return 0;
+}
+
+
+/**
+ * virSecurityPathsAreDistinct:
+ * @paths: paths to check
+ * @npaths: number of @paths
+ *
+ * Checks that no two of @paths refer to the same file. Symlinks,
+ * hardlinks and names like /dev/disk/by-id/... all resolve to the
+ * same device and inode number.
+ *
+ * Returns true if all files are distinct, false if they are not or
+ * if any of them cannot be stat()-ed.
+ */
+bool
+virSecurityPathsAreDistinct(const char **paths,
+                            size_t npaths)
+{
+    g_autofree virSecurityFileID *ids = g_new0(virSecurityFileID, npaths);
+    size_t i;
+
+    for (i = 0; i < npaths; i++) {
+        struct stat sb;
+
+        if (stat(paths[i], &sb) < 0)
+            return false;
+
+        ids[i].dev = sb.st_dev;
+        ids[i].ino = sb.st_ino;
+    }
+
+    qsort(ids, npaths, sizeof(*ids), virSecurityFileIDCompare);
+
+    for (i = 1; i < npaths; i++) {
+        if (virSecurityFileIDCompare(&ids[i - 1], &ids[i]) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+
+/* Upper bound on the number of threads relabelling paths of a single
+ * transaction concurrently */
+#define VIR_SECURITY_TRANSACTION_WORKERS 8
+
+typedef struct _virSecurityTransactionData virSecurityTransactionData;
+struct _virSecurityTransactionData {
+    size_t nitems;
+    virSecurityTransactionItemFunc apply;
+    void *opaque;
+
+    bool *applied;
+    int next;
+    int failed;
+    virErrorPtr err; /* first error, protected by @failed */
+};
+
+
+static void
+virSecurityTransactionWorker(void *opaque)
+{
+    virSecurityTransactionData *data = opaque;
+    int idx;
+
+    while (!g_atomic_int_get(&data->failed) &&
+           (idx = g_atomic_int_add(&data->next, 1)) < (int) data->nitems) {
+        if (data->apply(idx, data->opaque) < 0) {
+            /* Errors are thread local, hand the first one over */
+            if (g_atomic_int_compare_and_exchange(&data->failed, 0, 1))
+                virErrorPreserveLast(&data->err);
+            return;
+        }
+
+        data->applied[idx] = true;
+    }
+}
+
+
+/**
+ * virSecurityTransactionApply:
+ * @nitems: number of transaction items
+ * @parallel: whether items can be applied concurrently
+ * @apply: callback applying an item
+ * @rollback: callback undoing an applied item
+ * @opaque: opaque data passed to the callbacks
+ *
+ * Applies all @nitems items of a transaction. If @parallel is true
+ * the items are spread over several threads, which is only safe if no
+ * two items refer to the same file. If applying any item fails, no
+ * further items are started and all items applied so far are rolled
+ * back in reverse order.
+ *
+ * Returns 0 on success, -1 on error (with the error of the failed item
+ * reported).
+ */
+int
+virSecurityTransactionApply(size_t nitems,
+                            bool parallel,
+                            virSecurityTransactionItemFunc apply,
+                            virSecurityTransactionItemFunc rollback,
+                            void *opaque)
+{
+    virSecurityTransactionData data = {
+        .nitems = nitems, .apply = apply, .opaque = opaque,
+    };
+    virThread threads[VIR_SECURITY_TRANSACTION_WORKERS - 1];
+    size_t nthreads = 0;
+    size_t i;
+
+    data.applied = g_new0(bool, nitems);
+
+    while (parallel &&
+           nthreads + 1 < MIN(nitems, VIR_SECURITY_TRANSACTION_WORKERS)) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                virSecurityTransactionWorker,
+                                "sec-relabel", false, &data) < 0) {
+            /* Not fatal, the remaining threads will do the work */
+            VIR_WARN("Failed to create relabel thread: %s",
+                     virGetLastErrorMessage());
+            virResetLastError();
+            break;
+        }
+        nthreads++;
+    }
+
+    virSecurityTransactionWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (data.failed) {
+        for (i = nitems; i > 0; i--) {
+            if (data.applied[i - 1])
+                ignore_value(rollback(i - 1, opaque));
+        }
+        virErrorRestore(&data.err);
+    }
+
+    g_free(data.applied);
+    return data.failed ? -1 : 0;
+}
@@ -35,3 +35,28 @@ virSecurityMoveRememberedLabel(const char *name,
 
 bool
 virSecurityXATTRNamespaceDefined(void);
+
+bool
+virSecurityPathsAreDistinct(const char **paths,
+                            size_t npaths);
+
+
+/**
+ * virSecurityTransactionItemFunc:
+ * @idx: index of the transaction item
+ * @opaque: opaque data passed to virSecurityTransactionApply()
+ *
+ * Applies or rolls back item @idx of a transaction.
+ *
+ * Returns 0 on success, -1 on error (with an error reported).
+ */
+typedef int
+(*virSecurityTransactionItemFunc)(size_t idx,
+                                  void *opaque);
+
+int
+virSecurityTransactionApply(size_t nitems,
+                            bool parallel,
+                            virSecurityTransactionItemFunc apply,
+                            virSecurityTransactionItemFunc rollback,
+                            void *opaque);
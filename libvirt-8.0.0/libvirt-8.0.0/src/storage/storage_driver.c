@@ -93,18 +93,31 @@ storagePoolRefreshFailCleanup(virStorageBackend *backend,
 }
 
 
+/*
+ * With @incremental the current volume definitions are stashed rather
+ * than dropped, so that backends can reuse the ones that are still
+ * valid instead of probing them again.
+ */
 static int
 storagePoolRefreshImpl(virStorageBackend *backend,
                        virStoragePoolObj *obj,
-                       const char *stateFile)
+                       const char *stateFile,
+                       bool incremental)
 {
-    virStoragePoolObjClearVols(obj);
+    int ret = 0;
+
+    if (incremental)
+        virStoragePoolObjStashVols(obj);
+    else
+        virStoragePoolObjClearVols(obj);
+
     if (backend->refreshPool(obj) < 0) {
         storagePoolRefreshFailCleanup(backend, obj, stateFile);
-        return -1;
+        ret = -1;
     }
 
-    return 0;
+    virStoragePoolObjClearStashedVols(obj);
+    return ret;
 }
 
 
@@ -161,7 +174,7 @@ storagePoolUpdateStateCallback(virStoragePoolObj *obj,
      * continue with other pools.
      */
     if (active &&
-        storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+        storagePoolRefreshImpl(backend, obj, stateFile, false) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Failed to restart storage pool '%s': %s"),
                        def->name, virGetLastErrorMessage());
@@ -217,7 +230,7 @@ storageDriverAutostartCallback(virStoragePoolObj *obj,
         stateFile = virFileBuildPath(driver->stateDir, def->name, ".xml");
         if (!stateFile ||
             virStoragePoolSaveState(stateFile, def) < 0 ||
-            storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+            storagePoolRefreshImpl(backend, obj, stateFile, false) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Failed to autostart storage pool '%s': %s"),
                            def->name, virGetLastErrorMessage());
@@ -775,7 +788,7 @@ storagePoolCreateXML(virConnectPtr conn,
 
     if (!stateFile ||
         virStoragePoolSaveState(stateFile, def) < 0 ||
-        storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+        storagePoolRefreshImpl(backend, obj, stateFile, false) < 0) {
         goto error;
     }
 
@@ -985,7 +998,7 @@ storagePoolCreate(virStoragePoolPtr pool,
 
     if (!stateFile ||
         virStoragePoolSaveState(stateFile, def) < 0 ||
-        storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+        storagePoolRefreshImpl(backend, obj, stateFile, false) < 0) {
         goto cleanup;
     }
 
@@ -1222,7 +1235,7 @@ storagePoolRefresh(virStoragePoolPtr pool,
     int ret = -1;
     virObjectEvent *event = NULL;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_POOL_REFRESH_INCREMENTAL, -1);
 
     if (!(obj = storagePoolObjFindByUUID(pool->uuid, pool->name)))
         goto cleanup;
@@ -1255,7 +1268,8 @@ storagePoolRefresh(virStoragePoolPtr pool,
     }
 
     stateFile = virFileBuildPath(driver->stateDir, def->name, ".xml");
-    if (storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+    if (storagePoolRefreshImpl(backend, obj, stateFile,
+                               !!(flags & VIR_STORAGE_POOL_REFRESH_INCREMENTAL)) < 0) {
         event = virStoragePoolEventLifecycleNew(def->name,
                                                 def->uuid,
                                                 VIR_STORAGE_POOL_EVENT_STOPPED,
@@ -2337,7 +2351,8 @@ virStorageVolPoolRefreshThread(void *opaque)
     if (!(backend = virStorageBackendForType(def->type)))
         goto cleanup;
 
-    if (storagePoolRefreshImpl(backend, obj, NULL) < 0)
+    /* Only the uploaded volume changed, the rest can be kept */
+    if (storagePoolRefreshImpl(backend, obj, NULL, true) < 0)
         VIR_DEBUG("Failed to refresh storage pool");
 
     event = virStoragePoolEventRefreshNew(def->name, def->uuid);
@@ -2608,11 +2623,16 @@ storageVolWipePattern(virStorageVolPtr vol,
 
     virStoragePoolObjIncrAsyncjobs(obj);
     voldef->in_use++;
+    voldef->wiping = true;
+    voldef->wipeCancel = false;
+    voldef->wipeTotal = 0;
+    voldef->wipeProcessed = 0;
     virObjectUnlock(obj);
 
     rc = backend->wipeVol(obj, voldef, algorithm, flags);
 
     virObjectLock(obj);
+    voldef->wiping = false;
     voldef->in_use--;
     virStoragePoolObjDecrAsyncjobs(obj);
 
@@ -2657,16 +2677,44 @@ storageVolGetInfoFlags(virStorageVolPtr vol,
     virStorageVolDef *voldef;
     int ret = -1;
 
-    virCheckFlags(VIR_STORAGE_VOL_GET_PHYSICAL, -1);
+    virCheckFlags(VIR_STORAGE_VOL_GET_PHYSICAL |
+                  VIR_STORAGE_VOL_GET_WIPE_PROGRESS |
+                  VIR_STORAGE_VOL_GET_WIPE_CANCEL, -1);
+
+    VIR_EXCLUSIVE_FLAGS_RET(VIR_STORAGE_VOL_GET_PHYSICAL,
+                            VIR_STORAGE_VOL_GET_WIPE_PROGRESS, -1);
+    VIR_EXCLUSIVE_FLAGS_RET(VIR_STORAGE_VOL_GET_PHYSICAL,
+                            VIR_STORAGE_VOL_GET_WIPE_CANCEL, -1);
 
     if (!(voldef = virStorageVolDefFromVol(vol, &obj, &backend)))
         return -1;
 
     if (virStorageVolGetInfoFlagsEnsureACL(vol->conn,
                                            virStoragePoolObjGetDef(obj),
-                                           voldef) < 0)
+                                           voldef, flags) < 0)
         goto cleanup;
 
+    if (flags & (VIR_STORAGE_VOL_GET_WIPE_PROGRESS |
+                 VIR_STORAGE_VOL_GET_WIPE_CANCEL)) {
+        if (!voldef->wiping) {
+            virReportError(VIR_ERR_OPERATION_INVALID,
+                           _("volume '%s' is not being wiped"),
+                           voldef->name);
+            goto cleanup;
+        }
+
+        /* The wipe engine checks this flag between chunks and aborts */
+        if (flags & VIR_STORAGE_VOL_GET_WIPE_CANCEL)
+            voldef->wipeCancel = true;
+
+        memset(info, 0, sizeof(*info));
+        info->type = voldef->type;
+        info->capacity = voldef->wipeTotal;
+        info->allocation = voldef->wipeProcessed;
+        ret = 0;
+        goto cleanup;
+    }
+
     if (backend->refreshVol &&
         backend->refreshVol(obj, voldef) < 0)
         goto cleanup;
@@ -66,6 +66,8 @@
 #include "virfdstream.h"
 #include "virutil.h"
 #include "virsecureerase.h"
+#include "virthread.h"
+#include "virrandom.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -116,6 +118,286 @@ reflinkCloneFile(int dest_fd G_GNUC_UNUSED,
 #endif
 
 
+/* Number of threads copying chunks of READ_BLOCK_SIZE_DEFAULT
+ * concurrently when cloning a volume by reading and writing */
+#define VIR_STORAGE_COPY_WORKERS 4
+
+typedef struct _virStorageBackendCopyExtent virStorageBackendCopyExtent;
+struct _virStorageBackendCopyExtent {
+    unsigned long long offset;
+    unsigned long long length;
+};
+
+typedef struct _virStorageBackendCopyData virStorageBackendCopyData;
+struct _virStorageBackendCopyData {
+    virMutex lock;
+
+    const char *inputpath;
+    const char *outputpath;
+    int inputfd;
+    int outputfd;
+    size_t wbytes;
+    bool want_sparse;
+
+    /* data extents of the input, claimed chunk by chunk under @lock */
+    virStorageBackendCopyExtent *extents;
+    size_t nextents;
+    size_t curExtent;
+    unsigned long long curOffset;
+
+    bool failed;
+    virErrorPtr err;
+};
+
+
+/*
+ * Check whether @buf is all zeroes. Comparing a short prefix first
+ * keeps the common non-zero case cheap; comparing the buffer with
+ * itself shifted by that prefix then lets the vectorized memcmp() of
+ * the C library do the rest without a separate zero buffer.
+ */
+static bool
+virStorageBackendBufferIsZero(const char *buf,
+                              size_t len)
+{
+    static const char zero[16];
+
+    if (len <= sizeof(zero))
+        return memcmp(buf, zero, len) == 0;
+
+    return memcmp(buf, zero, sizeof(zero)) == 0 &&
+        memcmp(buf, buf + sizeof(zero), len - sizeof(zero)) == 0;
+}
+
+
+/*
+ * Collect the ranges of the first @len bytes of @fd which need to be
+ * copied. Holes are only skipped if the destination is allowed to be
+ * sparse, and only if the file system reports them.
+ */
+static void
+virStorageBackendCopyGetExtents(int fd,
+                                unsigned long long len,
+                                bool want_sparse,
+                                virStorageBackendCopyExtent **extents,
+                                size_t *nextents)
+{
+    unsigned long long pos = 0;
+    virStorageBackendCopyExtent ext = { 0, len };
+
+    if (!want_sparse)
+        goto whole;
+
+    while (pos < len) {
+        int inData;
+        long long length;
+
+        if (lseek(fd, pos, SEEK_SET) == (off_t) -1 ||
+            virFileInData(fd, &inData, &length) < 0) {
+            VIR_DEBUG("Cannot query holes, copying the whole input");
+            virResetLastError();
+            g_clear_pointer(extents, g_free);
+            *nextents = 0;
+            goto whole;
+        }
+
+        /* Implicit hole at EOF */
+        if (length == 0)
+            break;
+
+        if ((unsigned long long) length > len - pos)
+            length = len - pos;
+
+        if (inData) {
+            ext.offset = pos;
+            ext.length = length;
+            VIR_APPEND_ELEMENT(*extents, *nextents, ext);
+        }
+
+        pos += length;
+    }
+
+    ignore_value(lseek(fd, 0, SEEK_SET));
+    return;
+
+ whole:
+    ext.offset = 0;
+    ext.length = len;
+    VIR_APPEND_ELEMENT(*extents, *nextents, ext);
+}
+
+
+static bool
+virStorageBackendCopyClaimChunk(virStorageBackendCopyData *data,
+                                unsigned long long *offset,
+                                size_t *length)
+{
+    virStorageBackendCopyExtent *ext;
+    bool ret = false;
+
+    virMutexLock(&data->lock);
+    while (!data->failed && data->curExtent < data->nextents) {
+        ext = &data->extents[data->curExtent];
+
+        if (data->curOffset < ext->offset)
+            data->curOffset = ext->offset;
+
+        if (data->curOffset >= ext->offset + ext->length) {
+            data->curExtent++;
+            continue;
+        }
+
+        *offset = data->curOffset;
+        *length = MIN(READ_BLOCK_SIZE_DEFAULT,
+                      ext->offset + ext->length - data->curOffset);
+        data->curOffset += *length;
+        ret = true;
+        break;
+    }
+    virMutexUnlock(&data->lock);
+
+    return ret;
+}
+
+
+static void
+virStorageBackendCopyFailed(virStorageBackendCopyData *data)
+{
+    virMutexLock(&data->lock);
+    if (!data->failed) {
+        data->failed = true;
+        virErrorPreserveLast(&data->err);
+    }
+    virMutexUnlock(&data->lock);
+}
+
+
+/*
+ * Copy one chunk, writing consecutive non-zero blocks in one go and
+ * leaving consecutive zero blocks untouched in the (already sized and
+ * therefore zero filled) destination when it may be sparse.
+ */
+static int
+virStorageBackendCopyChunk(virStorageBackendCopyData *data,
+                           char *buf,
+                           unsigned long long offset,
+                           size_t length)
+{
+    ssize_t amtread;
+    size_t pos = 0;
+
+    if ((amtread = safepread(data->inputfd, buf, length, offset)) < 0) {
+        virReportSystemError(errno,
+                             _("failed reading from file '%s'"),
+                             data->inputpath);
+        return -1;
+    }
+
+    while (pos < (size_t) amtread) {
+        size_t start = pos;
+        size_t interval = MIN(data->wbytes, amtread - pos);
+        bool zero = data->want_sparse &&
+            virStorageBackendBufferIsZero(buf + pos, interval);
+
+        /* extend the run while blocks are of the same kind */
+        do {
+            pos += interval;
+            interval = MIN(data->wbytes, amtread - pos);
+        } while (pos < (size_t) amtread &&
+                 (data->want_sparse &&
+                  virStorageBackendBufferIsZero(buf + pos, interval)) == zero);
+
+        if (zero)
+            continue;
+
+        if (safepwrite(data->outputfd, buf + start, pos - start,
+                       offset + start) < 0) {
+            virReportSystemError(errno,
+                                 _("failed writing to file '%s'"),
+                                 data->outputpath);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+virStorageBackendCopyWorker(void *opaque)
+{
+    virStorageBackendCopyData *data = opaque;
+    g_autofree char *buf = g_new0(char, READ_BLOCK_SIZE_DEFAULT);
+    unsigned long long offset;
+    size_t length;
+
+    while (virStorageBackendCopyClaimChunk(data, &offset, &length)) {
+        if (virStorageBackendCopyChunk(data, buf, offset, length) < 0) {
+            virStorageBackendCopyFailed(data);
+            return;
+        }
+    }
+}
+
+
+#if WITH_COPY_FILE_RANGE
+/*
+ * Let the kernel copy the data, which allows file systems to share
+ * extents or to copy on the server side where they support it.
+ *
+ * Returns 0 on success, -1 on error, -2 if unsupported for @inputfd
+ * and @outputfd and nothing was copied.
+ */
+static int
+virStorageBackendCopyFileRange(virStorageBackendCopyData *data)
+{
+    bool copied = false;
+    size_t i;
+
+    for (i = 0; i < data->nextents; i++) {
+        off_t inoff = data->extents[i].offset;
+        off_t outoff = data->extents[i].offset;
+        unsigned long long remain = data->extents[i].length;
+
+        while (remain > 0) {
+            ssize_t r = copy_file_range(data->inputfd, &inoff,
+                                        data->outputfd, &outoff,
+                                        MIN(remain, SSIZE_MAX), 0);
+
+            if (r < 0 && errno == EINTR)
+                continue;
+
+            if (r < 0 && !copied &&
+                (errno == ENOSYS || errno == EXDEV ||
+                 errno == EINVAL || errno == EOPNOTSUPP))
+                return -2;
+
+            if (r < 0) {
+                virReportSystemError(errno,
+                                     _("failed to copy '%s' to '%s'"),
+                                     data->inputpath, data->outputpath);
+                return -1;
+            }
+
+            if (r == 0)
+                break;
+
+            copied = true;
+            remain -= r;
+        }
+    }
+
+    return 0;
+}
+#else /* !WITH_COPY_FILE_RANGE */
+static int
+virStorageBackendCopyFileRange(virStorageBackendCopyData *data G_GNUC_UNUSED)
+{
+    return -2;
+}
+#endif /* !WITH_COPY_FILE_RANGE */
+
+
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDef *vol,
                           virStorageVolDef *inputvol,
@@ -124,13 +406,16 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
                           bool want_sparse,
                           bool reflink_copy)
 {
-    int amtread = -1;
-    size_t rbytes = READ_BLOCK_SIZE_DEFAULT;
     int wbytes = 0;
-    int interval;
+    unsigned long long len = *total;
     struct stat st;
-    g_autofree char *zerobuf = NULL;
-    g_autofree char *buf = NULL;
+    struct stat inputst;
+    virStorageBackendCopyData data = { 0 };
+    virThread threads[VIR_STORAGE_COPY_WORKERS - 1];
+    size_t nthreads = 0;
+    size_t i;
+    int rc;
+    int ret = -1;
     VIR_AUTOCLOSE inputfd = -1;
 
     if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
@@ -149,10 +434,6 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
     if (wbytes < WRITE_BLOCK_SIZE_DEFAULT)
         wbytes = WRITE_BLOCK_SIZE_DEFAULT;
 
-    zerobuf = g_new0(char, wbytes);
-
-    buf = g_new0(char, rbytes);
-
     if (reflink_copy) {
         if (reflinkCloneFile(fd, inputfd) < 0) {
             virReportSystemError(errno,
@@ -165,58 +446,103 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
         }
     }
 
-    while (amtread != 0) {
-        int amtleft;
+    if (fstat(inputfd, &inputst) < 0) {
+        virReportSystemError(errno,
+                             _("cannot stat input file '%s'"),
+                             inputvol->target.path);
+        return -1;
+    }
 
-        if (*total < rbytes)
-            rbytes = *total;
+    /* Never copy past the end of the input */
+    if (S_ISREG(inputst.st_mode)) {
+        len = MIN(len, inputst.st_size);
+    } else {
+        off_t end = lseek(inputfd, 0, SEEK_END);
 
-        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
-            virReportSystemError(errno,
-                                 _("failed reading from file '%s'"),
-                                 inputvol->target.path);
-            return -1;
+        if (end != (off_t) -1)
+            len = MIN(len, end);
+    }
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        return -1;
+    }
+
+    data.inputpath = inputvol->target.path;
+    data.outputpath = vol->target.path;
+    data.inputfd = inputfd;
+    data.outputfd = fd;
+    data.wbytes = wbytes;
+    data.want_sparse = want_sparse;
+
+    virStorageBackendCopyGetExtents(inputfd, len,
+                                    want_sparse && S_ISREG(inputst.st_mode),
+                                    &data.extents, &data.nextents);
+
+    /* copy_file_range() doesn't skip zero blocks within the data, so
+     * only use it if the destination was already allocated upfront and
+     * there is nothing to keep sparse. Holes of the input are still
+     * skipped through the extent list as the allocated destination
+     * reads back as zeroes there. */
+    if (S_ISREG(inputst.st_mode) &&
+        fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        (unsigned long long) st.st_blocks * 512 >= len) {
+        if ((rc = virStorageBackendCopyFileRange(&data)) == -1)
+            goto cleanup;
+        if (rc == 0) {
+            VIR_DEBUG("Copied %llu bytes with copy_file_range", len);
+            goto done;
         }
-        *total -= amtread;
+    }
 
-        /* Loop over amt read in 512 byte increments, looking for sparse
-         * blocks */
-        amtleft = amtread;
-        do {
-            int offset = amtread - amtleft;
-            interval = ((wbytes > amtleft) ? amtleft : wbytes);
+    while (nthreads < G_N_ELEMENTS(threads) &&
+           (nthreads + 1) * READ_BLOCK_SIZE_DEFAULT < len) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                virStorageBackendCopyWorker,
+                                "storage-copy", false, &data) < 0) {
+            virResetLastError();
+            break;
+        }
+        nthreads++;
+    }
 
-            if (want_sparse && memcmp(buf+offset, zerobuf, interval) == 0) {
-                if (lseek(fd, interval, SEEK_CUR) < 0) {
-                    virReportSystemError(errno,
-                                         _("cannot extend file '%s'"),
-                                         vol->target.path);
-                    return -1;
-                }
-            } else if (safewrite(fd, buf+offset, interval) < 0) {
-                virReportSystemError(errno,
-                                     _("failed writing to file '%s'"),
-                                     vol->target.path);
-                return -1;
+    VIR_DEBUG("Copying %llu bytes in %zu extents with %zu threads",
+              len, data.nextents, nthreads + 1);
 
-            }
-        } while ((amtleft -= interval) > 0);
+    virStorageBackendCopyWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (data.failed) {
+        virErrorRestore(&data.err);
+        goto cleanup;
     }
 
+ done:
+    *total -= len;
+
     if (virFileDataSync(fd) < 0) {
         virReportSystemError(errno, _("cannot sync data to file '%s'"),
                              vol->target.path);
-        return -1;
+        goto cleanup;
     }
 
     if (VIR_CLOSE(inputfd) < 0) {
         virReportSystemError(errno,
                              _("cannot close file '%s'"),
                              inputvol->target.path);
-        return -1;
+        goto cleanup;
     }
 
-    return 0;
+    ret = 0;
+
+ cleanup:
+    virMutexDestroy(&data.lock);
+    virFreeError(data.err);
+    g_free(data.extents);
+    return ret;
 }
 
 static int
@@ -1907,6 +2233,9 @@ virStorageBackendUpdateVolTargetInfoFD(virStorageSource *target,
     target->perms->uid = sb->st_uid;
     target->perms->gid = sb->st_gid;
 
+    target->dev = sb->st_dev;
+    target->ino = sb->st_ino;
+
     if (!target->timestamps)
         target->timestamps = g_new0(virStorageTimestamps, 1);
 
@@ -2572,18 +2901,498 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/* Offloaded requests are split into chunks so that progress can be
+ * reported and cancellation honoured in between. Written chunks are
+ * what each writer thread submits; their size is a multiple of both
+ * the O_DIRECT alignment and the length of every pattern, so each
+ * chunk starts at the beginning of the pattern. */
+#define WIPE_OFFLOAD_CHUNK_SIZE (1024ULL * 1024 * 1024)
+#define WIPE_WRITE_ALIGN 4096
+#define WIPE_WRITE_CHUNK_SIZE (255 * WIPE_WRITE_ALIGN)
+#define WIPE_WRITE_WORKERS 4
+/* How much has to be wiped between two progress updates */
+#define WIPE_PROGRESS_INTERVAL (64ULL * 1024 * 1024)
+
+typedef struct _virStorageBackendWipePass virStorageBackendWipePass;
+struct _virStorageBackendWipePass {
+    unsigned int count;         /* how many times the pass is done */
+    size_t len;                 /* pattern length, 0 for random data */
+    unsigned char pattern[3];
+};
+
+#define WIPE_RANDOM(n) { n, 0, { 0 } }
+#define WIPE_BYTE(b) { 1, 1, { b } }
+#define WIPE_BYTES(a, b, c) { 1, 3, { a, b, c } }
+
+/* The sequences are the ones of scrub(1), which used to do the
+ * wiping for all algorithms but 'zero' */
+static const virStorageBackendWipePass wipePassesZero[] = {
+    WIPE_BYTE(0x00),
+};
+
+static const virStorageBackendWipePass wipePassesNNSA[] = {
+    WIPE_RANDOM(2), WIPE_BYTE(0x00),
+};
+
+static const virStorageBackendWipePass wipePassesDOD[] = {
+    WIPE_RANDOM(1), WIPE_BYTE(0x00), WIPE_BYTE(0xff),
+};
+
+static const virStorageBackendWipePass wipePassesBSI[] = {
+    WIPE_BYTE(0xff), WIPE_BYTE(0xfe), WIPE_BYTE(0xfd), WIPE_BYTE(0xfb),
+    WIPE_BYTE(0xf7), WIPE_BYTE(0xef), WIPE_BYTE(0xdf), WIPE_BYTE(0xbf),
+    WIPE_BYTE(0x7f),
+};
+
+static const virStorageBackendWipePass wipePassesGutmann[] = {
+    WIPE_RANDOM(4),
+    WIPE_BYTE(0x55), WIPE_BYTE(0xaa),
+    WIPE_BYTES(0x92, 0x49, 0x24), WIPE_BYTES(0x49, 0x24, 0x92),
+    WIPE_BYTES(0x24, 0x92, 0x49),
+    WIPE_BYTE(0x00), WIPE_BYTE(0x11), WIPE_BYTE(0x22), WIPE_BYTE(0x33),
+    WIPE_BYTE(0x44), WIPE_BYTE(0x55), WIPE_BYTE(0x66), WIPE_BYTE(0x77),
+    WIPE_BYTE(0x88), WIPE_BYTE(0x99), WIPE_BYTE(0xaa), WIPE_BYTE(0xbb),
+    WIPE_BYTE(0xcc), WIPE_BYTE(0xdd), WIPE_BYTE(0xee), WIPE_BYTE(0xff),
+    WIPE_BYTES(0x92, 0x49, 0x24), WIPE_BYTES(0x49, 0x24, 0x92),
+    WIPE_BYTES(0x24, 0x92, 0x49), WIPE_BYTES(0x6d, 0xb6, 0xdb),
+    WIPE_BYTES(0xb6, 0xdb, 0x6d), WIPE_BYTES(0xdb, 0x6d, 0xb6),
+    WIPE_RANDOM(4),
+};
+
+static const virStorageBackendWipePass wipePassesSchneier[] = {
+    WIPE_BYTE(0x00), WIPE_BYTE(0xff), WIPE_RANDOM(5),
+};
+
+static const virStorageBackendWipePass wipePassesPfitzner7[] = {
+    WIPE_RANDOM(7),
+};
+
+static const virStorageBackendWipePass wipePassesPfitzner33[] = {
+    WIPE_RANDOM(33),
+};
+
+static const virStorageBackendWipePass wipePassesRandom[] = {
+    WIPE_RANDOM(1),
+};
+
+typedef struct _virStorageBackendWipeMethod virStorageBackendWipeMethod;
+struct _virStorageBackendWipeMethod {
+    const char *name;
+    const virStorageBackendWipePass *passes;
+    size_t npasses;
+    bool verify;                /* read back the last pass */
+};
+
+#define WIPE_METHOD(name, passes, verify) \
+    { name, passes, G_N_ELEMENTS(passes), verify }
+
+static const virStorageBackendWipeMethod wipeMethods[] = {
+    [VIR_STORAGE_VOL_WIPE_ALG_ZERO] =
+        WIPE_METHOD("zero", wipePassesZero, false),
+    [VIR_STORAGE_VOL_WIPE_ALG_NNSA] =
+        WIPE_METHOD("nnsa", wipePassesNNSA, true),
+    [VIR_STORAGE_VOL_WIPE_ALG_DOD] =
+        WIPE_METHOD("dod", wipePassesDOD, true),
+    [VIR_STORAGE_VOL_WIPE_ALG_BSI] =
+        WIPE_METHOD("bsi", wipePassesBSI, false),
+    [VIR_STORAGE_VOL_WIPE_ALG_GUTMANN] =
+        WIPE_METHOD("gutmann", wipePassesGutmann, false),
+    [VIR_STORAGE_VOL_WIPE_ALG_SCHNEIER] =
+        WIPE_METHOD("schneier", wipePassesSchneier, false),
+    [VIR_STORAGE_VOL_WIPE_ALG_PFITZNER7] =
+        WIPE_METHOD("pfitzner7", wipePassesPfitzner7, false),
+    [VIR_STORAGE_VOL_WIPE_ALG_PFITZNER33] =
+        WIPE_METHOD("pfitzner33", wipePassesPfitzner33, false),
+    [VIR_STORAGE_VOL_WIPE_ALG_RANDOM] =
+        WIPE_METHOD("random", wipePassesRandom, false),
+};
+
+
+/* Number of times the volume is written or read in full by @method */
+static unsigned int
+storageBackendWipeMethodPasses(const virStorageBackendWipeMethod *method)
+{
+    unsigned int ret = method->verify ? 1 : 0;
+    size_t i;
+
+    for (i = 0; i < method->npasses; i++)
+        ret += method->passes[i].count;
+
+    return ret;
+}
+
+
+typedef struct _virStorageBackendWipeJob virStorageBackendWipeJob;
+struct _virStorageBackendWipeJob {
+    /* NULL if progress isn't tracked, e.g. for partition tables */
+    virStoragePoolObj *pool;
+    virStorageVolDef *vol;
+
+    virMutex lock;
+    unsigned long long processed;
+    unsigned long long reported;
+    bool failed;
+    virErrorPtr err;
+};
+
+
+static void
+storageBackendWipeJobInit(virStorageBackendWipeJob *job,
+                          virStoragePoolObj *pool,
+                          virStorageVolDef *vol,
+                          unsigned long long total)
+{
+    job->pool = pool;
+    job->vol = vol;
+    job->processed = 0;
+    job->reported = 0;
+
+    if (!job->pool)
+        return;
+
+    virObjectLock(job->pool);
+    job->vol->wipeTotal = total;
+    job->vol->wipeProcessed = 0;
+    virObjectUnlock(job->pool);
+}
+
+
+/*
+ * Account @len more bytes as wiped, publish the progress to the
+ * volume definition and check whether the wipe was cancelled.
+ *
+ * Returns 0 to continue, -1 with an error reported if cancelled.
+ */
+static int
+storageBackendWipeJobUpdate(virStorageBackendWipeJob *job,
+                            unsigned long long len)
+{
+    bool publish = false;
+    bool cancel = false;
+    unsigned long long processed;
+
+    virMutexLock(&job->lock);
+    job->processed += len;
+    processed = job->processed;
+    if (job->pool && processed - job->reported >= WIPE_PROGRESS_INTERVAL) {
+        job->reported = processed;
+        publish = true;
+    }
+    virMutexUnlock(&job->lock);
+
+    if (!publish)
+        return 0;
+
+    virObjectLock(job->pool);
+    if (processed > job->vol->wipeProcessed)
+        job->vol->wipeProcessed = processed;
+    cancel = job->vol->wipeCancel;
+    virObjectUnlock(job->pool);
+
+    if (cancel) {
+        virReportError(VIR_ERR_OPERATION_ABORTED,
+                       _("wiping of volume '%s' was cancelled"),
+                       job->vol->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Let the kernel or the device zero the range in place: BLKZEROOUT
+ * for block devices and FALLOC_FL_ZERO_RANGE for files. Neither
+ * changes how much of the volume is allocated.
+ *
+ * Returns 0 on success, -1 on error, -2 if not supported for @fd and
+ * nothing was touched.
+ */
+#ifdef __linux__
 static int
-storageBackendWipeLocal(const char *path,
+storageBackendWipeOffload(virStorageBackendWipeJob *job,
+                          const char *path,
+                          int fd,
+                          struct stat *st,
+                          unsigned long long offset,
+                          unsigned long long len)
+{
+    unsigned long long pos = 0;
+
+    if (S_ISBLK(st->st_mode)) {
+        while (pos < len) {
+            uint64_t range[2] = { offset + pos,
+                                  MIN(len - pos, WIPE_OFFLOAD_CHUNK_SIZE) };
+
+            if (ioctl(fd, BLKZEROOUT, range) < 0) {
+                if (pos == 0) {
+                    VIR_DEBUG("BLKZEROOUT not usable on '%s': %s",
+                              path, g_strerror(errno));
+                    return -2;
+                }
+
+                virReportSystemError(errno,
+                                     _("BLKZEROOUT failed on volume with path '%s'"),
+                                     path);
+                return -1;
+            }
+
+            pos += range[1];
+            if (storageBackendWipeJobUpdate(job, range[1]) < 0)
+                return -1;
+        }
+
+        VIR_DEBUG("Zeroed '%s' with BLKZEROOUT", path);
+        return 0;
+    }
+
+# if WITH_FALLOCATE - 0 && defined(FALLOC_FL_ZERO_RANGE)
+    if (S_ISREG(st->st_mode)) {
+        while (pos < len) {
+            unsigned long long chunk = MIN(len - pos, WIPE_OFFLOAD_CHUNK_SIZE);
+
+            if (fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                          offset + pos, chunk) < 0) {
+                if (pos == 0 &&
+                    (errno == ENOSYS || errno == EOPNOTSUPP))
+                    return -2;
+
+                virReportSystemError(errno,
+                                     _("Failed to zero range of volume with path '%s'"),
+                                     path);
+                return -1;
+            }
+
+            pos += chunk;
+            if (storageBackendWipeJobUpdate(job, chunk) < 0)
+                return -1;
+        }
+
+        VIR_DEBUG("Zeroed '%s' with FALLOC_FL_ZERO_RANGE", path);
+        return 0;
+    }
+# endif /* WITH_FALLOCATE && FALLOC_FL_ZERO_RANGE */
+
+    return -2;
+}
+#else /* !__linux__ */
+static int
+storageBackendWipeOffload(virStorageBackendWipeJob *job G_GNUC_UNUSED,
+                          const char *path G_GNUC_UNUSED,
+                          int fd G_GNUC_UNUSED,
+                          struct stat *st G_GNUC_UNUSED,
+                          unsigned long long offset G_GNUC_UNUSED,
+                          unsigned long long len G_GNUC_UNUSED)
+{
+    return -2;
+}
+#endif /* !__linux__ */
+
+
+typedef struct _virStorageBackendWipeWriteData virStorageBackendWipeWriteData;
+struct _virStorageBackendWipeWriteData {
+    virStorageBackendWipeJob *job;
+    const char *path;
+    int fd;
+    /* WIPE_WRITE_CHUNK_SIZE bytes of the pattern, NULL for random data */
+    const char *pattern;
+    bool verify;                /* compare with @pattern instead of writing */
+    unsigned long long end;
+    unsigned long long next;    /* claimed under job->lock */
+};
+
+
+static int
+storageBackendWipeVerifyChunk(virStorageBackendWipeWriteData *data,
+                              char *buf,
+                              unsigned long long offset,
+                              size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t got = pread(data->fd, buf + done, len - done, offset + done);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0) {
+            virReportSystemError(got < 0 ? errno : EIO,
+                                 _("Failed to read back %zu bytes from "
+                                   "storage volume with path '%s'"),
+                                 len, data->path);
+            return -1;
+        }
+
+        done += got;
+    }
+
+    if (memcmp(buf, data->pattern, len) != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("verifying wiped storage volume with path '%s' "
+                         "failed at offset %llu"),
+                       data->path, offset);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+storageBackendWipeWriteWorker(void *opaque)
+{
+    virStorageBackendWipeWriteData *data = opaque;
+    virStorageBackendWipeJob *job = data->job;
+    g_autofree char *bufalloc = NULL;
+    char *buf = NULL;
+
+    /* Random data and data read back need a buffer per thread */
+    if (!data->pattern || data->verify) {
+        bufalloc = g_new0(char, WIPE_WRITE_CHUNK_SIZE + WIPE_WRITE_ALIGN);
+        buf = (char *) VIR_ROUND_UP((uintptr_t) bufalloc, WIPE_WRITE_ALIGN);
+    }
+
+    while (true) {
+        unsigned long long offset;
+        size_t len;
+
+        virMutexLock(&job->lock);
+        if (job->failed || data->next >= data->end) {
+            virMutexUnlock(&job->lock);
+            return;
+        }
+        offset = data->next;
+        len = MIN(WIPE_WRITE_CHUNK_SIZE, data->end - offset);
+        data->next += len;
+        virMutexUnlock(&job->lock);
+
+        if (data->verify) {
+            if (storageBackendWipeVerifyChunk(data, buf, offset, len) < 0)
+                goto error;
+        } else {
+            if (!data->pattern &&
+                virRandomBytes((unsigned char *) buf, len) < 0)
+                goto error;
+
+            if (safepwrite(data->fd, data->pattern ? data->pattern : buf,
+                           len, offset) < 0) {
+                virReportSystemError(errno,
+                                     _("Failed to write %zu bytes to "
+                                       "storage volume with path '%s'"),
+                                     len, data->path);
+                goto error;
+            }
+        }
+
+        if (storageBackendWipeJobUpdate(job, len) < 0)
+            goto error;
+    }
+
+ error:
+    virMutexLock(&job->lock);
+    if (!job->failed) {
+        job->failed = true;
+        virErrorPreserveLast(&job->err);
+    }
+    virMutexUnlock(&job->lock);
+}
+
+
+/*
+ * Write @pass over the range, or read the range back and compare it
+ * with @pass if @verify is true, with several requests in flight.
+ * The I/O bypasses the page cache through O_DIRECT if the range is
+ * suitably aligned and the file system allows it.
+ */
+static int
+storageBackendWipeWrite(virStorageBackendWipeJob *job,
+                        const char *path,
+                        int fd,
+                        unsigned long long offset,
+                        unsigned long long len,
+                        const virStorageBackendWipePass *pass,
+                        bool verify)
+{
+    virStorageBackendWipeWriteData data = {
+        .job = job, .path = path, .fd = fd, .verify = verify,
+        .end = offset + len, .next = offset,
+    };
+    virThread threads[WIPE_WRITE_WORKERS - 1];
+    size_t nthreads = 0;
+    size_t i;
+    g_autofree char *patternalloc = NULL;
+    VIR_AUTOCLOSE directfd = -1;
+
+    if (offset % WIPE_WRITE_ALIGN == 0 && len % WIPE_WRITE_ALIGN == 0) {
+        if ((directfd = open(path, O_RDWR | O_DIRECT)) >= 0)
+            data.fd = directfd;
+        else
+            VIR_DEBUG("Cannot open '%s' with O_DIRECT: %s",
+                      path, g_strerror(errno));
+    }
+
+    if (pass->len) {
+        char *pattern;
+
+        patternalloc = g_new0(char, WIPE_WRITE_CHUNK_SIZE + WIPE_WRITE_ALIGN);
+        pattern = (char *) VIR_ROUND_UP((uintptr_t) patternalloc,
+                                        WIPE_WRITE_ALIGN);
+        for (i = 0; i < WIPE_WRITE_CHUNK_SIZE; i++)
+            pattern[i] = pass->pattern[i % pass->len];
+        data.pattern = pattern;
+    }
+
+    while (nthreads < G_N_ELEMENTS(threads) &&
+           (nthreads + 1) * WIPE_WRITE_CHUNK_SIZE < len) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                storageBackendWipeWriteWorker,
+                                "storage-wipe", false, &data) < 0) {
+            virResetLastError();
+            break;
+        }
+        nthreads++;
+    }
+
+    VIR_DEBUG("%s %llu bytes at %llu of '%s' with %zu threads%s",
+              verify ? "Verifying" : "Writing", len, offset, path,
+              nthreads + 1, data.fd == directfd ? " (O_DIRECT)" : "");
+
+    storageBackendWipeWriteWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (job->failed) {
+        virErrorRestore(&job->err);
+        return -1;
+    }
+
+    /* Each pass has to reach the disk before the next one starts */
+    if (!verify && virFileDataSync(data.fd) < 0) {
+        virReportSystemError(errno,
+                             _("cannot sync data to volume with path '%s'"),
+                             path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+storageBackendWipeLocal(virStorageBackendWipeJob *job,
+                        const char *path,
                         int fd,
+                        struct stat *st,
+                        const virStorageBackendWipeMethod *method,
                         unsigned long long wipe_len,
-                        size_t writebuf_length,
                         bool zero_end)
 {
-    unsigned long long remaining = 0;
     off_t size;
-    g_autofree char *writebuf = NULL;
-
-    writebuf = g_new0(char, writebuf_length);
+    size_t i;
+    unsigned int j;
+    int rc = -2;
 
     if (!zero_end) {
         if ((size = lseek(fd, 0, SEEK_SET)) < 0) {
@@ -2605,21 +3414,25 @@ storageBackendWipeLocal(const char *path,
 
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t)size, wipe_len);
 
-    remaining = wipe_len;
-    while (remaining > 0) {
-        size_t write_size = MIN(writebuf_length, remaining);
-        int written = safewrite(fd, writebuf, write_size);
-
-        if (written < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to write %zu bytes to "
-                                   "storage volume with path '%s'"),
-                                 write_size, path);
+    if (method == &wipeMethods[VIR_STORAGE_VOL_WIPE_ALG_ZERO] &&
+        (rc = storageBackendWipeOffload(job, path, fd, st,
+                                        size, wipe_len)) == -1)
+        return -1;
 
-            return -1;
+    if (rc == -2) {
+        for (i = 0; i < method->npasses; i++) {
+            for (j = 0; j < method->passes[i].count; j++) {
+                if (storageBackendWipeWrite(job, path, fd, size, wipe_len,
+                                            &method->passes[i], false) < 0)
+                    return -1;
+            }
         }
 
-        remaining -= written;
+        if (method->verify &&
+            storageBackendWipeWrite(job, path, fd, size, wipe_len,
+                                    &method->passes[method->npasses - 1],
+                                    true) < 0)
+            return -1;
     }
 
     if (virFileDataSync(fd) < 0) {
@@ -2629,22 +3442,30 @@ storageBackendWipeLocal(const char *path,
         return -1;
     }
 
-    VIR_DEBUG("Wrote %llu bytes to volume with path '%s'", wipe_len, path);
+    VIR_DEBUG("Wiped %llu bytes of volume with path '%s'", wipe_len, path);
 
     return 0;
 }
 
 
+/*
+ * @pool, @vol: if non-NULL, the volume whose wipe progress is
+ *              published; @pool must not be locked by the caller
+ */
 static int
-storageBackendVolWipeLocalFile(const char *path,
+storageBackendVolWipeLocalFile(virStoragePoolObj *pool,
+                               virStorageVolDef *vol,
+                               const char *path,
                                unsigned int algorithm,
                                unsigned long long allocation,
                                bool zero_end)
 {
-    const char *alg_char = NULL;
+    const virStorageBackendWipeMethod *method;
+    unsigned int npasses;
     struct stat st;
+    virStorageBackendWipeJob job = { 0 };
+    int ret = -1;
     VIR_AUTOCLOSE fd = -1;
-    g_autoptr(virCommand) cmd = NULL;
 
     fd = open(path, O_RDWR);
     if (fd == -1) {
@@ -2663,57 +3484,53 @@ storageBackendVolWipeLocalFile(const char *path,
 
     switch ((virStorageVolWipeAlgorithm) algorithm) {
     case VIR_STORAGE_VOL_WIPE_ALG_ZERO:
-        alg_char = "zero";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_NNSA:
-        alg_char = "nnsa";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_DOD:
-        alg_char = "dod";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_BSI:
-        alg_char = "bsi";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_GUTMANN:
-        alg_char = "gutmann";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_SCHNEIER:
-        alg_char = "schneier";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_PFITZNER7:
-        alg_char = "pfitzner7";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_PFITZNER33:
-        alg_char = "pfitzner33";
-        break;
     case VIR_STORAGE_VOL_WIPE_ALG_RANDOM:
-        alg_char = "random";
+        method = &wipeMethods[algorithm];
         break;
     case VIR_STORAGE_VOL_WIPE_ALG_TRIM:
         virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
                        _("'trim' algorithm not supported"));
         return -1;
     case VIR_STORAGE_VOL_WIPE_ALG_LAST:
+    default:
         virReportError(VIR_ERR_INVALID_ARG,
                        _("unsupported algorithm %d"),
                        algorithm);
         return -1;
     }
 
-    VIR_DEBUG("Wiping file '%s' with algorithm '%s'", path, alg_char);
+    VIR_DEBUG("Wiping file '%s' with algorithm '%s'", path, method->name);
 
-    if (algorithm != VIR_STORAGE_VOL_WIPE_ALG_ZERO) {
-        cmd = virCommandNew(SCRUB);
-        virCommandAddArgList(cmd, "-f", "-p", alg_char, path, NULL);
+    if (algorithm == VIR_STORAGE_VOL_WIPE_ALG_ZERO) {
+        if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE))
+            return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
+    } else if (S_ISREG(st.st_mode)) {
+        /* Overwrite the whole file, wherever its blocks are */
+        allocation = st.st_size;
+    }
 
-        return virCommandRun(cmd, NULL);
+    if (virMutexInit(&job.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to init mutex"));
+        return -1;
     }
 
-    if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE))
-        return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
+    npasses = storageBackendWipeMethodPasses(method);
+    storageBackendWipeJobInit(&job, pool, vol, allocation * npasses);
+
+    ret = storageBackendWipeLocal(&job, path, fd, &st, method,
+                                  allocation, zero_end);
 
-    return storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
-                                   zero_end);
+    virMutexDestroy(&job.lock);
+    virFreeError(job.err);
+    return ret;
 }
 
 
@@ -2737,7 +3554,7 @@ storageBackendVolWipePloop(virStorageVolDef *vol,
 
     disk_desc = g_strdup_printf("%s/DiskDescriptor.xml", vol->target.path);
 
-    if (storageBackendVolWipeLocalFile(target_path, algorithm,
+    if (storageBackendVolWipeLocalFile(NULL, NULL, target_path, algorithm,
                                        vol->target.allocation, false) < 0)
         return -1;
 
@@ -2763,7 +3580,7 @@ storageBackendVolWipePloop(virStorageVolDef *vol,
 
 
 int
-virStorageBackendVolWipeLocal(virStoragePoolObj *pool G_GNUC_UNUSED,
+virStorageBackendVolWipeLocal(virStoragePoolObj *pool,
                               virStorageVolDef *vol,
                               unsigned int algorithm,
                               unsigned int flags)
@@ -2778,8 +3595,9 @@ virStorageBackendVolWipeLocal(virStoragePoolObj *pool G_GNUC_UNUSED,
     if (vol->target.format == VIR_STORAGE_FILE_PLOOP) {
         ret = storageBackendVolWipePloop(vol, algorithm);
     } else {
-        ret = storageBackendVolWipeLocalFile(vol->target.path, algorithm,
-                                             vol->target.allocation, false);
+        ret = storageBackendVolWipeLocalFile(pool, vol, vol->target.path,
+                                             algorithm, vol->target.allocation,
+                                             false);
     }
 
     return ret;
@@ -3553,9 +4371,131 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDef *vol)
 }
 
 
+/* Upper bound on the number of threads probing volumes of
+ * a directory pool concurrently during refresh */
+#define VIR_STORAGE_REFRESH_LOCAL_WORKERS 16
+
+typedef struct _virStorageBackendRefreshLocalEntry virStorageBackendRefreshLocalEntry;
+struct _virStorageBackendRefreshLocalEntry {
+    virStorageVolDef *vol;
+    bool probe;     /* false if @vol was reused from the previous refresh */
+    int rc;         /* result of virStorageBackendRefreshVolTargetUpdate */
+    virErrorPtr err;
+};
+
+typedef struct _virStorageBackendRefreshLocalData virStorageBackendRefreshLocalData;
+struct _virStorageBackendRefreshLocalData {
+    virStorageBackendRefreshLocalEntry *entries;
+    size_t nentries;
+    int next;       /* index of the next entry to probe, atomic */
+};
+
+
+static void
+virStorageBackendRefreshLocalWorker(void *opaque)
+{
+    virStorageBackendRefreshLocalData *data = opaque;
+    int idx;
+
+    while ((idx = g_atomic_int_add(&data->next, 1)) < (int) data->nentries) {
+        virStorageBackendRefreshLocalEntry *entry = &data->entries[idx];
+
+        if (!entry->probe)
+            continue;
+
+        /* Errors are thread local, preserve them for the caller */
+        if ((entry->rc = virStorageBackendRefreshVolTargetUpdate(entry->vol)) == -1)
+            virErrorPreserveLast(&entry->err);
+    }
+}
+
+
+/*
+ * A volume left over from the previous refresh is still valid if its
+ * file was neither modified nor replaced since it was probed. Changing
+ * the inode in any way updates ctime; the inode number and size catch
+ * a file replaced by one carrying the same timestamps.
+ */
+static bool
+virStorageBackendRefreshLocalIsUnchanged(virStorageVolDef *vol)
+{
+    struct stat sb;
+    virStorageTimestamps *ts = vol->target.timestamps;
+
+    if (!ts || stat(vol->target.path, &sb) < 0)
+        return false;
+
+    if (!S_ISREG(sb.st_mode))
+        return false;
+
+    if (vol->target.dev != (unsigned long long) sb.st_dev ||
+        vol->target.ino != (unsigned long long) sb.st_ino ||
+        vol->target.physical != (unsigned long long) sb.st_size)
+        return false;
+
+#ifdef __APPLE__
+    return ts->mtime.tv_sec == sb.st_mtimespec.tv_sec &&
+        ts->mtime.tv_nsec == sb.st_mtimespec.tv_nsec &&
+        ts->ctime.tv_sec == sb.st_ctimespec.tv_sec &&
+        ts->ctime.tv_nsec == sb.st_ctimespec.tv_nsec;
+#else /* ! __APPLE__ */
+    return ts->mtime.tv_sec == sb.st_mtim.tv_sec &&
+        ts->mtime.tv_nsec == sb.st_mtim.tv_nsec &&
+        ts->ctime.tv_sec == sb.st_ctim.tv_sec &&
+        ts->ctime.tv_nsec == sb.st_ctim.tv_nsec;
+#endif /* ! __APPLE__ */
+}
+
+
+/*
+ * Probe all entries which need it, spreading the work over up to
+ * VIR_STORAGE_REFRESH_LOCAL_WORKERS threads. The calling thread
+ * takes part in probing too.
+ */
+static void
+virStorageBackendRefreshLocalProbe(virStorageBackendRefreshLocalEntry *entries,
+                                   size_t nentries)
+{
+    virStorageBackendRefreshLocalData data = {
+        .entries = entries, .nentries = nentries, .next = 0,
+    };
+    virThread threads[VIR_STORAGE_REFRESH_LOCAL_WORKERS - 1];
+    size_t nprobe = 0;
+    size_t nthreads = 0;
+    size_t i;
+
+    for (i = 0; i < nentries; i++) {
+        if (entries[i].probe)
+            nprobe++;
+    }
+
+    VIR_DEBUG("Probing %zu of %zu volumes", nprobe, nentries);
+
+    while (nthreads + 1 < MIN(nprobe, VIR_STORAGE_REFRESH_LOCAL_WORKERS)) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                virStorageBackendRefreshLocalWorker,
+                                "storage-refresh", false, &data) < 0) {
+            VIR_WARN("Failed to start volume probe thread, continuing with %zu",
+                     nthreads + 1);
+            virResetLastError();
+            break;
+        }
+        nthreads++;
+    }
+
+    virStorageBackendRefreshLocalWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * Volumes stashed by an incremental refresh whose files did not change
+ * are reused as they are; all others are probed in parallel.
  */
 int
 virStorageBackendRefreshLocal(virStoragePoolObj *pool)
@@ -3566,15 +4506,18 @@ virStorageBackendRefreshLocal(virStoragePoolObj *pool)
     struct statvfs sb;
     struct stat statbuf;
     int direrr;
-    g_autoptr(virStorageVolDef) vol = NULL;
+    virStorageBackendRefreshLocalEntry *entries = NULL;
+    size_t nentries = 0;
+    size_t i;
     VIR_AUTOCLOSE fd = -1;
     g_autoptr(virStorageSource) target = NULL;
+    int ret = -1;
 
     if (virDirOpen(&dir, def->target.path) < 0)
         return -1;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
+        virStorageBackendRefreshLocalEntry entry = { 0 };
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
@@ -3582,32 +4525,47 @@ virStorageBackendRefreshLocal(virStoragePoolObj *pool)
             continue;
         }
 
-        vol = g_new0(virStorageVolDef, 1);
+        if ((entry.vol = virStoragePoolObjTakeStashedVol(pool, ent->d_name))) {
+            if (virStorageBackendRefreshLocalIsUnchanged(entry.vol)) {
+                VIR_APPEND_ELEMENT(entries, nentries, entry);
+                continue;
+            }
+            g_clear_pointer(&entry.vol, virStorageVolDefFree);
+        }
 
-        vol->name = g_strdup(ent->d_name);
+        entry.vol = g_new0(virStorageVolDef, 1);
+        entry.probe = true;
 
-        vol->type = VIR_STORAGE_VOL_FILE;
-        vol->target.path = g_strdup_printf("%s/%s", def->target.path, vol->name);
+        entry.vol->name = g_strdup(ent->d_name);
+
+        entry.vol->type = VIR_STORAGE_VOL_FILE;
+        entry.vol->target.path = g_strdup_printf("%s/%s", def->target.path,
+                                                 entry.vol->name);
+
+        entry.vol->key = g_strdup(entry.vol->target.path);
+
+        VIR_APPEND_ELEMENT(entries, nentries, entry);
+    }
+    if (direrr < 0)
+        goto cleanup;
 
-        vol->key = g_strdup(vol->target.path);
+    virStorageBackendRefreshLocalProbe(entries, nentries);
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
+    for (i = 0; i < nentries; i++) {
+        if (entries[i].rc < 0) {
+            if (entries[i].rc == -2) {
                 /* Silently ignore non-regular files,
                  * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
                 continue;
             }
-            return -1;
+            virErrorRestore(&entries[i].err);
+            goto cleanup;
         }
 
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
-            return -1;
-        vol = NULL;
+        if (virStoragePoolObjAddVol(pool, entries[i].vol) < 0)
+            goto cleanup;
+        entries[i].vol = NULL;
     }
-    if (direrr < 0)
-        return -1;
 
     target = virStorageSourceNew();
 
@@ -3615,25 +4573,25 @@ virStorageBackendRefreshLocal(virStoragePoolObj *pool)
         virReportSystemError(errno,
                              _("cannot open path '%s'"),
                              def->target.path);
-        return -1;
+        goto cleanup;
     }
 
     if (fstat(fd, &statbuf) < 0) {
         virReportSystemError(errno,
                              _("cannot stat path '%s'"),
                              def->target.path);
-        return -1;
+        goto cleanup;
     }
 
     if (virStorageBackendUpdateVolTargetInfoFD(target, fd, &statbuf) < 0)
-        return -1;
+        goto cleanup;
 
     /* VolTargetInfoFD doesn't update capacity correctly for the pool case */
     if (statvfs(def->target.path, &sb) < 0) {
         virReportSystemError(errno,
                              _("cannot statvfs path '%s'"),
                              def->target.path);
-        return -1;
+        goto cleanup;
     }
 
     def->capacity = ((unsigned long long)sb.f_frsize *
@@ -3648,7 +4606,15 @@ virStorageBackendRefreshLocal(virStoragePoolObj *pool)
     VIR_FREE(def->target.perms.label);
     def->target.perms.label = g_strdup(target->perms->label);
 
-    return 0;
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nentries; i++) {
+        virStorageVolDefFree(entries[i].vol);
+        virFreeError(entries[i].err);
+    }
+    g_free(entries);
+    return ret;
 }
 
 
@@ -4064,11 +5030,13 @@ int
 virStorageBackendZeroPartitionTable(const char *path,
                                     unsigned long long size)
 {
-    if (storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
+    if (storageBackendVolWipeLocalFile(NULL, NULL, path,
+                                       VIR_STORAGE_VOL_WIPE_ALG_ZERO,
                                        size, false) < 0)
         return -1;
 
-    return storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
+    return storageBackendVolWipeLocalFile(NULL, NULL, path,
+                                          VIR_STORAGE_VOL_WIPE_ALG_ZERO,
                                           size, true);
 }
 
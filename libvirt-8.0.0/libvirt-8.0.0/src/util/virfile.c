@@ -1110,6 +1110,50 @@ safewrite(int fd, const void *buf, size_t count)
     return nwritten;
 }
 
+/* Like pread(), but restarts after EINTR and short reads,
+ * stopping only at EOF. */
+ssize_t
+safepread(int fd, void *buf, size_t count, off_t offset)
+{
+    size_t nread = 0;
+    while (count > 0) {
+        ssize_t r = pread(fd, buf, count, offset);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return r;
+        if (r == 0)
+            return nread;
+        buf = (char *)buf + r;
+        count -= r;
+        offset += r;
+        nread += r;
+    }
+    return nread;
+}
+
+/* Like pwrite(), but restarts after EINTR and short writes. */
+ssize_t
+safepwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+    size_t nwritten = 0;
+    while (count > 0) {
+        ssize_t r = pwrite(fd, buf, count, offset);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return r;
+        if (r == 0)
+            return nwritten;
+        buf = (const char *)buf + r;
+        count -= r;
+        offset += r;
+        nwritten += r;
+    }
+    return nwritten;
+}
+
 #ifdef WITH_POSIX_FALLOCATE
 static int
 safezero_posix_fallocate(int fd, off_t offset, off_t len)
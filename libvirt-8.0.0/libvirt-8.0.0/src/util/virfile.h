@@ -45,6 +45,10 @@ typedef enum {
 ssize_t saferead(int fd, void *buf, size_t count) G_GNUC_WARN_UNUSED_RESULT;
 ssize_t safewrite(int fd, const void *buf, size_t count)
     G_GNUC_WARN_UNUSED_RESULT;
+ssize_t safepread(int fd, void *buf, size_t count, off_t offset)
+    G_GNUC_WARN_UNUSED_RESULT;
+ssize_t safepwrite(int fd, const void *buf, size_t count, off_t offset)
+    G_GNUC_WARN_UNUSED_RESULT;
 int safezero(int fd, off_t offset, off_t len)
     G_GNUC_WARN_UNUSED_RESULT;
 int virFileAllocate(int fd, off_t offset, off_t len)
@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -342,6 +343,121 @@ virFileCacheLookupByFunc(virFileCache *cache,
 }
 
 
+/* Upper bound on the number of threads creating data concurrently
+ * in virFileCachePrefetch() */
+#define VIR_FILE_CACHE_PREFETCH_WORKERS 8
+
+typedef struct _virFileCachePrefetchData virFileCachePrefetchData;
+struct _virFileCachePrefetchData {
+    virFileCache *cache;
+    const char **names;
+    void **data;
+    size_t nnames;
+    int next;
+};
+
+
+static void
+virFileCachePrefetchWorker(void *opaque)
+{
+    virFileCachePrefetchData *pf = opaque;
+    int idx;
+
+    while ((idx = g_atomic_int_add(&pf->next, 1)) < (int) pf->nnames) {
+        const char *name = pf->names[idx];
+
+        if (!name)
+            continue;
+
+        /* Errors are thread local and the data will be created again
+         * by the next lookup which can report them properly. */
+        if (!(pf->data[idx] = virFileCacheNewData(pf->cache, name))) {
+            VIR_DEBUG("Failed to prefetch data for '%s': %s",
+                      name, virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+}
+
+
+/**
+ * virFileCachePrefetch:
+ * @cache: existing cache object
+ * @names: array of names of data to populate the cache with
+ * @nnames: number of items in @names
+ *
+ * Makes sure data for all @names is present in the cache. Data which is
+ * not cached yet is loaded from files or created using the newData
+ * handler by several threads in parallel without holding the cache
+ * lock, so the handlers must be safe to call concurrently. Failures
+ * are ignored, a subsequent virFileCacheLookup() will try to create
+ * the data again and report the error.
+ */
+void
+virFileCachePrefetch(virFileCache *cache,
+                     const char **names,
+                     size_t nnames)
+{
+    virFileCachePrefetchData pf = {
+        .cache = cache, .names = NULL, .data = NULL, .nnames = nnames,
+    };
+    virThread threads[VIR_FILE_CACHE_PREFETCH_WORKERS - 1];
+    size_t nmissing = 0;
+    size_t nthreads = 0;
+    size_t i;
+
+    pf.names = g_new0(const char *, nnames);
+    pf.data = g_new0(void *, nnames);
+
+    virObjectLock(cache);
+    for (i = 0; i < nnames; i++) {
+        void *data = virHashLookup(cache->table, names[i]);
+
+        if (data && cache->handlers.isValid(data, cache->priv))
+            continue;
+
+        pf.names[i] = names[i];
+        nmissing++;
+    }
+    virObjectUnlock(cache);
+
+    VIR_DEBUG("Prefetching %zu of %zu entries", nmissing, nnames);
+
+    while (nthreads + 1 < MIN(nmissing, VIR_FILE_CACHE_PREFETCH_WORKERS)) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                virFileCachePrefetchWorker,
+                                "filecache-load", false, &pf) < 0) {
+            /* Not fatal, the remaining threads will do the work */
+            VIR_WARN("Failed to create prefetch thread: %s",
+                     virGetLastErrorMessage());
+            virResetLastError();
+            break;
+        }
+        nthreads++;
+    }
+
+    virFileCachePrefetchWorker(&pf);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virObjectLock(cache);
+    for (i = 0; i < nnames; i++) {
+        if (!pf.data[i])
+            continue;
+
+        /* Replaces stale data as well as anything a concurrent
+         * lookup may have stored in the meantime */
+        if (virHashUpdateEntry(cache->table, pf.names[i], pf.data[i]) < 0)
+            virObjectUnref(pf.data[i]);
+    }
+    virObjectUnlock(cache);
+
+    g_free(pf.names);
+    g_free(pf.data);
+}
+
+
 /**
  * virFileCacheGetPriv:
  * @cache: existing cache object
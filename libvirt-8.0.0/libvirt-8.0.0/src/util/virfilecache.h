@@ -124,6 +124,11 @@ virFileCacheLookupByFunc(virFileCache *cache,
                          virHashSearcher iter,
                          const void *iterData);
 
+void
+virFileCachePrefetch(virFileCache *cache,
+                     const char **names,
+                     size_t nnames);
+
 void *
 virFileCacheGetPriv(virFileCache *cache);
 
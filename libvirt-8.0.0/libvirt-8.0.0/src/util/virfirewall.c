@@ -46,6 +46,14 @@ VIR_ENUM_IMPL(virFirewallLayerCommand,
               IP6TABLES,
 );
 
+VIR_ENUM_DECL(virFirewallLayerRestoreCommand);
+VIR_ENUM_IMPL(virFirewallLayerRestoreCommand,
+              VIR_FIREWALL_LAYER_LAST,
+              EBTABLES_RESTORE,
+              IPTABLES_RESTORE,
+              IP6TABLES_RESTORE,
+);
+
 struct _virFirewallRule {
     virFirewallLayer layer;
 
@@ -524,6 +532,149 @@ virFirewallApplyRuleDirect(virFirewallRule *rule,
 }
 
 
+/*
+ * A rule can be merged into a restore batch only if nothing
+ * depends on its individual outcome: its output isn't parsed
+ * and its failure must abort the whole transaction.
+ */
+static bool
+virFirewallRuleIsBatchable(virFirewallRule *rule,
+                           bool ignoreErrors)
+{
+    return !ignoreErrors && !rule->ignoreErrors && !rule->queryCB &&
+        rule->argsLen > 1;
+}
+
+
+static const char *
+virFirewallRuleGetTable(virFirewallRule *rule)
+{
+    size_t i;
+
+    for (i = 1; i + 1 < rule->argsLen; i++) {
+        if (STREQ(rule->args[i], "-t") ||
+            STREQ(rule->args[i], "--table"))
+            return rule->args[i + 1];
+    }
+
+    return "filter";
+}
+
+
+static void
+virFirewallRuleFormatRestore(virBuffer *buf,
+                             virFirewallRule *rule)
+{
+    size_t i;
+    bool first = true;
+
+    /* args[0] is the locking option ('-w' / '--concurrent') which
+     * is passed to the restore command itself instead */
+    for (i = 1; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if (i + 1 < rule->argsLen &&
+            (STREQ(arg, "-t") || STREQ(arg, "--table"))) {
+            i++;
+            continue;
+        }
+
+        if (!first)
+            virBufferAddChar(buf, ' ');
+        first = false;
+
+        if (*arg == '\0' || strpbrk(arg, " \t\"'\\")) {
+            const char *tmp;
+
+            virBufferAddChar(buf, '"');
+            for (tmp = arg; *tmp; tmp++) {
+                if (*tmp == '"' || *tmp == '\\')
+                    virBufferAddChar(buf, '\\');
+                virBufferAddChar(buf, *tmp);
+            }
+            virBufferAddChar(buf, '"');
+        } else {
+            virBufferAdd(buf, arg, -1);
+        }
+    }
+    virBufferAddChar(buf, '\n');
+}
+
+
+/**
+ * virFirewallApplyRulesRestore:
+ * @rules: rules to apply, all of the same layer
+ * @nrules: number of entries in @rules
+ *
+ * Feed @rules to a single invocation of the layer's restore
+ * command (iptables-restore, ip6tables-restore or ebtables-restore)
+ * in --noflush mode. Consecutive rules targeting the same table
+ * share one '*table ... COMMIT' section, so each section is
+ * committed to the kernel atomically and a failing rule leaves
+ * the section unapplied.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+virFirewallApplyRulesRestore(virFirewallRule **rules,
+                             size_t nrules)
+{
+    virFirewallLayer layer = rules[0]->layer;
+    const char *bin = virFirewallLayerRestoreCommandTypeToString(layer);
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = NULL;
+    g_autofree char *error = NULL;
+    const char *table = NULL;
+    int status;
+    size_t i;
+
+    if (!bin) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unknown firewall layer %d"),
+                       layer);
+        return -1;
+    }
+
+    for (i = 0; i < nrules; i++) {
+        const char *ruleTable = virFirewallRuleGetTable(rules[i]);
+
+        if (!table || STRNEQ(table, ruleTable)) {
+            if (table)
+                virBufferAddLit(&buf, "COMMIT\n");
+            table = ruleTable;
+            virBufferAsprintf(&buf, "*%s\n", table);
+        }
+        virFirewallRuleFormatRestore(&buf, rules[i]);
+    }
+    virBufferAddLit(&buf, "COMMIT\n");
+
+    input = virBufferContentAndReset(&buf);
+
+    VIR_INFO("Applying %zu rules through '%s'", nrules, bin);
+    VIR_DEBUG("Restore input:\n%s", input);
+
+    cmd = virCommandNewArgList(bin, "--noflush", NULL);
+    if (layer != VIR_FIREWALL_LAYER_ETHERNET)
+        virCommandAddArg(cmd, "-w");
+
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules through %s: %s"),
+                       bin, NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int G_GNUC_UNUSED
 virFirewallApplyRuleFirewallD(virFirewallRule *rule,
                               bool ignoreErrors,
@@ -575,17 +726,38 @@ virFirewallApplyGroup(virFirewall *firewall,
 {
     virFirewallGroup *group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    bool batch = (group->actionFlags & VIR_FIREWALL_TRANSACTION_BATCH);
     size_t i;
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=0x%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
-    for (i = 0; i < group->naction; i++) {
+    for (i = 0; i < group->naction;) {
+        size_t n = 0;
+
+        /* Collect the longest run of consecutive batchable rules for
+         * the same layer; rule order within the group is preserved */
+        if (batch) {
+            while (i + n < group->naction &&
+                   group->action[i + n]->layer == group->action[i]->layer &&
+                   virFirewallRuleIsBatchable(group->action[i + n],
+                                              ignoreErrors))
+                n++;
+        }
+
+        if (n > 1) {
+            if (virFirewallApplyRulesRestore(group->action + i, n) < 0)
+                return -1;
+            i += n;
+            continue;
+        }
+
         if (virFirewallApplyRule(firewall,
                                  group->action[i],
                                  ignoreErrors) < 0)
             return -1;
+        i++;
     }
     return 0;
 }
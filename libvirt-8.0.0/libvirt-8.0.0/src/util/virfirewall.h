@@ -93,6 +93,11 @@ typedef enum {
     /* Ignore all errors when applying rules, so no
      * rollback block will be required */
     VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS = (1 << 0),
+    /* Apply runs of consecutive rules for the same layer through
+     * a single iptables-restore/ip6tables-restore/ebtables-restore
+     * invocation instead of one process per rule. Rules with a
+     * query callback or which ignore errors still run one by one */
+    VIR_FIREWALL_TRANSACTION_BATCH = (1 << 1),
 } virFirewallTransactionFlags;
 
 void virFirewallStartTransaction(virFirewall *firewall,
@@ -59,6 +59,238 @@ virXMLXPathContextNew(xmlDocPtr xml)
 }
 
 
+/*
+ * Most expressions used by the XML parsers are simple relative location
+ * paths such as "./devices/disk", "string(./name[1])" or
+ * "string(./source/@file)". These are answered by walking the children
+ * of the context node directly, which is considerably cheaper than
+ * compiling and evaluating the expression with libxml2. Anything else
+ * is left to xmlXPathEval().
+ */
+#define VIR_XPATH_SIMPLE_MAX_STEPS 8
+
+typedef enum {
+    VIR_XPATH_SIMPLE_NODESET,
+    VIR_XPATH_SIMPLE_STRING,
+    VIR_XPATH_SIMPLE_BOOLEAN,
+    VIR_XPATH_SIMPLE_COUNT,
+} virXPathSimpleType;
+
+typedef struct _virXPathSimpleStep virXPathSimpleStep;
+struct _virXPathSimpleStep {
+    const char *name; /* not NUL terminated */
+    size_t namelen;
+    bool attr; /* attribute axis, '@name' */
+    bool first; /* '[1]' predicate */
+};
+
+
+static bool
+virXPathSimpleIsNameChar(char c)
+{
+    return g_ascii_isalnum(c) || c == '_' || c == '-' || c == '.';
+}
+
+
+/*
+ * Parse @xpath into @steps if it is of the form
+ *
+ *   [string(|boolean(|count(][./]name[[1]]/name[[1]]/.../[@attr][)]
+ *
+ * where names carry no namespace prefix. Returns false for any other
+ * expression.
+ */
+static bool
+virXPathSimpleParse(const char *xpath,
+                    virXPathSimpleType *type,
+                    virXPathSimpleStep *steps,
+                    size_t *nsteps)
+{
+    const char *p = xpath;
+    const char *end = xpath + strlen(xpath);
+
+    if (STRPREFIX(p, "string(")) {
+        *type = VIR_XPATH_SIMPLE_STRING;
+        p += strlen("string(");
+    } else if (STRPREFIX(p, "boolean(")) {
+        *type = VIR_XPATH_SIMPLE_BOOLEAN;
+        p += strlen("boolean(");
+    } else if (STRPREFIX(p, "count(")) {
+        *type = VIR_XPATH_SIMPLE_COUNT;
+        p += strlen("count(");
+    } else {
+        *type = VIR_XPATH_SIMPLE_NODESET;
+    }
+
+    if (*type != VIR_XPATH_SIMPLE_NODESET) {
+        if (end == p || end[-1] != ')')
+            return false;
+        end--;
+    }
+
+    if (end - p >= 2 && p[0] == '.' && p[1] == '/')
+        p += 2;
+
+    *nsteps = 0;
+    while (p < end) {
+        virXPathSimpleStep *step;
+
+        if (*nsteps == VIR_XPATH_SIMPLE_MAX_STEPS)
+            return false;
+
+        step = &steps[(*nsteps)++];
+        memset(step, 0, sizeof(*step));
+
+        if (*p == '@') {
+            step->attr = true;
+            p++;
+        }
+
+        step->name = p;
+        while (p < end && virXPathSimpleIsNameChar(*p))
+            p++;
+        step->namelen = p - step->name;
+
+        if (step->namelen == 0 ||
+            !(g_ascii_isalpha(step->name[0]) || step->name[0] == '_'))
+            return false;
+
+        if (!step->attr && end - p >= 3 && STRPREFIX(p, "[1]")) {
+            step->first = true;
+            p += 3;
+        }
+
+        if (p == end)
+            break;
+
+        /* an attribute can only be the last step */
+        if (*p != '/' || step->attr || ++p == end)
+            return false;
+    }
+
+    return *nsteps > 0;
+}
+
+
+static bool
+virXPathSimpleNameEqual(const xmlChar *name,
+                        const virXPathSimpleStep *step)
+{
+    return strncmp((const char *) name, step->name, step->namelen) == 0 &&
+           name[step->namelen] == '\0';
+}
+
+
+/*
+ * Evaluate a simple location path. Unprefixed name tests only match
+ * elements and attributes in no namespace, exactly as in XPath. Since
+ * all nodes selected by a step are at the same depth, collecting them
+ * parent by parent keeps them unique and in document order.
+ */
+static xmlXPathObjectPtr
+virXPathSimpleEval(const char *xpath,
+                   xmlXPathContextPtr ctxt)
+{
+    virXPathSimpleStep steps[VIR_XPATH_SIMPLE_MAX_STEPS];
+    virXPathSimpleType type;
+    size_t nsteps;
+    g_autoptr(GPtrArray) cur = NULL;
+    g_autoptr(GPtrArray) next = NULL;
+    xmlNodeSetPtr set;
+    size_t i;
+    size_t j;
+
+    if (!ctxt->node ||
+        !virXPathSimpleParse(xpath, &type, steps, &nsteps))
+        return NULL;
+
+    cur = g_ptr_array_new();
+    next = g_ptr_array_new();
+    g_ptr_array_add(cur, ctxt->node);
+
+    for (i = 0; i < nsteps && cur->len > 0; i++) {
+        const virXPathSimpleStep *step = &steps[i];
+        GPtrArray *tmp;
+
+        g_ptr_array_set_size(next, 0);
+
+        for (j = 0; j < cur->len; j++) {
+            xmlNodePtr node = g_ptr_array_index(cur, j);
+
+            if (step->attr) {
+                xmlAttrPtr attr;
+
+                if (node->type != XML_ELEMENT_NODE)
+                    continue;
+
+                for (attr = node->properties; attr; attr = attr->next) {
+                    if (!attr->ns && virXPathSimpleNameEqual(attr->name, step)) {
+                        g_ptr_array_add(next, attr);
+                        break;
+                    }
+                }
+            } else {
+                xmlNodePtr child;
+
+                for (child = node->children; child; child = child->next) {
+                    if (child->type != XML_ELEMENT_NODE || child->ns ||
+                        !virXPathSimpleNameEqual(child->name, step))
+                        continue;
+
+                    g_ptr_array_add(next, child);
+                    if (step->first)
+                        break;
+                }
+            }
+        }
+
+        tmp = cur;
+        cur = next;
+        next = tmp;
+    }
+
+    if (i < nsteps)
+        g_ptr_array_set_size(cur, 0);
+
+    switch (type) {
+    case VIR_XPATH_SIMPLE_STRING:
+        if (cur->len == 0)
+            return xmlXPathNewCString("");
+        return xmlXPathWrapString(xmlXPathCastNodeToString(g_ptr_array_index(cur, 0)));
+
+    case VIR_XPATH_SIMPLE_BOOLEAN:
+        return xmlXPathNewBoolean(cur->len > 0);
+
+    case VIR_XPATH_SIMPLE_COUNT:
+        return xmlXPathNewFloat(cur->len);
+
+    case VIR_XPATH_SIMPLE_NODESET:
+        if (!(set = xmlXPathNodeSetCreate(NULL)))
+            abort();
+        for (j = 0; j < cur->len; j++) {
+            if (xmlXPathNodeSetAddUnique(set, g_ptr_array_index(cur, j)) < 0)
+                abort();
+        }
+        return xmlXPathWrapNodeSet(set);
+    }
+
+    return NULL;
+}
+
+
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    xmlXPathObjectPtr obj;
+
+    if ((obj = virXPathSimpleEval(xpath, ctxt)))
+        return obj;
+
+    return xmlXPathEval(BAD_CAST xpath, ctxt);
+}
+
+
 /**
  * virXPathString:
  * @xpath: the XPath string to evaluate
@@ -80,7 +312,7 @@ virXPathString(const char *xpath,
                        "%s", _("Invalid parameter to virXPathString()"));
         return NULL;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
         return NULL;
@@ -112,7 +344,7 @@ virXPathNumber(const char *xpath,
                        "%s", _("Invalid parameter to virXPathNumber()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
         return -1;
@@ -136,7 +368,7 @@ virXPathLongBase(const char *xpath,
                        "%s", _("Invalid parameter to virXPathLong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_l((char *) obj->stringval, NULL, base, value) < 0)
@@ -237,7 +469,7 @@ virXPathULongBase(const char *xpath,
                        "%s", _("Invalid parameter to virXPathULong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ul((char *) obj->stringval, NULL, base, value) < 0)
@@ -349,7 +581,7 @@ virXPathULongLong(const char *xpath,
                        "%s", _("Invalid parameter to virXPathULong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ull((char *) obj->stringval, NULL, 10, value) < 0)
@@ -391,7 +623,7 @@ virXPathLongLong(const char *xpath,
                        "%s", _("Invalid parameter to virXPathLongLong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ll((char *) obj->stringval, NULL, 10, value) < 0)
@@ -830,7 +1062,7 @@ virXPathBoolean(const char *xpath,
                        "%s", _("Invalid parameter to virXPathBoolean()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
         return -1;
@@ -859,7 +1091,7 @@ virXPathNode(const char *xpath,
                        "%s", _("Invalid parameter to virXPathNode()"));
         return NULL;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
         (obj->nodesetval->nodeTab == NULL)) {
@@ -897,7 +1129,7 @@ virXPathNodeSet(const char *xpath,
     if (list != NULL)
         *list = NULL;
 
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if (obj == NULL)
         return 0;
 
@@ -1159,6 +1159,55 @@ test28(const void *unused G_GNUC_UNUSED)
 }
 
 
+static int
+test29Hook(void *data G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+
+/*
+ * Measure the latency of running a trivial command. Commands which
+ * need nothing set up in the child can be spawned directly, while a
+ * pre-exec hook forces the full fork path, so compare both. Only
+ * done in debug mode.
+ */
+static int
+test29(const void *unused G_GNUC_UNUSED)
+{
+    const size_t iterations = 200;
+    gint64 elapsed[2] = { 0 };
+    size_t hook;
+    size_t i;
+
+    if (!virTestGetDebug())
+        return EXIT_AM_SKIP;
+
+    for (hook = 0; hook < G_N_ELEMENTS(elapsed); hook++) {
+        gint64 start = g_get_monotonic_time();
+
+        for (i = 0; i < iterations; i++) {
+            g_autoptr(virCommand) cmd = virCommandNew("true");
+
+            if (hook)
+                virCommandSetPreExecHook(cmd, test29Hook, NULL);
+
+            if (virCommandRun(cmd, NULL) < 0) {
+                printf("Cannot run child %s\n", virGetLastErrorMessage());
+                return -1;
+            }
+        }
+
+        elapsed[hook] = g_get_monotonic_time() - start;
+    }
+
+    VIR_TEST_DEBUG("spawn: %lld us, fork: %lld us per command",
+                   (long long) elapsed[0] / (long long) iterations,
+                   (long long) elapsed[1] / (long long) iterations);
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -1256,6 +1305,7 @@ mymain(void)
     DO_TEST(test26);
     DO_TEST(test27);
     DO_TEST(test28);
+    DO_TEST(test29);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -38,6 +38,8 @@
 #include "qemusecuritytest.h"
 #include "security/security_manager.h"
 #include "virhostuptime.h"
+#include "virtime.h"
+#include "virprocess.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -86,6 +88,15 @@ GHashTable *chown_paths = NULL;
  * the path is the key and the value is the label. */
 GHashTable *selinux_paths = NULL;
 
+/* When set, the first chown() waits for another one to run
+ * concurrently, which proves that transaction items are applied
+ * by more threads. See startParallelCheck(). */
+static bool parallel_check;
+static bool parallel_seen;
+static bool parallel_waiting;
+static bool parallel_cond_ready;
+static virCond parallel_cond;
+
 
 static void
 init_hash(void)
@@ -290,6 +301,28 @@ mock_chown(const char *path,
         goto cleanup;
     val = NULL;
 
+    if (parallel_check) {
+        if (parallel_waiting) {
+            parallel_seen = true;
+            virCondBroadcast(&parallel_cond);
+        } else {
+            unsigned long long now;
+
+            if (virTimeMillisNow(&now) < 0)
+                goto cleanup;
+
+            parallel_waiting = true;
+            while (!parallel_seen) {
+                if (virCondWaitUntil(&parallel_cond, &m, now + 5000) < 0) {
+                    /* Nobody came, items are applied serially */
+                    parallel_check = false;
+                    break;
+                }
+            }
+            parallel_waiting = false;
+        }
+    }
+
     ret = 0;
  cleanup:
     virMutexUnlock(&m);
@@ -509,11 +542,61 @@ void freePaths(void)
 }
 
 
+/**
+ * startParallelCheck:
+ *
+ * Make chown() check that at least two paths are chowned
+ * concurrently. The result is then obtained via
+ * stopParallelCheck().
+ */
+void startParallelCheck(void)
+{
+    virMutexLock(&m);
+    if (!parallel_cond_ready) {
+        if (virCondInit(&parallel_cond) < 0)
+            abort();
+        parallel_cond_ready = true;
+    }
+    parallel_check = true;
+    parallel_seen = false;
+    virMutexUnlock(&m);
+}
+
+
+/**
+ * stopParallelCheck:
+ *
+ * Returns true if two chown() calls were seen running
+ * concurrently since startParallelCheck(), false otherwise.
+ */
+bool stopParallelCheck(void)
+{
+    bool ret;
+
+    virMutexLock(&m);
+    ret = parallel_seen;
+    parallel_check = false;
+    virMutexUnlock(&m);
+    return ret;
+}
+
+
+/* The real function passes the pid of the parent to @cb, like
+ * virProcessRunInMountNamespace() passes the pid of the domain. */
 int
 virProcessRunInFork(virProcessForkCallback cb,
                     void *opaque)
 {
-    return cb(-1, opaque);
+    return cb(getpid(), opaque);
+}
+
+
+int
+virProcessRunInMountNamespace(pid_t pid,
+                              virProcessNamespaceCallback cb,
+                              void *opaque)
+{
+    return cb(pid, opaque);
 }
 
 
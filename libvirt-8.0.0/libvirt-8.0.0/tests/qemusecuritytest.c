@@ -25,6 +25,7 @@
 #include "security/security_util.h"
 #include "conf/domain_conf.h"
 #include "qemu/qemu_domain.h"
+#include "qemu/qemu_namespace.h"
 #include "qemu/qemu_security.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -132,6 +133,77 @@ testDomain(const void *opaque)
 }
 
 
+/* Relabel disks the way a domain started with the default config
+ * does: inside its mount namespace and with remembering of owners.
+ * Their paths are distinct files, so they must be chowned by more
+ * threads at once. */
+static int
+testParallelCommit(const void *opaque)
+{
+    virQEMUDriver *driver = (virQEMUDriver *) opaque;
+    g_autoptr(virDomainObj) vm = NULL;
+    g_autoptr(GHashTable) notRestored = virHashNew(NULL);
+    g_autofree char *dir = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (prepareObjects(driver, "disk-virtio", &vm) < 0)
+        return -1;
+
+    dir = g_strdup(abs_builddir "/qemusecuritydir-XXXXXX");
+    if (!g_mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create %s\n", dir);
+        return -1;
+    }
+
+    /* The paths are stat()-ed to check they are distinct */
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virStorageSource *src = vm->def->disks[i]->src;
+
+        g_free(src->path);
+        src->path = g_strdup_printf("%s/disk%zu.img", dir, i);
+        src->readonly = false;
+        src->shared = false;
+
+        if (virFileTouch(src->path, 0600) < 0)
+            goto cleanup;
+    }
+
+    if (qemuDomainEnableNamespace(vm, QEMU_DOMAIN_NS_MOUNT) < 0)
+        goto cleanup;
+    vm->pid = getpid();
+
+    if (g_setenv(ENVVAR, "1", FALSE) == FALSE)
+        goto cleanup;
+
+    startParallelCheck();
+
+    if (qemuSecuritySetAllLabel(driver, vm, NULL, false) < 0) {
+        stopParallelCheck();
+        goto cleanup;
+    }
+
+    if (!stopParallelCheck()) {
+        fprintf(stderr, "Disks were not relabelled in parallel\n");
+        goto cleanup;
+    }
+
+    qemuSecurityRestoreAllLabel(driver, vm, false);
+
+    if (checkPaths(notRestored) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    g_unsetenv(ENVVAR);
+    freePaths();
+    for (i = 0; i < vm->def->ndisks; i++)
+        unlink(vm->def->disks[i]->src->path);
+    rmdir(dir);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -251,6 +323,9 @@ mymain(void)
     DO_TEST_DOMAIN("x86_64-q35-graphics");
     DO_TEST_DOMAIN("x86_64-q35-headless");
 
+    if (virTestRun("parallel-commit", testParallelCommit, &driver) < 0)
+        ret = -1;
+
  cleanup:
     qemuTestDriverFree(&driver);
 #ifdef WITH_SELINUX
@@ -25,3 +25,7 @@
 extern int checkPaths(GHashTable *paths);
 
 extern void freePaths(void);
+
+extern void startParallelCheck(void);
+
+extern bool stopParallelCheck(void);
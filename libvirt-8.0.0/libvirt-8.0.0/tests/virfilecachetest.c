@@ -78,6 +78,7 @@ testFileCacheObjNew(const char *data)
 
 struct _testFileCachePriv {
     bool dataSaved;
+    int newDataCalls; /* updated atomically, see virFileCachePrefetch */
     const char *newData;
     const char *expectData;
 };
@@ -101,6 +102,8 @@ testFileCacheNewData(const char *name G_GNUC_UNUSED,
 {
     testFileCachePriv *testPriv = priv;
 
+    g_atomic_int_inc(&testPriv->newDataCalls);
+
     return testFileCacheObjNew(testPriv->newData);
 }
 
@@ -192,6 +195,56 @@ testFileCache(const void *opaque)
 }
 
 
+static int
+testFileCachePrefetch(const void *opaque)
+{
+    const testFileCacheData *data = opaque;
+    testFileCachePriv *testPriv = virFileCacheGetPriv(data->cache);
+    const char *names[] = { "prefetchA", "prefetchB", "prefetchC" };
+    size_t i;
+
+    testPriv->newData = data->newData;
+    testPriv->expectData = data->expectData;
+    testPriv->newDataCalls = 0;
+
+    virFileCachePrefetch(data->cache, names, G_N_ELEMENTS(names));
+
+    if (testPriv->newDataCalls != G_N_ELEMENTS(names)) {
+        fprintf(stderr, "Expected %zu entries to be created, got %d.\n",
+                G_N_ELEMENTS(names), testPriv->newDataCalls);
+        return -1;
+    }
+
+    /* Entries which are cached already must not be created again */
+    virFileCachePrefetch(data->cache, names, G_N_ELEMENTS(names));
+
+    if (testPriv->newDataCalls != G_N_ELEMENTS(names)) {
+        fprintf(stderr, "Valid entries were created again.\n");
+        return -1;
+    }
+
+    /* Everything must be in memory now, so lookups won't create and
+     * save any data */
+    for (i = 0; i < G_N_ELEMENTS(names); i++) {
+        testFileCacheData lookup = *data;
+
+        lookup.name = names[i];
+        lookup.newData = NULL;
+        lookup.expectSave = false;
+
+        if (testFileCache(&lookup) < 0)
+            return -1;
+    }
+
+    if (testPriv->newDataCalls != G_N_ELEMENTS(names)) {
+        fprintf(stderr, "Lookups created prefetched entries again.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -214,12 +267,23 @@ mymain(void)
             ret = -1; \
     } while (0)
 
+#define TEST_RUN_PREFETCH(newData) \
+    do { \
+        testFileCacheData data = { \
+            cache, NULL, newData, newData, false \
+        }; \
+        if (virTestRun("prefetch", testFileCachePrefetch, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
     /* The cache file name is created using:
      * '$ echo -n $TEST_NAME | sha256sum' */
     TEST_RUN("cacheValid", NULL, "aaa\n", false);
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
 
+    TEST_RUN_PREFETCH("ddd\n");
+
     virObjectUnref(cache);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
@@ -774,6 +774,103 @@ testFirewallQuery(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static void
+testFirewallBatchHook(const char *const*args G_GNUC_UNUSED,
+                      const char *const*env G_GNUC_UNUSED,
+                      const char *input,
+                      char **output G_GNUC_UNUSED,
+                      char **error G_GNUC_UNUSED,
+                      int *status G_GNUC_UNUSED,
+                      void *opaque)
+{
+    virBuffer *inputbuf = opaque;
+
+    if (input)
+        virBufferAdd(inputbuf, input, -1);
+}
+
+
+static int
+testFirewallBatchGroup(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) inputbuf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virFirewall) fw = virFirewallNew();
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE " --noflush -w\n"
+        IPTABLES " -w -A OUTPUT --jump DROP\n"
+        EBTABLES_RESTORE " --noflush\n";
+    const char *expectedInput =
+        "*filter\n"
+        "-A INPUT --source 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source !192.168.122.1 --jump REJECT\n"
+        "COMMIT\n"
+        "*nat\n"
+        "-A POSTROUTING -m comment --comment \"libvirt rule\" --jump MASQUERADE\n"
+        "COMMIT\n"
+        "*nat\n"
+        "-N libvirt-I-vnet0\n"
+        "-A PREROUTING -i vnet0 -j libvirt-I-vnet0\n"
+        "COMMIT\n";
+    g_autoptr(virCommandDryRunToken) dryRunToken = virCommandDryRunTokenNew();
+
+    virCommandSetDryRun(dryRunToken, &cmdbuf, false, false,
+                        testFirewallBatchHook, &inputbuf);
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_BATCH);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source", "!192.168.122.1",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-t", "nat", "-A", "POSTROUTING",
+                       "-m", "comment", "--comment", "libvirt rule",
+                       "--jump", "MASQUERADE", NULL);
+
+    /* Rules ignoring errors are not part of a batch */
+    virFirewallAddRuleFull(fw, VIR_FIREWALL_LAYER_IPV4,
+                           true, NULL, NULL,
+                           "-A", "OUTPUT",
+                           "--jump", "DROP", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_ETHERNET,
+                       "-t", "nat", "-N", "libvirt-I-vnet0", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_ETHERNET,
+                       "-t", "nat", "-A", "PREROUTING",
+                       "-i", "vnet0", "-j", "libvirt-I-vnet0", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        return -1;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        return -1;
+    }
+
+    actual = virBufferCurrentContent(&inputbuf);
+
+    if (STRNEQ_NULLABLE(expectedInput, actual)) {
+        fprintf(stderr, "Unexpected restore input\n");
+        virTestDifference(stderr, expectedInput, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -795,6 +892,7 @@ mymain(void)
     RUN_TEST("many rollback", testFirewallManyRollback);
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
+    RUN_TEST("batch group", testFirewallBatchGroup);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -22,6 +22,7 @@
 #include <fcntl.h>
 
 #include "virrotatingfile.h"
+#include "virfile.h"
 #include "virlog.h"
 #include "testutils.h"
 
@@ -555,6 +556,51 @@ static int testRotatingFileWriterLargeFile(const void *data G_GNUC_UNUSED)
 }
 
 
+static int testRotatingFileWriterExternalAppend(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileWriter *file;
+    VIR_AUTOCLOSE fd = -1;
+    int ret = -1;
+    char buf[256];
+
+    if (testRotatingFileInitFiles(512,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    4096,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    memset(buf, 0x5e, sizeof(buf));
+
+    /* Data written by someone else in between must not be overwritten */
+    if ((fd = open(FILENAME, O_WRONLY | O_APPEND)) < 0 ||
+        safewrite(fd, buf, sizeof(buf)) != (ssize_t) sizeof(buf))
+        goto cleanup;
+
+    if (virRotatingFileWriterAppend(file, buf, sizeof(buf)) != (ssize_t) sizeof(buf))
+        goto cleanup;
+
+    if (testRotatingFileWriterAssertFileSizes(1024,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    return ret;
+}
+
+
 static int testRotatingFileReaderOne(const void *data G_GNUC_UNUSED)
 {
     virRotatingFileReader *file;
@@ -724,6 +770,9 @@ mymain(void)
     if (virTestRun("Rotating file write to file larger then maxlen", testRotatingFileWriterLargeFile, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Rotating file write external append", testRotatingFileWriterExternalAppend, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("Rotating file read one", testRotatingFileReaderOne, NULL) < 0)
         ret = -1;
 
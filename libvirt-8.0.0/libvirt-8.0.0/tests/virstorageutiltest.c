@@ -16,6 +16,8 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "testutils.h"
 #include "virerror.h"
@@ -70,11 +72,221 @@ testGlusterExtractPoolSources(const void *opaque)
 }
 
 
+#define SCRATCHDIRTEMPLATE abs_builddir "/virstorageutildir-XXXXXX"
+
+struct testWipeData {
+    const char *scratchdir;
+    const char *name;
+    virStorageVolWipeAlgorithm algorithm;
+    size_t size;
+    int expect;     /* value of every byte afterwards, -1 for random data */
+};
+
+static int
+testWipeLocal(const void *opaque)
+{
+    const struct testWipeData *data = opaque;
+    virStorageVolDef def = { 0 };
+    g_autofree char *path = NULL;
+    g_autofree char *orig = NULL;
+    g_autofree char *actual = NULL;
+    size_t len = 0;
+    struct stat before;
+    struct stat after;
+    size_t i;
+    int ret = -1;
+
+    path = g_strdup_printf("%s/%s.raw", data->scratchdir, data->name);
+
+    orig = g_new(char, data->size);
+    memset(orig, 0x5a, data->size);
+    if (!g_file_set_contents(path, orig, data->size, NULL) ||
+        stat(path, &before) < 0) {
+        fprintf(stderr, "cannot create '%s'\n", path);
+        goto cleanup;
+    }
+
+    def.name = (char *) data->name;
+    def.type = VIR_STORAGE_VOL_FILE;
+    def.target.path = path;
+    def.target.format = VIR_STORAGE_FILE_RAW;
+    def.target.allocation = data->size;
+
+    if (virStorageBackendVolWipeLocal(NULL, &def, data->algorithm, 0) < 0)
+        goto cleanup;
+
+    if (!g_file_get_contents(path, &actual, &len, NULL) ||
+        stat(path, &after) < 0) {
+        fprintf(stderr, "cannot read back '%s'\n", path);
+        goto cleanup;
+    }
+
+    if (len != data->size) {
+        fprintf(stderr, "size changed from %zu to %zu\n", data->size, len);
+        goto cleanup;
+    }
+
+    /* Zeroing must not deallocate a preallocated volume */
+    if (after.st_blocks < before.st_blocks) {
+        fprintf(stderr, "allocation dropped from %lld to %lld blocks\n",
+                (long long) before.st_blocks, (long long) after.st_blocks);
+        goto cleanup;
+    }
+
+    if (data->expect < 0) {
+        if (memcmp(actual, orig, len) == 0) {
+            fprintf(stderr, "volume was not overwritten\n");
+            goto cleanup;
+        }
+    } else {
+        for (i = 0; i < len; i++) {
+            if ((unsigned char) actual[i] != data->expect) {
+                fprintf(stderr, "byte %zu is 0x%02x, expected 0x%02x\n",
+                        i, (unsigned char) actual[i], data->expect);
+                goto cleanup;
+            }
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    unlink(path);
+    return ret;
+}
+
+
+struct testCopyData {
+    const char *scratchdir;
+    const char *name;
+    unsigned long long allocation;  /* of the clone */
+};
+
+#define TEST_COPY_CAPACITY (8 * 1024 * 1024)
+
+static int
+testCopyLocal(const void *opaque)
+{
+    const struct testCopyData *data = opaque;
+    g_autofree char *poolxml = NULL;
+    g_autofree char *inputxml = NULL;
+    g_autofree char *volxml = NULL;
+    g_autofree char *inputpath = NULL;
+    g_autofree char *path = NULL;
+    g_autofree char *buf = NULL;
+    g_autofree char *expected = NULL;
+    g_autofree char *actual = NULL;
+    g_autoptr(virStorageVolDef) inputvol = NULL;
+    g_autoptr(virStorageVolDef) vol = NULL;
+    virStoragePoolDef *def = NULL;
+    virStoragePoolObj *obj = NULL;
+    size_t len = 0;
+    size_t expectedlen = 0;
+    struct stat st;
+    size_t i;
+    VIR_AUTOCLOSE fd = -1;
+    int ret = -1;
+
+    inputpath = g_strdup_printf("%s/%s-input.raw", data->scratchdir, data->name);
+    path = g_strdup_printf("%s/%s.raw", data->scratchdir, data->name);
+
+    /* Data at the start and the end of the input, with a hole and a
+     * run of zero blocks in between */
+    buf = g_new(char, 1024 * 1024);
+    for (i = 0; i < 1024 * 1024; i++)
+        buf[i] = i % 251 + 1;
+
+    if ((fd = open(inputpath, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0 ||
+        safepwrite(fd, buf, 1024 * 1024, 0) < 0 ||
+        safezero(fd, 1024 * 1024, 1024 * 1024) < 0 ||
+        safepwrite(fd, buf, 1024 * 1024, TEST_COPY_CAPACITY - 1024 * 1024) < 0 ||
+        VIR_CLOSE(fd) < 0) {
+        fprintf(stderr, "cannot create '%s'\n", inputpath);
+        goto cleanup;
+    }
+
+    poolxml = g_strdup_printf("<pool type='dir'>"
+                              "  <name>copy</name>"
+                              "  <target><path>%s</path></target>"
+                              "</pool>", data->scratchdir);
+    inputxml = g_strdup_printf("<volume>"
+                               "  <name>%s-input.raw</name>"
+                               "  <capacity>%d</capacity>"
+                               "  <target>"
+                               "    <path>%s</path>"
+                               "    <format type='raw'/>"
+                               "  </target>"
+                               "</volume>",
+                               data->name, TEST_COPY_CAPACITY, inputpath);
+    volxml = g_strdup_printf("<volume>"
+                             "  <name>%s.raw</name>"
+                             "  <capacity>%d</capacity>"
+                             "  <allocation>%llu</allocation>"
+                             "  <target>"
+                             "    <path>%s</path>"
+                             "    <format type='raw'/>"
+                             "  </target>"
+                             "</volume>",
+                             data->name, TEST_COPY_CAPACITY,
+                             data->allocation, path);
+
+    if (!(def = virStoragePoolDefParseString(poolxml, 0)))
+        goto cleanup;
+
+    if (!(obj = virStoragePoolObjNew())) {
+        virStoragePoolDefFree(def);
+        goto cleanup;
+    }
+    virStoragePoolObjSetDef(obj, def);
+
+    if (!(inputvol = virStorageVolDefParseString(def, inputxml, 0)) ||
+        !(vol = virStorageVolDefParseString(def, volxml, 0)))
+        goto cleanup;
+
+    if (virStorageBackendVolBuildFromLocal(obj, vol, inputvol, 0) < 0)
+        goto cleanup;
+
+    if (!g_file_get_contents(inputpath, &expected, &expectedlen, NULL) ||
+        !g_file_get_contents(path, &actual, &len, NULL) ||
+        stat(path, &st) < 0) {
+        fprintf(stderr, "cannot read back '%s'\n", path);
+        goto cleanup;
+    }
+
+    if (len != expectedlen || memcmp(actual, expected, len) != 0) {
+        fprintf(stderr, "clone of '%s' differs\n", inputpath);
+        goto cleanup;
+    }
+
+    /* A fully allocated clone must stay allocated */
+    if (data->allocation >= TEST_COPY_CAPACITY &&
+        (unsigned long long) st.st_blocks * 512 < TEST_COPY_CAPACITY) {
+        fprintf(stderr, "clone has %lld blocks allocated, expected %d\n",
+                (long long) st.st_blocks, TEST_COPY_CAPACITY / 512);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStoragePoolObjEndAPI(&obj);
+    unlink(inputpath);
+    unlink(path);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
     int ret = 0;
 
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create %s\n", scratchdir);
+        abort();
+    }
+
 #define DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL(testname, sffx, pooltype) \
     do { \
         struct testGlusterExtractPoolSourcesData data; \
@@ -104,6 +316,48 @@ mymain(void)
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_NETFS
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL
 
+    /* Sizes which are not a multiple of the O_DIRECT alignment use
+     * buffered writes; all sizes span several writer threads */
+#define DO_TEST_WIPE(testname, alg, sz, val) \
+    do { \
+        struct testWipeData data = { \
+            .scratchdir = scratchdir, .name = testname, \
+            .algorithm = VIR_STORAGE_VOL_WIPE_ALG_ ## alg, \
+            .size = sz, .expect = val, \
+        }; \
+        if (virTestRun("wipe-" testname, testWipeLocal, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_WIPE("zero", ZERO, 4 * 1024 * 1024, 0x00);
+    DO_TEST_WIPE("zero-unaligned", ZERO, 3 * 1024 * 1024 + 1000, 0x00);
+    DO_TEST_WIPE("nnsa", NNSA, 4 * 1024 * 1024, 0x00);
+    DO_TEST_WIPE("dod", DOD, 4 * 1024 * 1024, 0xff);
+    DO_TEST_WIPE("dod-unaligned", DOD, 3 * 1024 * 1024 + 1000, 0xff);
+    DO_TEST_WIPE("bsi", BSI, 4 * 1024 * 1024, 0x7f);
+    DO_TEST_WIPE("random", RANDOM, 3 * 1024 * 1024 + 1000, -1);
+
+#undef DO_TEST_WIPE
+
+    /* A fully allocated clone takes the copy_file_range() path where
+     * the file system supports it, a sparse one the regular copy */
+#define DO_TEST_COPY(testname, alloc) \
+    do { \
+        struct testCopyData data = { \
+            .scratchdir = scratchdir, .name = testname, .allocation = alloc, \
+        }; \
+        if (virTestRun("copy-" testname, testCopyLocal, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_COPY("allocated", TEST_COPY_CAPACITY);
+    DO_TEST_COPY("sparse", 0);
+
+#undef DO_TEST_COPY
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,364 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#include "virfile.h"
+#include "virxml.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Expressions evaluated with the domain root as context node */
+static const char *domainExprs[] = {
+    "./name",
+    "string(./name[1])",
+    "string(./uuid[1])",
+    "string(./memory)",
+    "string(./memory/@unit)",
+    "string(./vcpu/@placement)",
+    "string(./os/type[1])",
+    "string(./os/type/@arch)",
+    "string(./os/type[1]/@machine)",
+    "string(./on_poweroff)",
+    "boolean(./features/acpi)",
+    "boolean(./devices/emulator)",
+    "string(./devices/emulator[1])",
+    "./cpu/feature",
+    "string(./cpu/@mode)",
+    "./devices/disk",
+    "./devices/disk/source",
+    "./devices/disk/source/@file",
+    "string(./devices/disk/source/@file)",
+    "string(./devices/disk/target/@dev)",
+    "count(./devices/disk)",
+    "./devices/interface/model",
+    "./nonexistent/child",
+    "string(./nonexistent/@attr)",
+    "count(./devices/*)",
+    "string(./os/type[@arch='x86_64'])",
+};
+
+/* Expressions evaluated with each device as context node */
+static const char *deviceExprs[] = {
+    "./source",
+    "./source[1]",
+    "string(./@type)",
+    "string(./@device)",
+    "string(./source/@file)",
+    "string(./source/@dev)",
+    "string(./target/@dev)",
+    "string(./target/@bus)",
+    "./address",
+    "string(./address/@type)",
+    "string(./driver/@name)",
+    "string(./model/@type)",
+    "string(./alias/@name)",
+    "boolean(./readonly)",
+    "count(./source)",
+    "string(.)",
+};
+
+
+/*
+ * Evaluate @xpath with the virXPath helper a parser would use for its
+ * result type, which takes a shortcut for simple location paths, and
+ * compare the result with @obj from plain libxml2 evaluation. The time
+ * spent by the helper is added to @elapsed.
+ */
+static int
+testXPathCheck(const char *path,
+               const char *xpath,
+               xmlXPathContextPtr ctxt,
+               xmlXPathObjectPtr obj,
+               gint64 *elapsed)
+{
+    gint64 start = g_get_monotonic_time();
+
+    switch (obj->type) {
+    case XPATH_NODESET: {
+        g_autofree xmlNodePtr *nodes = NULL;
+        int nnodes = virXPathNodeSet(xpath, ctxt, &nodes);
+        int expect = obj->nodesetval ? obj->nodesetval->nodeNr : 0;
+
+        *elapsed += g_get_monotonic_time() - start;
+
+        if (nnodes != expect ||
+            (nnodes > 0 &&
+             memcmp(nodes, obj->nodesetval->nodeTab,
+                    nnodes * sizeof(xmlNodePtr)) != 0)) {
+            VIR_TEST_VERBOSE("\n%s: node set mismatch for '%s'", path, xpath);
+            return -1;
+        }
+        break;
+    }
+
+    case XPATH_STRING: {
+        g_autofree char *str = virXPathString(xpath, ctxt);
+        const char *expect = (const char *) obj->stringval;
+
+        *elapsed += g_get_monotonic_time() - start;
+
+        if (expect && !*expect)
+            expect = NULL;
+
+        if (STRNEQ_NULLABLE(str, expect)) {
+            VIR_TEST_VERBOSE("\n%s: expected '%s' got '%s' for '%s'",
+                             path, NULLSTR(expect), NULLSTR(str), xpath);
+            return -1;
+        }
+        break;
+    }
+
+    case XPATH_BOOLEAN: {
+        int val = virXPathBoolean(xpath, ctxt);
+
+        *elapsed += g_get_monotonic_time() - start;
+
+        if (val != obj->boolval) {
+            VIR_TEST_VERBOSE("\n%s: boolean mismatch for '%s'", path, xpath);
+            return -1;
+        }
+        break;
+    }
+
+    case XPATH_NUMBER:
+        /* Parsers read counts as integers */
+        if (STRPREFIX(xpath, "count(")) {
+            long long val;
+            int rc = virXPathLongLong(xpath, ctxt, &val);
+
+            *elapsed += g_get_monotonic_time() - start;
+
+            if (rc < 0 || val != obj->floatval) {
+                VIR_TEST_VERBOSE("\n%s: count mismatch for '%s'", path, xpath);
+                return -1;
+            }
+        } else {
+            double val;
+            int rc = virXPathNumber(xpath, ctxt, &val);
+
+            *elapsed += g_get_monotonic_time() - start;
+
+            if (rc < 0 || val != obj->floatval) {
+                VIR_TEST_VERBOSE("\n%s: number mismatch for '%s'", path, xpath);
+                return -1;
+            }
+        }
+        break;
+
+    default:
+        VIR_TEST_VERBOSE("\n%s: unexpected result type for '%s'", path, xpath);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testXPathCompare(const char *path,
+                 const char *xpath,
+                 xmlXPathContextPtr ctxt)
+{
+    g_autoptr(xmlXPathObject) obj = NULL;
+    gint64 elapsed = 0;
+
+    if (!(obj = xmlXPathEval(BAD_CAST xpath, ctxt))) {
+        VIR_TEST_VERBOSE("\n%s: failed to evaluate '%s'", path, xpath);
+        return -1;
+    }
+
+    return testXPathCheck(path, xpath, ctxt, obj, &elapsed);
+}
+
+
+static int
+testXPathFile(const char *path)
+{
+    g_autoptr(xmlDoc) xml = NULL;
+    g_autoptr(xmlXPathContext) ctxt = NULL;
+    g_autofree xmlNodePtr *devices = NULL;
+    xmlNodePtr root;
+    int ndevices;
+    size_t i;
+    size_t j;
+
+    /* Some of the files are deliberately broken */
+    if (!(xml = virXMLParseFileCtxt(path, &ctxt))) {
+        virResetLastError();
+        return 0;
+    }
+
+    root = ctxt->node;
+
+    for (i = 0; i < G_N_ELEMENTS(domainExprs); i++) {
+        if (testXPathCompare(path, domainExprs[i], ctxt) < 0)
+            return -1;
+    }
+
+    if ((ndevices = virXPathNodeSet("./devices/*", ctxt, &devices)) < 0)
+        return -1;
+
+    for (i = 0; i < (size_t) ndevices; i++) {
+        ctxt->node = devices[i];
+
+        for (j = 0; j < G_N_ELEMENTS(deviceExprs); j++) {
+            if (testXPathCompare(path, deviceExprs[j], ctxt) < 0)
+                return -1;
+        }
+    }
+
+    ctxt->node = root;
+    return 0;
+}
+
+
+/* Evaluate the expressions over all domain XMLs in qemuxml2argvdata */
+static int
+testXPathDir(const void *opaque)
+{
+    const char *dir_path = opaque;
+    g_autoptr(DIR) dir = NULL;
+    struct dirent *ent;
+    int ret = 0;
+    int rc;
+
+    if (virDirOpen(&dir, dir_path) < 0) {
+        virTestPropagateLibvirtError();
+        return -1;
+    }
+
+    while ((rc = virDirRead(dir, &ent, dir_path)) > 0) {
+        g_autofree char *xml_path = NULL;
+
+        if (!virStringHasSuffix(ent->d_name, ".xml") ||
+            ent->d_name[0] == '.')
+            continue;
+
+        xml_path = g_strdup_printf("%s/%s", dir_path, ent->d_name);
+
+        if (testXPathFile(xml_path) < 0)
+            ret = -1;
+    }
+
+    if (rc < 0) {
+        virTestPropagateLibvirtError();
+        return -1;
+    }
+
+    return ret;
+}
+
+
+static int
+testXPathBenchFile(const char *path,
+                   gint64 *fast,
+                   gint64 *slow)
+{
+    g_autoptr(xmlDoc) xml = NULL;
+    g_autoptr(xmlXPathContext) ctxt = NULL;
+    size_t i;
+
+    if (!(xml = virXMLParseFileCtxt(path, &ctxt))) {
+        virResetLastError();
+        return 0;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(domainExprs); i++) {
+        g_autoptr(xmlXPathObject) obj = NULL;
+        gint64 start = g_get_monotonic_time();
+
+        obj = xmlXPathEval(BAD_CAST domainExprs[i], ctxt);
+        *slow += g_get_monotonic_time() - start;
+
+        if (!obj) {
+            VIR_TEST_VERBOSE("\n%s: failed to evaluate '%s'",
+                             path, domainExprs[i]);
+            return -1;
+        }
+
+        if (testXPathCheck(path, domainExprs[i], ctxt, obj, fast) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * With VIR_TEST_DEBUG set, print the time spent by the virXPath helpers
+ * and by plain libxml2 evaluation over qemuxml2argvdata, so the domain
+ * XMLs there double as a parser benchmark.
+ */
+static int
+testXPathBench(const void *opaque)
+{
+    const char *dir_path = opaque;
+    g_autoptr(DIR) dir = NULL;
+    struct dirent *ent;
+    gint64 fast = 0;
+    gint64 slow = 0;
+    int rc;
+
+    if (!virTestGetDebug())
+        return EXIT_AM_SKIP;
+
+    if (virDirOpen(&dir, dir_path) < 0) {
+        virTestPropagateLibvirtError();
+        return -1;
+    }
+
+    while ((rc = virDirRead(dir, &ent, dir_path)) > 0) {
+        g_autofree char *xml_path = NULL;
+
+        if (!virStringHasSuffix(ent->d_name, ".xml") ||
+            ent->d_name[0] == '.')
+            continue;
+
+        xml_path = g_strdup_printf("%s/%s", dir_path, ent->d_name);
+
+        if (testXPathBenchFile(xml_path, &fast, &slow) < 0)
+            return -1;
+    }
+
+    if (rc < 0)
+        return -1;
+
+    VIR_TEST_DEBUG("virXPath helpers: %lld us, libxml2: %lld us",
+                   (long long) fast, (long long) slow);
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    const char *dir_path = abs_srcdir "/qemuxml2argvdata";
+
+    if (virTestRun("XPath shortcuts", testXPathDir, dir_path) < 0)
+        ret = -1;
+
+    if (virTestRun("XPath benchmark", testXPathBench, dir_path) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
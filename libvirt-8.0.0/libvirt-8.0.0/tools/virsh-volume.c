@@ -992,6 +992,14 @@ static const vshCmdOptDef opts_vol_info[] = {
      .type = VSH_OT_BOOL,
      .help = N_("return the physical size of the volume in allocation field")
     },
+    {.name = "wipe-progress",
+     .type = VSH_OT_BOOL,
+     .help = N_("return the progress of a running wipe of the volume")
+    },
+    {.name = "cancel-wipe",
+     .type = VSH_OT_BOOL,
+     .help = N_("cancel a running wipe of the volume")
+    },
     {.name = NULL}
 };
 
@@ -1002,9 +1010,14 @@ cmdVolInfo(vshControl *ctl, const vshCmd *cmd)
     g_autoptr(virshStorageVol) vol = NULL;
     bool bytes = vshCommandOptBool(cmd, "bytes");
     bool physical = vshCommandOptBool(cmd, "physical");
+    bool wipe = vshCommandOptBool(cmd, "wipe-progress");
+    bool cancel = vshCommandOptBool(cmd, "cancel-wipe");
     int rc;
     unsigned int flags = 0;
 
+    VSH_EXCLUSIVE_OPTIONS_VAR(physical, wipe);
+    VSH_EXCLUSIVE_OPTIONS_VAR(physical, cancel);
+
     if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", NULL)))
         return false;
 
@@ -1012,6 +1025,10 @@ cmdVolInfo(vshControl *ctl, const vshCmd *cmd)
 
     if (physical)
         flags |= VIR_STORAGE_VOL_GET_PHYSICAL;
+    if (wipe)
+        flags |= VIR_STORAGE_VOL_GET_WIPE_PROGRESS;
+    if (cancel)
+        flags |= VIR_STORAGE_VOL_GET_WIPE_CANCEL;
 
     if (flags)
         rc = virStorageVolGetInfoFlags(vol, &info, flags);
@@ -1025,6 +1042,23 @@ cmdVolInfo(vshControl *ctl, const vshCmd *cmd)
     vshPrint(ctl, "%-15s %s\n", _("Type:"),
              virshVolumeTypeToString(info.type));
 
+    if (wipe || cancel) {
+        if (bytes) {
+            vshPrint(ctl, "%-15s %llu %s\n", _("Wipe total:"), info.capacity, _("bytes"));
+            vshPrint(ctl, "%-15s %llu %s\n", _("Wiped:"), info.allocation, _("bytes"));
+        } else {
+            const char *unit;
+            double val = vshPrettyCapacity(info.capacity, &unit);
+
+            vshPrint(ctl, "%-15s %2.2lf %s\n", _("Wipe total:"), val, unit);
+            val = vshPrettyCapacity(info.allocation, &unit);
+            vshPrint(ctl, "%-15s %2.2lf %s\n", _("Wiped:"), val, unit);
+        }
+        if (cancel)
+            vshPrintExtra(ctl, "%s\n", _("Wipe cancellation requested"));
+        return true;
+    }
+
     if (bytes) {
         vshPrint(ctl, "%-15s %llu %s\n", _("Capacity:"), info.capacity, _("bytes"));
 
@@ -1107,6 +1107,91 @@ cmdDaemonLogOutputs(vshControl *ctl, const vshCmd *cmd)
     return true;
 }
 
+/* ------------------------
+ * Command domain-log-stats
+ * ------------------------
+ */
+static const vshCmdInfo info_domain_log_stats[] = {
+    {.name = "help",
+     .data = N_("show the throughput of domain log files")
+    },
+    {.name = "desc",
+     .data = N_("Show the number of bytes written to and dropped from each "
+                "domain log file handled by the daemon, along with the "
+                "current write rate.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDomainLogStats(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int count = 0;
+    size_t i;
+    vshAdmControl *priv = ctl->privData;
+    g_autoptr(vshTable) table = NULL;
+
+    if (virAdmConnectGetDomainLogStats(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get domain log statistics"));
+        goto cleanup;
+    }
+
+    if (virTypedParamsGetUInt(params, nparams, "log.count", &count) < 0)
+        goto cleanup;
+
+    table = vshTableNew(_("Domain"), _("Written"), _("Dropped"),
+                        _("Rate (B/s)"), _("Path"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < count; i++) {
+        const char *domname = NULL;
+        const char *path = NULL;
+        unsigned long long written = 0;
+        unsigned long long dropped = 0;
+        unsigned long long rate = 0;
+        g_autofree char *field = NULL;
+        g_autofree char *writtenStr = NULL;
+        g_autofree char *droppedStr = NULL;
+        g_autofree char *rateStr = NULL;
+
+#define GET_LOG_STAT(getter, name, var) \
+        do { \
+            g_free(field); \
+            field = g_strdup_printf("log.%zu." name, i); \
+            if (getter(params, nparams, field, var) < 0) \
+                goto cleanup; \
+        } while (0)
+
+        GET_LOG_STAT(virTypedParamsGetString, "domain.name", &domname);
+        GET_LOG_STAT(virTypedParamsGetString, "path", &path);
+        GET_LOG_STAT(virTypedParamsGetULLong, "written", &written);
+        GET_LOG_STAT(virTypedParamsGetULLong, "dropped", &dropped);
+        GET_LOG_STAT(virTypedParamsGetULLong, "rate", &rate);
+
+#undef GET_LOG_STAT
+
+        writtenStr = g_strdup_printf("%llu", written);
+        droppedStr = g_strdup_printf("%llu", dropped);
+        rateStr = g_strdup_printf("%llu", rate);
+
+        if (vshTableRowAppend(table, NULLSTR(domname), writtenStr, droppedStr,
+                              rateStr, NULLSTR(path), NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
 static void *
 vshAdmConnectionHandler(vshControl *ctl)
 {
@@ -1447,6 +1532,12 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "domain-log-stats",
+     .handler = cmdDomainLogStats,
+     .opts = NULL,
+     .info = info_domain_log_stats,
+     .flags = 0
+    },
     {.name = NULL}
 };
 
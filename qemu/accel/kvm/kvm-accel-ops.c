@@ -23,6 +23,7 @@
 #include "qapi/error.h"
 
 #include "kvm-cpus.h"
+#include "trace.h"
 
 static void *kvm_vcpu_thread_fn(void *arg)
 {
@@ -38,11 +39,21 @@ static void *kvm_vcpu_thread_fn(void *arg)
     current_cpu = cpu;
 
     r = kvm_init_vcpu(cpu, &error_fatal);
-    kvm_init_cpu_signals(cpu);
 
     /* signal CPU creation */
     cpu_thread_signal_created(cpu);
+
+    /*
+     * The rest of the setup only concerns this thread, so let the main
+     * thread go on with realizing the next vCPU in the meantime.  Signals
+     * are all blocked until kvm_init_cpu_signals() unblocks them, so a
+     * kick that comes in early stays pending.
+     */
+    qemu_mutex_unlock_iothread();
+    kvm_init_cpu_signals(cpu);
     qemu_guest_random_seed_thread_part2(cpu->random_seed);
+    trace_kvm_vcpu_thread_ready(cpu->cpu_index);
+    qemu_mutex_lock_iothread();
 
     do {
         if (cpu_can_run(cpu)) {
@@ -81,6 +92,8 @@ static void kvm_accel_ops_class_init(ObjectClass *oc, void *data)
     ops->create_vcpu_thread = kvm_start_vcpu_thread;
     ops->synchronize_post_reset = kvm_cpu_synchronize_post_reset;
     ops->synchronize_post_init = kvm_cpu_synchronize_post_init;
+    ops->synchronize_all_post_reset = kvm_cpu_synchronize_all_post_reset;
+    ops->synchronize_all_post_init = kvm_cpu_synchronize_all_post_init;
     ops->synchronize_state = kvm_cpu_synchronize_state;
     ops->synchronize_pre_loadvm = kvm_cpu_synchronize_pre_loadvm;
 }
@@ -42,6 +42,7 @@
 #include "qapi/qapi-types-common.h"
 #include "qapi/qapi-visit-common.h"
 #include "sysemu/reset.h"
+#include "sysemu/sysemu.h"
 #include "qemu/guest-random.h"
 #include "sysemu/hw_accel.h"
 #include "kvm-cpus.h"
@@ -135,10 +136,28 @@ struct KVMState
     int nr_allocated_irq_routes;
     unsigned long *used_gsi_bitmap;
     unsigned int gsi_count;
+    /*
+     * Routing entries are looked up by GSI through these two arrays:
+     * irq_route_head[gsi] is the index of the first entry for @gsi in
+     * irq_routes->entries[], irq_route_next[n] the index of the next
+     * entry with the same GSI as entries[n]; -1 terminates both.
+     */
+    int *irq_route_head;
+    int *irq_route_next;
+    /* Nesting level of kvm_irqchip_begin_route_changes() */
+    int irq_routes_txn_depth;
+    /* irq_routes differs from what KVM was last given */
+    bool irq_routes_dirty;
+    uint64_t irq_routes_commits;
+    uint64_t irq_routes_commits_skipped;
+    int64_t irq_routes_commit_ns;
+    Notifier irq_routes_summary;
     QTAILQ_HEAD(, KVMMSIRoute) msi_hashtab[KVM_MSI_HASHTAB_SIZE];
 #endif
     KVMMemoryListener memory_listener;
     QLIST_HEAD(, KVMParkedVcpu) kvm_parked_vcpus;
+    /* KVM_GET_VCPU_MMAP_SIZE, queried when the first vCPU is created */
+    long vcpu_mmap_size;
 
     /* For "info mtree -f" to tell if an MR is registered in KVM */
     int nr_as;
@@ -387,7 +406,6 @@ err:
 static int do_kvm_destroy_vcpu(CPUState *cpu)
 {
     KVMState *s = kvm_state;
-    long mmap_size;
     struct KVMParkedVcpu *vcpu = NULL;
     int ret = 0;
 
@@ -398,14 +416,7 @@ static int do_kvm_destroy_vcpu(CPUState *cpu)
         goto err;
     }
 
-    mmap_size = kvm_ioctl(s, KVM_GET_VCPU_MMAP_SIZE, 0);
-    if (mmap_size < 0) {
-        ret = mmap_size;
-        DPRINTF("KVM_GET_VCPU_MMAP_SIZE failed\n");
-        goto err;
-    }
-
-    ret = munmap(cpu->kvm_run, mmap_size);
+    ret = munmap(cpu->kvm_run, s->vcpu_mmap_size);
     if (ret < 0) {
         goto err;
     }
@@ -455,6 +466,7 @@ int kvm_init_vcpu(CPUState *cpu, Error **errp)
 {
     KVMState *s = kvm_state;
     long mmap_size;
+    int64_t start_ns = get_clock();
     int ret;
 
     trace_kvm_init_vcpu(cpu->cpu_index, kvm_arch_vcpu_id(cpu));
@@ -471,16 +483,19 @@ int kvm_init_vcpu(CPUState *cpu, Error **errp)
     cpu->vcpu_dirty = true;
     cpu->dirty_pages = 0;
 
-    mmap_size = kvm_ioctl(s, KVM_GET_VCPU_MMAP_SIZE, 0);
-    if (mmap_size < 0) {
-        ret = mmap_size;
-        error_setg_errno(errp, -mmap_size,
-                         "kvm_init_vcpu: KVM_GET_VCPU_MMAP_SIZE failed");
-        goto err;
+    if (!s->vcpu_mmap_size) {
+        mmap_size = kvm_ioctl(s, KVM_GET_VCPU_MMAP_SIZE, 0);
+        if (mmap_size < 0) {
+            ret = mmap_size;
+            error_setg_errno(errp, -mmap_size,
+                             "kvm_init_vcpu: KVM_GET_VCPU_MMAP_SIZE failed");
+            goto err;
+        }
+        s->vcpu_mmap_size = mmap_size;
     }
 
-    cpu->kvm_run = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED,
-                        cpu->kvm_fd, 0);
+    cpu->kvm_run = mmap(NULL, s->vcpu_mmap_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, cpu->kvm_fd, 0);
     if (cpu->kvm_run == MAP_FAILED) {
         ret = -errno;
         error_setg_errno(errp, ret,
@@ -512,7 +527,9 @@ int kvm_init_vcpu(CPUState *cpu, Error **errp)
         error_setg_errno(errp, -ret,
                          "kvm_init_vcpu: kvm_arch_init_vcpu failed (%lu)",
                          kvm_arch_vcpu_id(cpu));
+        goto err;
     }
+    trace_kvm_init_vcpu_done(cpu->cpu_index, get_clock() - start_ns);
 err:
     return ret;
 }
@@ -616,13 +633,123 @@ static void kvm_log_stop(MemoryListener *listener,
     }
 }
 
+/*
+ * Slots with at least twice this many pages have their dirty bitmap
+ * merged into the RAMBlock bitmaps by several threads.
+ */
+#define KVM_DIRTY_SYNC_MIN_PAGES_PER_THREAD  (1ULL << 18)
+#define KVM_DIRTY_SYNC_MAX_THREADS           8
+
+typedef struct KVMDirtySyncWorker {
+    QemuThread thread;
+    QemuSemaphore sem;
+    unsigned long *bmap;
+    ram_addr_t start;
+    ram_addr_t pages;
+    uint64_t dirty_pages;
+} KVMDirtySyncWorker;
+
+/*
+ * The workers are started on first use and then kept around, waiting on
+ * their semaphore for the next sync.  All syncs happen under the slots
+ * lock, so there is only ever one user of the pool.
+ */
+static KVMDirtySyncWorker kvm_dirty_sync_workers[KVM_DIRTY_SYNC_MAX_THREADS];
+static int kvm_dirty_sync_nr_workers;
+static QemuSemaphore kvm_dirty_sync_done;
+
+static void *kvm_dirty_sync_worker(void *opaque)
+{
+    KVMDirtySyncWorker *w = opaque;
+
+    rcu_register_thread();
+    for (;;) {
+        qemu_sem_wait(&w->sem);
+        cpu_physical_memory_set_dirty_lebitmap_count(w->bmap, w->start,
+                                                     w->pages,
+                                                     &w->dirty_pages);
+        qemu_sem_post(&kvm_dirty_sync_done);
+    }
+    return NULL;
+}
+
+static int kvm_dirty_sync_nr_threads(ram_addr_t pages)
+{
+    static int max_threads;
+
+    if (!max_threads) {
+        max_threads = MAX(MIN(sysconf(_SC_NPROCESSORS_ONLN),
+                              KVM_DIRTY_SYNC_MAX_THREADS), 1);
+    }
+    return MIN(pages / KVM_DIRTY_SYNC_MIN_PAGES_PER_THREAD, max_threads);
+}
+
+static void kvm_dirty_sync_start_workers(int nr_threads)
+{
+    if (!kvm_dirty_sync_nr_workers) {
+        qemu_sem_init(&kvm_dirty_sync_done, 0);
+        /* Slot 0 is always merged by the calling thread */
+        kvm_dirty_sync_nr_workers = 1;
+    }
+
+    while (kvm_dirty_sync_nr_workers < nr_threads) {
+        KVMDirtySyncWorker *w =
+            &kvm_dirty_sync_workers[kvm_dirty_sync_nr_workers++];
+
+        qemu_sem_init(&w->sem, 0);
+        qemu_thread_create(&w->thread, "kvm-dirty-sync",
+                           kvm_dirty_sync_worker, w, QEMU_THREAD_DETACHED);
+    }
+}
+
 /* get kvm's dirty pages bitmap and update qemu's */
 static void kvm_slot_sync_dirty_pages(KVMSlot *slot)
 {
+    KVMDirtySyncWorker *workers = kvm_dirty_sync_workers;
     ram_addr_t start = slot->ram_start_offset;
     ram_addr_t pages = slot->memory_size / qemu_real_host_page_size;
+    ram_addr_t share, first;
+    int nr_threads, i;
+
+    nr_threads = kvm_dirty_sync_nr_threads(pages);
+    if (nr_threads < 2) {
+        cpu_physical_memory_set_dirty_lebitmap(slot->dirty_bmap, start, pages);
+        return;
+    }
+
+    kvm_dirty_sync_start_workers(nr_threads);
 
-    cpu_physical_memory_set_dirty_lebitmap(slot->dirty_bmap, start, pages);
+    /*
+     * Split the bitmap at word boundaries; the calling thread merges the
+     * first share itself while the others run.  Each worker counts its
+     * dirty pages separately, total_dirty_pages is only updated here,
+     * under the BQL.
+     */
+    share = ROUND_UP(DIV_ROUND_UP(pages, nr_threads), BITS_PER_LONG);
+    for (i = 0, first = 0; i < nr_threads && first < pages;
+         i++, first += share) {
+        KVMDirtySyncWorker *w = &workers[i];
+
+        w->bmap = slot->dirty_bmap + BIT_WORD(first);
+        w->start = start + first * qemu_real_host_page_size;
+        w->pages = MIN(share, pages - first);
+        w->dirty_pages = 0;
+        if (i > 0) {
+            qemu_sem_post(&w->sem);
+        }
+    }
+    nr_threads = i;
+
+    cpu_physical_memory_set_dirty_lebitmap_count(workers[0].bmap,
+                                                 workers[0].start,
+                                                 workers[0].pages,
+                                                 &workers[0].dirty_pages);
+    for (i = 1; i < nr_threads; i++) {
+        qemu_sem_wait(&kvm_dirty_sync_done);
+    }
+    for (i = 0; i < nr_threads; i++) {
+        total_dirty_pages += workers[i].dirty_pages;
+    }
 }
 
 static void kvm_slot_reset_dirty_pages(KVMSlot *slot)
@@ -896,7 +1023,7 @@ static int kvm_log_clear_one_slot(KVMSlot *mem, int as_id, uint64_t start,
                                   uint64_t size)
 {
     KVMState *s = kvm_state;
-    uint64_t end, bmap_start, start_delta, bmap_npages;
+    uint64_t end, bmap_start, start_delta, bmap_npages, clear_end;
     struct kvm_clear_dirty_log d;
     unsigned long *bmap_clear = NULL, psize = qemu_real_host_page_size;
     int ret;
@@ -949,6 +1076,21 @@ static int kvm_log_clear_one_slot(KVMSlot *mem, int as_id, uint64_t start,
     assert(bmap_start % BITS_PER_LONG == 0);
     /* We should never do log_clear before log_sync */
     assert(mem->dirty_bmap);
+
+    /*
+     * Only bits that are set in the cached bitmap are cleared in the
+     * kernel, so there is nothing to do if the last sync reported no
+     * dirty page in the range.  Since migration clears the log lazily,
+     * chunk by chunk as it sends pages, this skips the ioctl for every
+     * chunk that the guest did not touch.
+     */
+    clear_end = bmap_start + start_delta + size / psize;
+    if (find_next_bit(mem->dirty_bmap, clear_end, bmap_start + start_delta) >=
+        clear_end) {
+        trace_kvm_clear_dirty_log_skip(mem->slot | (as_id << 16),
+                                       bmap_start + start_delta, size / psize);
+        return 0;
+    }
     if (start_delta || bmap_npages - size / psize) {
         /* Slow path - we need to manipulate a temp bitmap */
         bmap_clear = bitmap_new(bmap_npages);
@@ -1713,6 +1855,15 @@ static void clear_gsi(KVMState *s, unsigned int gsi)
     clear_bit(gsi, s->used_gsi_bitmap);
 }
 
+static void kvm_irq_routing_summary(Notifier *n, void *opaque)
+{
+    KVMState *s = container_of(n, KVMState, irq_routes_summary);
+
+    trace_kvm_irqchip_routing_summary(s->irq_routes->nr, s->irq_routes_commits,
+                                      s->irq_routes_commit_ns,
+                                      s->irq_routes_commits_skipped);
+}
+
 void kvm_init_irq_routing(KVMState *s)
 {
     int gsi_count, i;
@@ -1722,10 +1873,19 @@ void kvm_init_irq_routing(KVMState *s)
         /* Round up so we can search ints using ffs */
         s->used_gsi_bitmap = bitmap_new(gsi_count);
         s->gsi_count = gsi_count;
+        s->irq_route_head = g_new(int, gsi_count);
+        for (i = 0; i < gsi_count; i++) {
+            s->irq_route_head[i] = -1;
+        }
     }
 
     s->irq_routes = g_malloc0(sizeof(*s->irq_routes));
     s->nr_allocated_irq_routes = 0;
+    /* Make sure the first commit replaces KVM's default routing */
+    s->irq_routes_dirty = true;
+
+    s->irq_routes_summary.notify = kvm_irq_routing_summary;
+    qemu_add_machine_init_done_notifier(&s->irq_routes_summary);
 
     if (!kvm_direct_msi_allowed) {
         for (i = 0; i < KVM_MSI_HASHTAB_SIZE; i++) {
@@ -1736,10 +1896,29 @@ void kvm_init_irq_routing(KVMState *s)
     kvm_arch_init_irq_routing(s);
 }
 
-void kvm_irqchip_commit_routes(KVMState *s)
+static void kvm_irqchip_push_routes(KVMState *s)
 {
+    int64_t start_ns;
     int ret;
 
+    if (!s->irq_routes_dirty) {
+        s->irq_routes_commits_skipped++;
+        return;
+    }
+
+    s->irq_routes->flags = 0;
+    start_ns = get_clock();
+    ret = kvm_vm_ioctl(s, KVM_SET_GSI_ROUTING, s->irq_routes);
+    assert(ret == 0);
+    s->irq_routes_dirty = false;
+    s->irq_routes_commits++;
+    s->irq_routes_commit_ns += get_clock() - start_ns;
+    trace_kvm_irqchip_commit_routes(s->irq_routes->nr, s->irq_routes_commits,
+                                    s->irq_routes_commit_ns);
+}
+
+void kvm_irqchip_commit_routes(KVMState *s)
+{
     if (kvm_gsi_direct_mapping()) {
         return;
     }
@@ -1748,10 +1927,31 @@ void kvm_irqchip_commit_routes(KVMState *s)
         return;
     }
 
-    s->irq_routes->flags = 0;
-    trace_kvm_irqchip_commit_routes();
-    ret = kvm_vm_ioctl(s, KVM_SET_GSI_ROUTING, s->irq_routes);
-    assert(ret == 0);
+    if (s->irq_routes_txn_depth) {
+        s->irq_routes_commits_skipped++;
+        return;
+    }
+
+    kvm_irqchip_push_routes(s);
+}
+
+void kvm_irqchip_begin_route_changes(KVMState *s)
+{
+    if (!kvm_gsi_routing_enabled()) {
+        return;
+    }
+    s->irq_routes_txn_depth++;
+}
+
+void kvm_irqchip_commit_route_changes(KVMState *s)
+{
+    if (!kvm_gsi_routing_enabled()) {
+        return;
+    }
+    assert(s->irq_routes_txn_depth > 0);
+    if (--s->irq_routes_txn_depth == 0) {
+        kvm_irqchip_commit_routes(s);
+    }
 }
 
 static void kvm_add_routing_entry(KVMState *s,
@@ -1760,6 +1960,8 @@ static void kvm_add_routing_entry(KVMState *s,
     struct kvm_irq_routing_entry *new;
     int n, size;
 
+    assert(entry->gsi < s->gsi_count);
+
     if (s->irq_routes->nr == s->nr_allocated_irq_routes) {
         n = s->nr_allocated_irq_routes * 2;
         if (n < 64) {
@@ -1768,38 +1970,71 @@ static void kvm_add_routing_entry(KVMState *s,
         size = sizeof(struct kvm_irq_routing);
         size += n * sizeof(*new);
         s->irq_routes = g_realloc(s->irq_routes, size);
+        s->irq_route_next = g_renew(int, s->irq_route_next, n);
         s->nr_allocated_irq_routes = n;
     }
     n = s->irq_routes->nr++;
     new = &s->irq_routes->entries[n];
 
     *new = *entry;
+    s->irq_route_next[n] = s->irq_route_head[entry->gsi];
+    s->irq_route_head[entry->gsi] = n;
+    s->irq_routes_dirty = true;
 
     set_gsi(s, entry->gsi);
 }
 
+/* Return the link in the GSI index that points to entries[@n] */
+static int *kvm_routing_entry_link(KVMState *s, int n)
+{
+    int *link = &s->irq_route_head[s->irq_routes->entries[n].gsi];
+
+    while (*link != n) {
+        assert(*link >= 0);
+        link = &s->irq_route_next[*link];
+    }
+    return link;
+}
+
+/* Remove entries[@n] by moving the last entry into its place */
+static void kvm_remove_routing_entry(KVMState *s, int n)
+{
+    int last = s->irq_routes->nr - 1;
+
+    *kvm_routing_entry_link(s, n) = s->irq_route_next[n];
+    if (n != last) {
+        *kvm_routing_entry_link(s, last) = n;
+        s->irq_routes->entries[n] = s->irq_routes->entries[last];
+        s->irq_route_next[n] = s->irq_route_next[last];
+    }
+    s->irq_routes->nr--;
+    s->irq_routes_dirty = true;
+}
+
 static int kvm_update_routing_entry(KVMState *s,
                                     struct kvm_irq_routing_entry *new_entry)
 {
     struct kvm_irq_routing_entry *entry;
     int n;
 
-    for (n = 0; n < s->irq_routes->nr; n++) {
-        entry = &s->irq_routes->entries[n];
-        if (entry->gsi != new_entry->gsi) {
-            continue;
-        }
-
-        if(!memcmp(entry, new_entry, sizeof *entry)) {
-            return 0;
-        }
+    if (new_entry->gsi >= s->gsi_count) {
+        return -ESRCH;
+    }
 
-        *entry = *new_entry;
+    n = s->irq_route_head[new_entry->gsi];
+    if (n < 0) {
+        return -ESRCH;
+    }
 
+    entry = &s->irq_routes->entries[n];
+    if (!memcmp(entry, new_entry, sizeof *entry)) {
         return 0;
     }
 
-    return -ESRCH;
+    *entry = *new_entry;
+    s->irq_routes_dirty = true;
+
+    return 0;
 }
 
 void kvm_irqchip_add_irq_route(KVMState *s, int irq, int irqchip, int pin)
@@ -1818,19 +2053,12 @@ void kvm_irqchip_add_irq_route(KVMState *s, int irq, int irqchip, int pin)
 
 void kvm_irqchip_release_virq(KVMState *s, int virq)
 {
-    struct kvm_irq_routing_entry *e;
-    int i;
-
     if (kvm_gsi_direct_mapping()) {
         return;
     }
 
-    for (i = 0; i < s->irq_routes->nr; i++) {
-        e = &s->irq_routes->entries[i];
-        if (e->gsi == virq) {
-            s->irq_routes->nr--;
-            *e = s->irq_routes->entries[s->irq_routes->nr];
-        }
+    while (s->irq_route_head[virq] >= 0) {
+        kvm_remove_routing_entry(s, s->irq_route_head[virq]);
     }
     clear_gsi(s, virq);
     kvm_arch_release_virq_post(virq);
@@ -1944,7 +2172,8 @@ int kvm_irqchip_send_msi(KVMState *s, MSIMessage msg)
         route->kroute.u.msi.data = le32_to_cpu(msg.data);
 
         kvm_add_routing_entry(s, &route->kroute);
-        kvm_irqchip_commit_routes(s);
+        /* The route is used right away, so it can't wait for a batch */
+        kvm_irqchip_push_routes(s);
 
         QTAILQ_INSERT_TAIL(&s->msi_hashtab[kvm_hash_msi(msg.data)], route,
                            entry);
@@ -2151,6 +2380,14 @@ void kvm_irqchip_release_virq(KVMState *s, int virq)
 {
 }
 
+void kvm_irqchip_begin_route_changes(KVMState *s)
+{
+}
+
+void kvm_irqchip_commit_route_changes(KVMState *s)
+{
+}
+
 int kvm_irqchip_send_msi(KVMState *s, MSIMessage msg)
 {
     abort();
@@ -2746,6 +2983,82 @@ void kvm_cpu_synchronize_post_init(CPUState *cpu)
     run_on_cpu(cpu, do_kvm_cpu_synchronize_post_init, RUN_ON_CPU_NULL);
 }
 
+typedef struct KVMPutAllRegisters {
+    int level;
+    int pending;
+    QemuCond done;
+} KVMPutAllRegisters;
+
+static void do_kvm_cpu_put_all_registers(CPUState *cpu, run_on_cpu_data arg)
+{
+    KVMPutAllRegisters *put = arg.host_ptr;
+
+#ifdef KVM_HAVE_UNLOCKED_PUT_REGISTERS
+    /* Let the other vCPU threads load their state at the same time */
+    qemu_mutex_unlock_iothread();
+    kvm_arch_put_registers(cpu, put->level);
+    qemu_mutex_lock_iothread();
+#else
+    kvm_arch_put_registers(cpu, put->level);
+#endif
+    cpu->vcpu_dirty = false;
+
+    if (--put->pending == 0) {
+        qemu_cond_signal(&put->done);
+    }
+}
+
+/*
+ * Load the state of all vCPUs into KVM.  Rather than asking one vCPU
+ * thread after the other, queue the work on every vCPU first and then
+ * wait for all of them, so that large guests do not pay one round trip
+ * and one series of ioctls after the other at startup and reset.
+ */
+static void kvm_cpu_put_all_registers(int level, const char *what,
+                                      void (*put_one)(CPUState *cpu))
+{
+    KVMPutAllRegisters put = { .level = level };
+    int64_t start_ns = get_clock();
+    CPUState *cpu;
+    int nr_cpus = 0;
+
+    if (current_cpu) {
+        /* A vCPU thread must not wait for its own queued work */
+        CPU_FOREACH(cpu) {
+            put_one(cpu);
+        }
+        return;
+    }
+
+    qemu_cond_init(&put.done);
+    CPU_FOREACH(cpu) {
+        put.pending++;
+        nr_cpus++;
+    }
+    CPU_FOREACH(cpu) {
+        async_run_on_cpu(cpu, do_kvm_cpu_put_all_registers,
+                         RUN_ON_CPU_HOST_PTR(&put));
+    }
+    while (put.pending) {
+        qemu_cond_wait_iothread(&put.done);
+    }
+    qemu_cond_destroy(&put.done);
+
+    trace_kvm_cpu_put_all_registers(what, nr_cpus, get_clock() - start_ns);
+}
+
+void kvm_cpu_synchronize_all_post_reset(void)
+{
+    kvm_cpu_put_all_registers(KVM_PUT_RESET_STATE, "reset",
+                              kvm_cpu_synchronize_post_reset);
+}
+
+void kvm_cpu_synchronize_all_post_init(void)
+{
+    kvm_cpu_put_all_registers(KVM_PUT_FULL_STATE, "init",
+                              kvm_cpu_synchronize_post_init);
+}
+
 static void do_kvm_cpu_synchronize_pre_loadvm(CPUState *cpu, run_on_cpu_data arg)
 {
     cpu->vcpu_dirty = true;
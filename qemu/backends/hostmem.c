@@ -15,12 +15,17 @@
 #include "hw/boards.h"
 #include "qapi/error.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "qapi/qapi-events-machine.h"
 #include "qapi/visitor.h"
 #include "qemu/config-file.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
 #include "qom/object_interfaces.h"
 #include "qemu/mmap-alloc.h"
+#include "qemu/timer.h"
 
 #ifdef CONFIG_NUMA
+#include <numa.h>
 #include <numaif.h>
 QEMU_BUILD_BUG_ON(HOST_MEM_POLICY_DEFAULT != MPOL_DEFAULT);
 QEMU_BUILD_BUG_ON(HOST_MEM_POLICY_PREFERRED != MPOL_PREFERRED);
@@ -203,6 +208,283 @@ static void host_memory_backend_set_dump(Object *obj, bool value, Error **errp)
     }
 }
 
+#if defined(CONFIG_LINUX) && !defined(MADV_POPULATE_WRITE)
+#define MADV_POPULATE_WRITE 23
+#endif
+
+#ifdef CONFIG_NUMA
+/*
+ * Fill @cpus with the CPUs in @allowed that belong to the host nodes
+ * @backend is bound to.  Return false if there are none.
+ */
+static bool host_memory_backend_get_node_cpus(HostMemoryBackend *backend,
+                                              cpu_set_t *allowed,
+                                              cpu_set_t *cpus)
+{
+    struct bitmask *node_cpus;
+    unsigned long node;
+    int cpu;
+
+    if (backend->policy == MPOL_DEFAULT || numa_available() < 0) {
+        return false;
+    }
+
+    CPU_ZERO(cpus);
+    node_cpus = numa_allocate_cpumask();
+    for (node = find_first_bit(backend->host_nodes, MAX_NODES);
+         node < MAX_NODES;
+         node = find_next_bit(backend->host_nodes, MAX_NODES, node + 1)) {
+        if (numa_node_to_cpus(node, node_cpus) < 0) {
+            continue;
+        }
+        for (cpu = 0; cpu < node_cpus->size && cpu < CPU_SETSIZE; cpu++) {
+            if (numa_bitmask_isbitset(node_cpus, cpu) &&
+                CPU_ISSET(cpu, allowed)) {
+                CPU_SET(cpu, cpus);
+            }
+        }
+    }
+    numa_free_cpumask(node_cpus);
+
+    return CPU_COUNT(cpus) > 0;
+}
+#endif
+
+#ifdef CONFIG_LINUX
+typedef struct HostMemoryBackendPopulate {
+    QemuThread thread;
+    char *addr;
+    size_t size;
+    int ret;
+} HostMemoryBackendPopulate;
+
+static void *host_memory_backend_populate_thread(void *opaque)
+{
+    HostMemoryBackendPopulate *p = opaque;
+
+    do {
+        p->ret = madvise(p->addr, p->size, MADV_POPULATE_WRITE) ? -errno : 0;
+    } while (p->ret == -EINTR);
+
+    return NULL;
+}
+#endif
+
+/*
+ * Check whether host_memory_backend_populate_range() works for @backend, by
+ * populating its first page.  MADV_POPULATE_WRITE needs Linux 5.14, and
+ * even then the kernel refuses it for VM_PFNMAP and VM_IO mappings, such as
+ * those of /dev/sgx_vepc or of device memory, which an empty range would
+ * not show.
+ */
+static bool host_memory_backend_can_populate(HostMemoryBackend *backend)
+{
+#ifdef CONFIG_LINUX
+    return !madvise(memory_region_get_ram_ptr(&backend->mr),
+                    host_memory_backend_pagesize(backend),
+                    MADV_POPULATE_WRITE);
+#else
+    return false;
+#endif
+}
+
+/*
+ * Populate the pages of @backend in [@offset, @offset + @size) with
+ * MADV_POPULATE_WRITE, split across prealloc-threads threads.  Unlike
+ * os_mem_prealloc(), this leaves the contents of the memory alone and
+ * reports a failure to allocate as an error rather than with SIGBUS.  It is
+ * therefore safe while other threads, including vCPUs, access the memory,
+ * and it doesn't need to replace the process' SIGBUS handler.
+ *
+ * Returns 0 on success, or a negative errno value with @errp set.
+ */
+static int host_memory_backend_populate_range(HostMemoryBackend *backend,
+                                              uint64_t offset, uint64_t size,
+                                              Error **errp)
+{
+#ifdef CONFIG_LINUX
+    char *ptr = memory_region_get_ram_ptr(&backend->mr) + offset;
+    size_t pagesize = host_memory_backend_pagesize(backend);
+    int nr_threads = MAX(MIN(backend->prealloc_threads, size / pagesize), 1);
+    g_autofree HostMemoryBackendPopulate *threads =
+        g_new0(HostMemoryBackendPopulate, nr_threads);
+    size_t chunk = ROUND_UP(DIV_ROUND_UP(size, nr_threads), pagesize);
+    uint64_t first;
+    int i;
+
+    for (i = 0, first = 0; i < nr_threads && first < size;
+         i++, first += chunk) {
+        threads[i].addr = ptr + first;
+        threads[i].size = MIN(chunk, size - first);
+        if (i > 0) {
+            qemu_thread_create(&threads[i].thread, "mem-populate",
+                               host_memory_backend_populate_thread,
+                               &threads[i], QEMU_THREAD_JOINABLE);
+        }
+    }
+    nr_threads = i;
+
+    host_memory_backend_populate_thread(&threads[0]);
+    for (i = 1; i < nr_threads; i++) {
+        qemu_thread_join(&threads[i].thread);
+    }
+
+    for (i = 0; i < nr_threads; i++) {
+        if (threads[i].ret < 0) {
+            error_setg_errno(errp, -threads[i].ret,
+                             "failed to preallocate pages");
+            return threads[i].ret;
+        }
+    }
+    return 0;
+#else
+    g_assert_not_reached();
+#endif
+}
+
+/*
+ * Allocate the pages of @backend in [@offset, @offset + @size), either with
+ * host_memory_backend_populate_range() or, if @populate is false, by
+ * touching them with os_mem_prealloc().  If the memory is bound to host
+ * nodes, the calling thread runs on the CPUs of those nodes meanwhile: the
+ * threads doing the work inherit that affinity, so pages are cleared by
+ * CPUs local to the memory they are allocated from.
+ *
+ * Returns 0 on success, or a negative errno value with @errp set.
+ */
+static int host_memory_backend_do_prealloc_range(HostMemoryBackend *backend,
+                                                 uint64_t offset,
+                                                 uint64_t size,
+                                                 bool populate,
+                                                 Error **errp)
+{
+    int fd = memory_region_get_fd(&backend->mr);
+    char *ptr = memory_region_get_ram_ptr(&backend->mr);
+    Error *local_err = NULL;
+    int ret = 0;
+#ifdef CONFIG_NUMA
+    cpu_set_t old_cpus, node_cpus;
+    bool pinned = false;
+
+    if (!pthread_getaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus) &&
+        host_memory_backend_get_node_cpus(backend, &old_cpus, &node_cpus)) {
+        pinned = !pthread_setaffinity_np(pthread_self(), sizeof(node_cpus),
+                                         &node_cpus);
+    }
+#endif
+
+    if (populate) {
+        ret = host_memory_backend_populate_range(backend, offset, size,
+                                                 &local_err);
+    } else {
+        os_mem_prealloc(fd, ptr + offset, size, backend->prealloc_threads,
+                        &local_err);
+        if (local_err) {
+            ret = -ENOMEM;
+        }
+    }
+
+#ifdef CONFIG_NUMA
+    if (pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus);
+    }
+#endif
+    error_propagate(errp, local_err);
+    return ret;
+}
+
+/*
+ * Preallocate a range of @backend while the guest may be running, as
+ * virtio-mem does when blocks are plugged.  os_mem_prealloc() is not safe
+ * then: it temporarily replaces the SIGBUS handler, which would swallow
+ * machine check SIGBUS meant for vCPU threads.  So this needs
+ * MADV_POPULATE_WRITE; callers must check for it upfront with
+ * host_memory_backend_can_prealloc_range().
+ */
+void host_memory_backend_prealloc_range(HostMemoryBackend *backend,
+                                        uint64_t offset, uint64_t size,
+                                        Error **errp)
+{
+#ifdef CONFIG_LINUX
+    host_memory_backend_do_prealloc_range(backend, offset, size, true, errp);
+#else
+    error_setg(errp, "preallocation at run time needs MADV_POPULATE_WRITE"
+               " support of the host (Linux 5.14)");
+#endif
+}
+
+/*
+ * The check populates the first page of @backend, so it should be done
+ * before the memory is discarded to its initial state, as virtio-mem does
+ * when it is realized.
+ */
+bool host_memory_backend_can_prealloc_range(HostMemoryBackend *backend)
+{
+    return host_memory_backend_can_populate(backend);
+}
+
+static void host_memory_backend_do_prealloc(HostMemoryBackend *backend,
+                                            Error **errp)
+{
+    uint64_t size = memory_region_size(&backend->mr);
+    Error *local_err = NULL;
+    int ret;
+
+    if (host_memory_backend_can_populate(backend)) {
+        ret = host_memory_backend_do_prealloc_range(backend, 0, size, true,
+                                                    &local_err);
+        if (ret != -EINVAL && ret != -EFAULT) {
+            error_propagate(errp, local_err);
+            return;
+        }
+        /* Part of the mapping can't be populated, touch it instead */
+        error_free(local_err);
+    }
+
+    host_memory_backend_do_prealloc_range(backend, 0, size, false, errp);
+}
+
+/*
+ * Runs concurrently with the rest of machine creation and with the guest,
+ * which may already write to guest memory (e.g. ROMs, firmware tables), so
+ * the pages must not be touched with os_mem_prealloc() here.
+ */
+static void *host_memory_backend_prealloc_thread(void *opaque)
+{
+    HostMemoryBackend *backend = opaque;
+    int64_t start_ns = get_clock();
+
+    host_memory_backend_do_prealloc_range(backend, 0,
+                                          memory_region_size(&backend->mr),
+                                          true, &backend->prealloc_err);
+    backend->prealloc_ns = get_clock() - start_ns;
+    qemu_bh_schedule(backend->prealloc_bh);
+    return NULL;
+}
+
+/*
+ * Report the end of background preallocation from the main loop.  The
+ * guest may be running already, and it relies on the memory being
+ * preallocated like with synchronous preallocation, so failing is fatal
+ * just the same.
+ */
+static void host_memory_backend_prealloc_done(void *opaque)
+{
+    HostMemoryBackend *backend = opaque;
+    g_autofree char *path = object_get_canonical_path(OBJECT(backend));
+
+    qemu_thread_join(&backend->prealloc_thread);
+    backend->prealloc_pending = false;
+
+    if (backend->prealloc_err) {
+        error_reportf_err(backend->prealloc_err, "%s: ", path);
+        exit(1);
+    }
+
+    qapi_event_send_memory_backend_prealloc_complete(
+        path, memory_region_size(&backend->mr), backend->prealloc_ns);
+}
+
 static bool host_memory_backend_get_prealloc(Object *obj, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -227,11 +509,7 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 
     if (value && !backend->prealloc) {
-        int fd = memory_region_get_fd(&backend->mr);
-        void *ptr = memory_region_get_ram_ptr(&backend->mr);
-        uint64_t sz = memory_region_size(&backend->mr);
-
-        os_mem_prealloc(fd, ptr, sz, backend->prealloc_threads, &local_err);
+        host_memory_backend_do_prealloc(backend, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -264,6 +542,25 @@ static void host_memory_backend_set_prealloc_threads(Object *obj, Visitor *v,
     backend->prealloc_threads = value;
 }
 
+static bool host_memory_backend_get_prealloc_async(Object *obj, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    return backend->prealloc_async;
+}
+
+static void host_memory_backend_set_prealloc_async(Object *obj, bool value,
+                                                   Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+    backend->prealloc_async = value;
+}
+
 static void host_memory_backend_init(Object *obj)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -391,9 +688,18 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
          * This is necessary to guarantee memory is allocated with
          * specified NUMA policy in place.
          */
-        if (backend->prealloc) {
-            os_mem_prealloc(memory_region_get_fd(&backend->mr), ptr, sz,
-                            backend->prealloc_threads, &local_err);
+        if (backend->prealloc && backend->prealloc_async &&
+            !phase_check(PHASE_MACHINE_READY) &&
+            host_memory_backend_can_populate(backend)) {
+            /* Overlap with machine creation and the start of the guest */
+            backend->prealloc_bh =
+                qemu_bh_new(host_memory_backend_prealloc_done, backend);
+            backend->prealloc_pending = true;
+            qemu_thread_create(&backend->prealloc_thread, "mem-prealloc",
+                               host_memory_backend_prealloc_thread, backend,
+                               QEMU_THREAD_JOINABLE);
+        } else if (backend->prealloc) {
+            host_memory_backend_do_prealloc(backend, &local_err);
             if (local_err) {
                 goto out;
             }
@@ -406,7 +712,9 @@ out:
 static bool
 host_memory_backend_can_be_deleted(UserCreatable *uc)
 {
-    if (host_memory_backend_is_mapped(MEMORY_BACKEND(uc))) {
+    HostMemoryBackend *backend = MEMORY_BACKEND(uc);
+
+    if (host_memory_backend_is_mapped(backend) || backend->prealloc_pending) {
         return false;
     } else {
         return true;
@@ -479,6 +787,7 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
 
     ucc->complete = host_memory_backend_memory_complete;
     ucc->can_be_deleted = host_memory_backend_can_be_deleted;
+    oc->unparent = host_memory_backend_unparent;
 
     object_class_property_add_bool(oc, "merge",
         host_memory_backend_get_merge,
@@ -501,6 +810,11 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
         NULL, NULL);
     object_class_property_set_description(oc, "prealloc-threads",
         "Number of CPU threads to use for prealloc");
+    object_class_property_add_bool(oc, "prealloc-async",
+        host_memory_backend_get_prealloc_async,
+        host_memory_backend_set_prealloc_async);
+    object_class_property_set_description(oc, "prealloc-async",
+        "Preallocate in the background, without delaying the guest start");
     object_class_property_add(oc, "size", "int",
         host_memory_backend_get_size,
         host_memory_backend_set_size,
@@ -544,6 +858,32 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
         host_memory_backend_set_use_canonical_path);
 }
 
+/*
+ * Only reached with preallocation pending when QEMU exits, as deleting the
+ * backend is refused meanwhile.  Wait for it before the memory region, a
+ * child of the backend, goes away.
+ */
+static void host_memory_backend_unparent(Object *obj)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (backend->prealloc_pending) {
+        qemu_thread_join(&backend->prealloc_thread);
+        backend->prealloc_pending = false;
+        error_free(backend->prealloc_err);
+        backend->prealloc_err = NULL;
+    }
+}
+
+static void host_memory_backend_finalize(Object *obj)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (backend->prealloc_bh) {
+        qemu_bh_delete(backend->prealloc_bh);
+    }
+}
+
 static const TypeInfo host_memory_backend_info = {
     .name = TYPE_MEMORY_BACKEND,
     .parent = TYPE_OBJECT,
@@ -553,6 +893,7 @@ static const TypeInfo host_memory_backend_info = {
     .instance_size = sizeof(HostMemoryBackend),
     .instance_init = host_memory_backend_init,
     .instance_post_init = host_memory_backend_post_init,
+    .instance_finalize = host_memory_backend_finalize,
     .interfaces = (InterfaceInfo[]) {
         { TYPE_USER_CREATABLE },
         { }
@@ -26,15 +26,21 @@
 #include "qemu/osdep.h"
 #include "block/accounting.h"
 #include "block/block_int.h"
+#include "qemu/host-utils.h"
 #include "qemu/timer.h"
 #include "sysemu/qtest.h"
 
 static QEMUClockType clock_type = QEMU_CLOCK_REALTIME;
 static const int qtest_latency_ns = NANOSECONDS_PER_SECOND / 1000;
 
-void block_acct_init(BlockAcctStats *stats)
+/*
+ * @in_flight is the request counter of the owner of @stats, read when a
+ * request starts to compute the queue depth histogram.
+ */
+void block_acct_init(BlockAcctStats *stats, const unsigned int *in_flight)
 {
     qemu_mutex_init(&stats->lock);
+    stats->in_flight = in_flight;
     if (qtest_enabled()) {
         clock_type = QEMU_CLOCK_VIRTUAL;
     }
@@ -84,6 +90,39 @@ BlockAcctTimedStats *block_acct_interval_next(BlockAcctStats *stats,
     }
 }
 
+/* Map @value to bin 0 if it is zero, else to bin floor(log2(@value)) + 1 */
+static int block_acct_log2_bin(uint64_t value, int nbins)
+{
+    if (value == 0) {
+        return 0;
+    }
+    return MIN(64 - clz64(value), nbins - 1);
+}
+
+static int block_acct_size_class(int64_t bytes)
+{
+    if (bytes <= BLOCK_ACCT_SIZE_CLASS_MIN) {
+        return 0;
+    }
+    /* Each class is four times as large as the previous one */
+    return MIN((64 - clz64(bytes - 1) - ctz32(BLOCK_ACCT_SIZE_CLASS_MIN) + 1)
+               / 2, BLOCK_ACCT_SIZE_CLASSES - 1);
+}
+
+/*
+ * Return the largest request size counted in @size_class, or 0 for the last
+ * class, which is unbounded.
+ */
+uint64_t block_acct_size_class_limit(int size_class)
+{
+    assert(size_class >= 0 && size_class < BLOCK_ACCT_SIZE_CLASSES);
+
+    if (size_class == BLOCK_ACCT_SIZE_CLASSES - 1) {
+        return 0;
+    }
+    return (uint64_t)BLOCK_ACCT_SIZE_CLASS_MIN << (2 * size_class);
+}
+
 void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
                       int64_t bytes, enum BlockAcctType type)
 {
@@ -92,6 +131,18 @@ void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
     cookie->bytes = bytes;
     cookie->start_time_ns = qemu_clock_get_ns(clock_type);
     cookie->type = type;
+
+    /*
+     * Not every cookie is finished: canceled requests and requests retried
+     * after an error are just dropped.  Counting requests here would make
+     * the depth drift, so use the owner's counter, which can't.
+     */
+    if (type != BLOCK_ACCT_NONE) {
+        unsigned depth = qatomic_read(stats->in_flight);
+        int bin = block_acct_log2_bin(depth, BLOCK_ACCT_DEPTH_BINS);
+
+        stat64_add(&stats->detailed[type].queue_depth[bin], 1);
+    }
 }
 
 /* block_latency_histogram_compare_func:
@@ -188,6 +239,7 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
     BlockAcctTimedStats *s;
     int64_t time_ns = qemu_clock_get_ns(clock_type);
     int64_t latency_ns = time_ns - cookie->start_time_ns;
+    int size_class, bin;
 
     if (qtest_enabled()) {
         latency_ns = qtest_latency_ns;
@@ -199,6 +251,10 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
         return;
     }
 
+    size_class = block_acct_size_class(cookie->bytes);
+    bin = block_acct_log2_bin(latency_ns / SCALE_US, BLOCK_ACCT_LATENCY_BINS);
+    stat64_add(&stats->detailed[cookie->type].latency[size_class][bin], 1);
+
     WITH_QEMU_LOCK_GUARD(&stats->lock) {
         if (failed) {
             stats->failed_ops[cookie->type]++;
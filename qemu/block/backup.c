@@ -44,6 +44,7 @@ typedef struct BackupBlockJob {
     uint64_t len;
     int64_t cluster_size;
     BackupPerf perf;
+    bool compress;
 
     BlockCopyState *bcs;
 
@@ -335,6 +336,21 @@ static bool backup_cancel(Job *job, bool force)
     return true;
 }
 
+static void backup_query(BlockJob *job, BlockJobInfo *info)
+{
+    BackupBlockJob *s = container_of(job, BackupBlockJob, common);
+    BackupJobInfo *backup = g_new0(BackupJobInfo, 1);
+    uint64_t data_bytes, zero_bytes;
+
+    block_copy_get_stats(s->bcs, &data_bytes, &zero_bytes);
+    backup->data_bytes = data_bytes;
+    backup->zero_bytes = zero_bytes;
+    backup->compressed = s->compress;
+
+    info->has_backup = true;
+    info->backup = backup;
+}
+
 static const BlockJobDriver backup_job_driver = {
     .job_driver = {
         .instance_size          = sizeof(BackupBlockJob),
@@ -349,6 +365,7 @@ static const BlockJobDriver backup_job_driver = {
         .cancel                 = backup_cancel,
     },
     .set_speed = backup_set_speed,
+    .query = backup_query,
 };
 
 BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
@@ -484,9 +501,11 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
     job->cluster_size = cluster_size;
     job->len = len;
     job->perf = *perf;
+    job->compress = compress;
 
     block_copy_set_copy_opts(bcs, perf->use_copy_range, compress);
     block_copy_set_progress_meter(bcs, &job->common.job.progress);
+    block_copy_set_detect_zeroes(bcs, true);
     block_copy_set_speed(bcs, speed);
 
     /* Required permissions are taken by copy-before-write filter target */
@@ -22,6 +22,8 @@
 #include "qemu/coroutine.h"
 #include "block/aio_task.h"
 #include "qemu/error-report.h"
+#include "qemu/cutils.h"
+#include "qemu/stats64.h"
 
 #define BLOCK_COPY_MAX_COPY_RANGE (16 * MiB)
 #define BLOCK_COPY_MAX_BUFFER (1 * MiB)
@@ -48,6 +50,8 @@ typedef struct BlockCopyCallState {
     int max_workers;
     int64_t max_chunk;
     bool ignore_ratelimit;
+    /* Check data read from the source for zeroes, see block_copy_do_copy() */
+    bool detect_zeroes;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
     /* Coroutine where async block-copy is running */
@@ -158,6 +162,17 @@ typedef struct BlockCopyState {
     ProgressMeter *progress;
     SharedResource *mem;
     RateLimit rate_limit;
+
+    /*
+     * Whether block_copy_async() calls check the data they read for zeroes.
+     * Synchronous block_copy() never does: for copy-before-write it runs on
+     * the guest write path.
+     */
+    bool detect_zeroes;
+
+    /* Bytes written to the target as data and as zeroes */
+    Stat64 data_bytes;
+    Stat64 zero_bytes;
 } BlockCopyState;
 
 /* Called with lock held */
@@ -492,12 +507,16 @@ static coroutine_fn int block_copy_task_run(AioTaskPool *pool,
  * @method is an in-out argument, so that copy_range can be either extended to
  * a full-size buffer or disabled if the copy_range attempt fails.  The output
  * value of @method should be used for subsequent tasks.
+ * If @wrote_zeroes is non-NULL, data read from the source is checked for
+ * zeroes; if it turns out to be all zeroes, it is written to the target as
+ * zeroes and @wrote_zeroes is set.
  * Returns 0 on success.
  */
 static int coroutine_fn block_copy_do_copy(BlockCopyState *s,
                                            int64_t offset, int64_t bytes,
                                            BlockCopyMethod *method,
-                                           bool *error_is_read)
+                                           bool *error_is_read,
+                                           bool *wrote_zeroes)
 {
     int ret;
     int64_t nbytes = MIN(offset + bytes, s->len) - offset;
@@ -556,6 +575,23 @@ static int coroutine_fn block_copy_do_copy(BlockCopyState *s,
             goto out;
         }
 
+        /*
+         * Block status doesn't know about zeroes that were written as
+         * data. Don't transfer (or compress) those either.
+         */
+        if (wrote_zeroes && buffer_is_zero(bounce_buffer, nbytes)) {
+            ret = bdrv_co_pwrite_zeroes(s->target, offset, nbytes,
+                                        s->write_flags &
+                                        ~BDRV_REQ_WRITE_COMPRESSED);
+            if (ret < 0) {
+                trace_block_copy_write_zeroes_fail(s, offset, ret);
+                *error_is_read = false;
+            } else {
+                *wrote_zeroes = true;
+            }
+            goto out;
+        }
+
         ret = bdrv_co_pwrite(s->target, offset, nbytes, bounce_buffer,
                              s->write_flags);
         if (ret < 0) {
@@ -580,10 +616,22 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     BlockCopyTask *t = container_of(task, BlockCopyTask, task);
     BlockCopyState *s = t->s;
     bool error_is_read = false;
+    bool wrote_zeroes = false;
     BlockCopyMethod method = t->method;
     int ret;
 
-    ret = block_copy_do_copy(s, t->offset, t->bytes, &method, &error_is_read);
+    ret = block_copy_do_copy(s, t->offset, t->bytes, &method, &error_is_read,
+                             t->call_state->detect_zeroes ? &wrote_zeroes :
+                             NULL);
+    if (ret >= 0) {
+        uint64_t nbytes = MIN(t->offset + t->bytes, s->len) - t->offset;
+
+        if (t->method == COPY_WRITE_ZEROES || wrote_zeroes) {
+            stat64_add(&s->zero_bytes, nbytes);
+        } else {
+            stat64_add(&s->data_bytes, nbytes);
+        }
+    }
 
     WITH_QEMU_LOCK_GUARD(&s->lock) {
         if (s->method == t->method) {
@@ -939,6 +987,7 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .detect_zeroes = s->detect_zeroes,
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -1008,6 +1057,13 @@ BdrvDirtyBitmap *block_copy_dirty_bitmap(BlockCopyState *s)
     return s->copy_bitmap;
 }
 
+void block_copy_get_stats(BlockCopyState *s, uint64_t *data_bytes,
+                          uint64_t *zero_bytes)
+{
+    *data_bytes = stat64_get(&s->data_bytes);
+    *zero_bytes = stat64_get(&s->zero_bytes);
+}
+
 int64_t block_copy_cluster_size(BlockCopyState *s)
 {
     return s->cluster_size;
@@ -1018,6 +1074,11 @@ void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip)
     qatomic_set(&s->skip_unallocated, skip);
 }
 
+void block_copy_set_detect_zeroes(BlockCopyState *s, bool detect)
+{
+    s->detect_zeroes = detect;
+}
+
 void block_copy_set_speed(BlockCopyState *s, uint64_t speed)
 {
     ratelimit_set_speed(&s->rate_limit, speed, BLOCK_COPY_SLICE_TIME);
@@ -17,19 +17,21 @@
 #include "trace.h"
 #include "block/block_int.h"
 #include "block/blockjob_int.h"
+#include "block/aio_task.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qerror.h"
 #include "qemu/ratelimit.h"
 #include "sysemu/block-backend.h"
 
-enum {
-    /*
-     * Size of data buffer for populating the image file.  This should be large
-     * enough to process multiple clusters in a single call, so that populating
-     * contiguous regions of the image is efficient.
-     */
-    COMMIT_BUFFER_SIZE = 512 * 1024, /* in bytes */
-};
+/* A copy request that failed and waits for the job's error policy */
+typedef struct CommitFailedRequest {
+    int64_t offset;
+    int64_t bytes;
+    int ret;
+    bool error_in_source;
+    bool retry;     /* policy decided to retry once the job resumes */
+    QSIMPLEQ_ENTRY(CommitFailedRequest) next;
+} CommitFailedRequest;
 
 typedef struct CommitBlockJob {
     BlockJob common;
@@ -42,8 +44,17 @@ typedef struct CommitBlockJob {
     bool base_read_only;
     bool chain_frozen;
     char *backing_file_str;
+    BlockJobPerf perf;
+    QSIMPLEQ_HEAD(, CommitFailedRequest) failed_requests;
 } CommitBlockJob;
 
+typedef struct CommitTask {
+    AioTask task;
+    CommitBlockJob *s;
+    int64_t offset;
+    int64_t bytes;
+} CommitTask;
+
 static int commit_prepare(Job *job)
 {
     CommitBlockJob *s = container_of(job, CommitBlockJob, common.job);
@@ -112,15 +123,70 @@ static void commit_clean(Job *job)
     blk_unref(s->top);
 }
 
+/*
+ * Copy one chunk from top to base.  Failures are not reported to the pool but
+ * queued for commit_run(), as the error policy has to be applied from the job
+ * coroutine.
+ */
+static coroutine_fn int commit_task_entry(AioTask *task)
+{
+    CommitTask *t = container_of(task, CommitTask, task);
+    CommitBlockJob *s = t->s;
+    QEMU_AUTO_VFREE void *buf = blk_blockalign(s->top, t->bytes);
+    CommitFailedRequest *req;
+    bool error_in_source = true;
+    int ret;
+
+    ret = blk_co_pread(s->top, t->offset, t->bytes, buf, 0);
+    if (ret >= 0) {
+        ret = blk_co_pwrite(s->base, t->offset, t->bytes, buf, 0);
+        if (ret < 0) {
+            error_in_source = false;
+        }
+    }
+
+    if (ret < 0) {
+        req = g_new(CommitFailedRequest, 1);
+        *req = (CommitFailedRequest) {
+            .offset = t->offset,
+            .bytes = t->bytes,
+            .ret = ret,
+            .error_in_source = error_in_source,
+        };
+        QSIMPLEQ_INSERT_TAIL(&s->failed_requests, req, next);
+        return 0;
+    }
+
+    job_progress_update(&s->common.job, t->bytes);
+    return 0;
+}
+
+static void coroutine_fn commit_start_task(CommitBlockJob *s,
+                                           AioTaskPool *pool,
+                                           int64_t offset, int64_t bytes)
+{
+    CommitTask *t = g_new(CommitTask, 1);
+
+    *t = (CommitTask) {
+        .task.func = commit_task_entry,
+        .s = s,
+        .offset = offset,
+        .bytes = bytes,
+    };
+
+    aio_task_pool_start_task(pool, &t->task);
+}
+
 static int coroutine_fn commit_run(Job *job, Error **errp)
 {
     CommitBlockJob *s = container_of(job, CommitBlockJob, common.job);
-    int64_t offset;
+    int64_t offset = 0;
     uint64_t delay_ns = 0;
     int ret = 0;
     int64_t n = 0; /* bytes */
-    QEMU_AUTO_VFREE void *buf = NULL;
     int64_t len, base_len;
+    AioTaskPool *pool;
+    CommitFailedRequest *req;
 
     len = blk_getlength(s->top);
     if (len < 0) {
@@ -140,57 +206,87 @@ static int coroutine_fn commit_run(Job *job, Error **errp)
         }
     }
 
-    buf = blk_blockalign(s->top, COMMIT_BUFFER_SIZE);
-
-    for (offset = 0; offset < len; offset += n) {
-        bool copy;
-        bool error_in_source = true;
+    pool = aio_task_pool_new(s->perf.max_workers);
 
+    for (;;) {
         /* Note that even when no rate limit is applied we need to yield
-         * with no pending I/O here so that bdrv_drain_all() returns.
+         * here so that bdrv_drain_all() returns.  Requests still in flight
+         * are waited for by the drain itself.
          */
         job_sleep_ns(&s->common.job, delay_ns);
+        delay_ns = 0;
         if (job_is_cancelled(&s->common.job)) {
             break;
         }
-        /* Copy if allocated above the base */
-        ret = bdrv_is_allocated_above(blk_bs(s->top), s->base_overlay, true,
-                                      offset, COMMIT_BUFFER_SIZE, &n);
-        copy = (ret > 0);
-        trace_commit_one_iteration(s, offset, n, ret);
-        if (copy) {
-            assert(n < SIZE_MAX);
-
-            ret = blk_co_pread(s->top, offset, n, buf, 0);
-            if (ret >= 0) {
-                ret = blk_co_pwrite(s->base, offset, n, buf, 0);
-                if (ret < 0) {
-                    error_in_source = false;
-                }
+
+        req = QSIMPLEQ_FIRST(&s->failed_requests);
+        if (req && !req->retry) {
+            BlockErrorAction action =
+                block_job_error_action(&s->common, s->on_error,
+                                       req->error_in_source, -req->ret);
+            if (action == BLOCK_ERROR_ACTION_REPORT) {
+                ret = req->ret;
+                break;
+            }
+            /* Retry after the pause point, the job may have been stopped */
+            req->retry = true;
+            continue;
+        }
+        if (req) {
+            QSIMPLEQ_REMOVE_HEAD(&s->failed_requests, next);
+            commit_start_task(s, pool, req->offset, req->bytes);
+            delay_ns = block_job_ratelimit_get_delay(&s->common, req->bytes);
+            g_free(req);
+            continue;
+        }
+
+        if (offset >= len) {
+            if (aio_task_pool_empty(pool)) {
+                break;
             }
+            /* Failed requests may still have to be retried */
+            aio_task_pool_wait_one(pool);
+            continue;
         }
+
+        /*
+         * Copy if allocated above the base.  Ask about the whole rest of the
+         * image so that unallocated areas are skipped in one step.
+         */
+        ret = bdrv_is_allocated_above(blk_bs(s->top), s->base_overlay, true,
+                                      offset, len - offset, &n);
+        trace_commit_one_iteration(s, offset, n, ret);
         if (ret < 0) {
             BlockErrorAction action =
-                block_job_error_action(&s->common, s->on_error,
-                                       error_in_source, -ret);
+                block_job_error_action(&s->common, s->on_error, true, -ret);
             if (action == BLOCK_ERROR_ACTION_REPORT) {
-                return ret;
-            } else {
-                n = 0;
-                continue;
+                break;
             }
+            ret = 0;
+            continue;
         }
-        /* Publish progress */
-        job_progress_update(&s->common.job, n);
 
-        if (copy) {
+        if (ret > 0) {
+            n = MIN(n, s->perf.max_chunk);
+            commit_start_task(s, pool, offset, n);
             delay_ns = block_job_ratelimit_get_delay(&s->common, n);
         } else {
-            delay_ns = 0;
+            /* Publish progress */
+            job_progress_update(&s->common.job, n);
         }
+        offset += n;
+        ret = 0;
     }
 
-    return 0;
+    aio_task_pool_wait_all(pool);
+    aio_task_pool_free(pool);
+
+    while ((req = QSIMPLEQ_FIRST(&s->failed_requests))) {
+        QSIMPLEQ_REMOVE_HEAD(&s->failed_requests, next);
+        g_free(req);
+    }
+
+    return ret;
 }
 
 static const BlockJobDriver commit_job_driver = {
@@ -243,7 +339,8 @@ void commit_start(const char *job_id, BlockDriverState *bs,
                   BlockDriverState *base, BlockDriverState *top,
                   int creation_flags, int64_t speed,
                   BlockdevOnError on_error, const char *backing_file_str,
-                  const char *filter_node_name, Error **errp)
+                  const char *filter_node_name, BlockJobPerf *perf,
+                  Error **errp)
 {
     CommitBlockJob *s;
     BlockDriverState *iter;
@@ -389,6 +486,8 @@ void commit_start(const char *job_id, BlockDriverState *bs,
 
     s->backing_file_str = g_strdup(backing_file_str);
     s->on_error = on_error;
+    s->perf = *perf;
+    QSIMPLEQ_INIT(&s->failed_requests);
 
     trace_commit_start(bs, base, top, s);
     job_start(&s->common.job);
@@ -25,27 +25,430 @@
 
 #include "qemu/osdep.h"
 
+#define ZLIB_CONST
+#include <zlib.h>
+
 #include "sysemu/block-backend.h"
 #include "qemu/cutils.h"
+#include "qemu/option.h"
 #include "qapi/error.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
 #include "block/block-copy.h"
+#include "block/aio_task.h"
+#include "block/thread-pool.h"
 
 #include "block/copy-before-write.h"
 
+#define CBW_OPT_CACHE_SIZE "cache-size"
+#define CBW_OPT_CACHE_COMPRESS "cache-compress"
+
+/* Number of cached writes processed in parallel */
+#define CBW_CACHE_WORKERS 16
+
+/* Delay between attempts to write failed cached writes while drained */
+#define CBW_CACHE_RETRY_NS (100 * SCALE_MS)
+
+/*
+ * A guest write held in memory.  Both the copy-before-write operation and
+ * the write to the file child are done later by cbw_cache_co().  Until then,
+ * the entry holds a reference in bs->in_flight, so that draining the node
+ * waits for it.
+ */
+typedef struct CbwCacheEntry {
+    int64_t offset;
+    int64_t bytes;
+    BdrvRequestFlags flags;
+    void *data;
+    size_t size;    /* length of @data, less than @bytes if compressed */
+    int ret;        /* error of the last attempt, if in cache_failed */
+    QTAILQ_ENTRY(CbwCacheEntry) next;
+} CbwCacheEntry;
+
 typedef struct BDRVCopyBeforeWriteState {
     BlockCopyState *bcs;
     BdrvChild *target;
+
+    /* Write-back cache for guest writes, see cbw_cache_write() */
+    uint64_t cache_size;
+    bool cache_compress;
+    uint64_t cache_used;
+    QTAILQ_HEAD(, CbwCacheEntry) cache_queued;
+    QTAILQ_HEAD(, CbwCacheEntry) cache_in_flight;
+    QTAILQ_HEAD(, CbwCacheEntry) cache_failed;  /* kept until written */
+    CoQueue cache_wait;     /* woken up whenever an entry is done */
+    bool cache_co_running;
 } BDRVCopyBeforeWriteState;
 
+typedef struct CbwCacheTask {
+    AioTask task;
+    BlockDriverState *bs;
+    CbwCacheEntry *entry;
+} CbwCacheTask;
+
+typedef struct CbwCompressData {
+    void *dest;
+    size_t dest_size;
+    const void *src;
+    size_t src_size;
+    bool compress;
+    ssize_t ret;
+} CbwCompressData;
+
+static coroutine_fn int cbw_do_copy_before_write(BlockDriverState *bs,
+        uint64_t offset, uint64_t bytes, BdrvRequestFlags flags);
+
+static int cbw_compress_func(void *opaque)
+{
+    CbwCompressData *data = opaque;
+    uLongf len = data->dest_size;
+    int ret;
+
+    if (data->compress) {
+        ret = compress2(data->dest, &len, data->src, data->src_size,
+                        Z_BEST_SPEED);
+    } else {
+        ret = uncompress(data->dest, &len, data->src, data->src_size);
+    }
+
+    data->ret = ret == Z_OK ? len : -EIO;
+    return 0;
+}
+
+/*
+ * Compress or uncompress @src into @dest in a worker thread.  Returns the
+ * length of the result, or -EIO if it does not fit into @dest_size bytes.
+ */
+static ssize_t coroutine_fn cbw_co_compress(BlockDriverState *bs,
+                                            bool compress,
+                                            void *dest, size_t dest_size,
+                                            const void *src, size_t src_size)
+{
+    ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
+    CbwCompressData data = {
+        .dest = dest,
+        .dest_size = dest_size,
+        .src = src,
+        .src_size = src_size,
+        .compress = compress,
+    };
+
+    thread_pool_submit_co(pool, cbw_compress_func, &data);
+
+    return data.ret;
+}
+
+static void cbw_cache_entry_free(CbwCacheEntry *entry)
+{
+    if (entry->size < entry->bytes) {
+        g_free(entry->data);
+    } else {
+        qemu_vfree(entry->data);
+    }
+    g_free(entry);
+}
+
+static bool cbw_cache_entry_intersects(CbwCacheEntry *entry,
+                                       int64_t offset, int64_t bytes)
+{
+    return offset < entry->offset + entry->bytes &&
+           entry->offset < offset + bytes;
+}
+
+/*
+ * Find a cached write intersecting with @offset/@bytes.  With @started_only,
+ * only writes that are in flight or have failed are considered.
+ */
+static CbwCacheEntry *cbw_cache_find(BDRVCopyBeforeWriteState *s,
+                                     bool started_only,
+                                     int64_t offset, int64_t bytes)
+{
+    CbwCacheEntry *entry;
+
+    QTAILQ_FOREACH(entry, &s->cache_in_flight, next) {
+        if (cbw_cache_entry_intersects(entry, offset, bytes)) {
+            return entry;
+        }
+    }
+
+    QTAILQ_FOREACH(entry, &s->cache_failed, next) {
+        if (cbw_cache_entry_intersects(entry, offset, bytes)) {
+            return entry;
+        }
+    }
+
+    if (started_only) {
+        return NULL;
+    }
+
+    QTAILQ_FOREACH(entry, &s->cache_queued, next) {
+        if (cbw_cache_entry_intersects(entry, offset, bytes)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void coroutine_fn cbw_cache_co(void *opaque);
+
+static void cbw_cache_kick(BlockDriverState *bs)
+{
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+
+    if (!s->cache_co_running && !QTAILQ_EMPTY(&s->cache_queued)) {
+        s->cache_co_running = true;
+        bdrv_inc_in_flight(bs);
+        aio_co_schedule(bdrv_get_aio_context(bs),
+                        qemu_coroutine_create(cbw_cache_co, bs));
+    }
+}
+
+/* Queue failed writes again, ahead of anything cached after them */
+static void cbw_cache_retry(BlockDriverState *bs)
+{
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+    CbwCacheEntry *entry;
+
+    while ((entry = QTAILQ_LAST(&s->cache_failed))) {
+        QTAILQ_REMOVE(&s->cache_failed, entry, next);
+        entry->ret = 0;
+        QTAILQ_INSERT_HEAD(&s->cache_queued, entry, next);
+    }
+
+    cbw_cache_kick(bs);
+}
+
+/*
+ * Wait until no cached write intersects with @offset/@bytes any more, so
+ * that a request bypassing the cache is ordered after the cached ones.
+ *
+ * Failed writes in the way are retried once.  If that fails again, the
+ * error is returned so that the request fails and the device's error
+ * policy applies.
+ */
+static int coroutine_fn cbw_cache_wait(BlockDriverState *bs,
+                                       int64_t offset, int64_t bytes)
+{
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+    bool retried = false;
+
+    while (cbw_cache_find(s, false, offset, bytes)) {
+        if (!QTAILQ_EMPTY(&s->cache_failed)) {
+            if (retried) {
+                return QTAILQ_FIRST(&s->cache_failed)->ret;
+            }
+            cbw_cache_retry(bs);
+            retried = true;
+        }
+        qemu_co_queue_wait(&s->cache_wait, NULL);
+    }
+
+    return 0;
+}
+
+static coroutine_fn int cbw_cache_task_entry(AioTask *task)
+{
+    CbwCacheTask *t = container_of(task, CbwCacheTask, task);
+    BlockDriverState *bs = t->bs;
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+    CbwCacheEntry *entry = t->entry;
+    QEMU_AUTO_VFREE void *buf = NULL;
+    int ret = 0;
+
+    if (entry->size < entry->bytes) {
+        buf = qemu_blockalign(bs, entry->bytes);
+        if (cbw_co_compress(bs, false, buf, entry->bytes,
+                            entry->data, entry->size) != entry->bytes) {
+            ret = -EIO;
+        }
+    }
+
+    if (ret == 0) {
+        ret = cbw_do_copy_before_write(bs, entry->offset, entry->bytes,
+                                       entry->flags);
+    }
+    if (ret == 0) {
+        ret = bdrv_co_pwrite(bs->file, entry->offset, entry->bytes,
+                             buf ?: entry->data, entry->flags);
+    }
+
+    QTAILQ_REMOVE(&s->cache_in_flight, entry, next);
+    if (ret < 0) {
+        /* The write was acknowledged already, so never drop its data */
+        entry->ret = ret;
+        QTAILQ_INSERT_TAIL(&s->cache_failed, entry, next);
+    } else {
+        s->cache_used -= entry->size;
+        cbw_cache_entry_free(entry);
+        bdrv_dec_in_flight(bs);
+    }
+    qemu_co_queue_restart_all(&s->cache_wait);
+
+    return 0;
+}
+
+/*
+ * Process cached writes until the cache is empty.  Writes are started in
+ * order, and a write waits for any earlier one that intersects with it.
+ * If that one failed, processing stops until cbw_cache_retry(), unless the
+ * node is drained: the drain can only complete once every acknowledged
+ * write is in the file child, so failed writes are retried periodically.
+ */
+static void coroutine_fn cbw_cache_co(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+    AioTaskPool *pool = aio_task_pool_new(CBW_CACHE_WORKERS);
+    CbwCacheEntry *entry;
+
+    for (;;) {
+        while ((entry = QTAILQ_FIRST(&s->cache_queued))) {
+            CbwCacheTask *t;
+
+            if (cbw_cache_find(s, true, entry->offset, entry->bytes)) {
+                break;
+            }
+
+            QTAILQ_REMOVE(&s->cache_queued, entry, next);
+            QTAILQ_INSERT_TAIL(&s->cache_in_flight, entry, next);
+
+            t = g_new(CbwCacheTask, 1);
+            *t = (CbwCacheTask) {
+                .task.func = cbw_cache_task_entry,
+                .bs = bs,
+                .entry = entry,
+            };
+            aio_task_pool_start_task(pool, &t->task);
+        }
+
+        if (aio_task_pool_empty(pool)) {
+            if (QTAILQ_EMPTY(&s->cache_failed) || !bs->quiesce_counter) {
+                break;
+            }
+            qemu_co_sleep_ns(QEMU_CLOCK_REALTIME, CBW_CACHE_RETRY_NS);
+            cbw_cache_retry(bs);
+            continue;
+        }
+        aio_task_pool_wait_one(pool);
+    }
+
+    aio_task_pool_free(pool);
+    s->cache_co_running = false;
+    qemu_co_queue_restart_all(&s->cache_wait);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Hold a guest write in memory and complete it right away, leaving the
+ * copy-before-write operation and the write itself to cbw_cache_co().
+ *
+ * The old data stays in the file child until it has been copied, so readers
+ * of the target, like a fleecing NBD export, keep seeing a consistent
+ * snapshot.  Reads through the filter wait for cached writes they intersect
+ * with.
+ *
+ * Returns false if the write has to be done synchronously, because the cache
+ * is disabled or full, the write must reach the disk before completing, or
+ * earlier cached writes have failed.  In the last case, guest writes go
+ * through the device's error policy until the failed ones are written.
+ */
+static bool coroutine_fn cbw_cache_write(BlockDriverState *bs,
+                                         int64_t offset, int64_t bytes,
+                                         QEMUIOVector *qiov,
+                                         BdrvRequestFlags flags)
+{
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+    CbwCacheEntry *entry;
+    void *data;
+    size_t size = bytes;
+
+    if (!s->cache_size || (flags & (BDRV_REQ_FUA | BDRV_REQ_WRITE_UNCHANGED)) ||
+        s->cache_used + bytes > s->cache_size ||
+        !QTAILQ_EMPTY(&s->cache_failed)) {
+        return false;
+    }
+
+    /* Reserve the uncompressed size, compression may yield */
+    s->cache_used += bytes;
+
+    data = qemu_blockalign(bs, bytes);
+    qemu_iovec_to_buf(qiov, 0, data, bytes);
+
+    if (s->cache_compress) {
+        void *zdata = g_malloc(bytes - 1);
+        ssize_t zsize = cbw_co_compress(bs, true, zdata, bytes - 1,
+                                        data, bytes);
+
+        if (zsize > 0) {
+            qemu_vfree(data);
+            data = g_realloc(zdata, zsize);
+            size = zsize;
+        } else {
+            g_free(zdata);
+        }
+    }
+    s->cache_used -= bytes - size;
+
+    entry = g_new(CbwCacheEntry, 1);
+    *entry = (CbwCacheEntry) {
+        .offset = offset,
+        .bytes = bytes,
+        .flags = flags,
+        .data = data,
+        .size = size,
+    };
+    QTAILQ_INSERT_TAIL(&s->cache_queued, entry, next);
+    bdrv_inc_in_flight(bs);
+    cbw_cache_kick(bs);
+
+    return true;
+}
+
 static coroutine_fn int cbw_co_preadv(
         BlockDriverState *bs, int64_t offset, int64_t bytes,
         QEMUIOVector *qiov, BdrvRequestFlags flags)
 {
+    int ret = cbw_cache_wait(bs, offset, bytes);
+
+    if (ret < 0) {
+        return ret;
+    }
+
     return bdrv_co_preadv(bs->file, offset, bytes, qiov, flags);
 }
 
+/*
+ * Data of cached writes is not in the file child yet, so report it as
+ * data here instead of passing the query on.
+ */
+static int coroutine_fn cbw_co_block_status(BlockDriverState *bs,
+                                            bool want_zero,
+                                            int64_t offset, int64_t bytes,
+                                            int64_t *pnum, int64_t *map,
+                                            BlockDriverState **file)
+{
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+    CbwCacheEntry *entry;
+    int64_t end = offset + bytes;
+
+    entry = cbw_cache_find(s, false, offset, 1);
+    if (entry) {
+        *pnum = MIN(entry->offset + entry->bytes, end) - offset;
+        return BDRV_BLOCK_DATA | BDRV_BLOCK_ALLOCATED;
+    }
+
+    /* No entry contains @offset, so this shrinks the range every time */
+    while ((entry = cbw_cache_find(s, false, offset, end - offset))) {
+        end = entry->offset;
+    }
+
+    *pnum = end - offset;
+    *map = offset;
+    *file = bs->file->bs;
+    return BDRV_BLOCK_RAW | BDRV_BLOCK_OFFSET_VALID;
+}
+
 static coroutine_fn int cbw_do_copy_before_write(BlockDriverState *bs,
         uint64_t offset, uint64_t bytes, BdrvRequestFlags flags)
 {
@@ -66,7 +469,14 @@ static coroutine_fn int cbw_do_copy_before_write(BlockDriverState *bs,
 static int coroutine_fn cbw_co_pdiscard(BlockDriverState *bs,
                                         int64_t offset, int64_t bytes)
 {
-    int ret = cbw_do_copy_before_write(bs, offset, bytes, 0);
+    int ret;
+
+    ret = cbw_cache_wait(bs, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cbw_do_copy_before_write(bs, offset, bytes, 0);
     if (ret < 0) {
         return ret;
     }
@@ -77,7 +487,14 @@ static int coroutine_fn cbw_co_pdiscard(BlockDriverState *bs,
 static int coroutine_fn cbw_co_pwrite_zeroes(BlockDriverState *bs,
         int64_t offset, int64_t bytes, BdrvRequestFlags flags)
 {
-    int ret = cbw_do_copy_before_write(bs, offset, bytes, flags);
+    int ret;
+
+    ret = cbw_cache_wait(bs, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cbw_do_copy_before_write(bs, offset, bytes, flags);
     if (ret < 0) {
         return ret;
     }
@@ -91,7 +508,18 @@ static coroutine_fn int cbw_co_pwritev(BlockDriverState *bs,
                                        QEMUIOVector *qiov,
                                        BdrvRequestFlags flags)
 {
-    int ret = cbw_do_copy_before_write(bs, offset, bytes, flags);
+    int ret;
+
+    if (cbw_cache_write(bs, offset, bytes, qiov, flags)) {
+        return 0;
+    }
+
+    ret = cbw_cache_wait(bs, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cbw_do_copy_before_write(bs, offset, bytes, flags);
     if (ret < 0) {
         return ret;
     }
@@ -101,13 +529,38 @@ static coroutine_fn int cbw_co_pwritev(BlockDriverState *bs,
 
 static int coroutine_fn cbw_co_flush(BlockDriverState *bs)
 {
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+
     if (!bs->file) {
         return 0;
     }
 
+    /*
+     * Cached writes have completed already, so their errors show up here.
+     * Failed ones are retried, and the flush keeps failing as long as any
+     * of them cannot be written.
+     */
+    cbw_cache_retry(bs);
+    while (s->cache_co_running) {
+        qemu_co_queue_wait(&s->cache_wait, NULL);
+    }
+    if (!QTAILQ_EMPTY(&s->cache_failed)) {
+        return QTAILQ_FIRST(&s->cache_failed)->ret;
+    }
+
     return bdrv_co_flush(bs->file->bs);
 }
 
+/*
+ * Acknowledged writes must reach the file child before the drain completes,
+ * e.g. before bdrv_cbw_drop() lets the guest write to it directly.  Start
+ * with failed ones right away, cbw_cache_co() keeps retrying them.
+ */
+static void coroutine_fn cbw_co_drain_begin(BlockDriverState *bs)
+{
+    cbw_cache_retry(bs);
+}
+
 static void cbw_refresh_filename(BlockDriverState *bs)
 {
     pstrcpy(bs->exact_filename, sizeof(bs->exact_filename),
@@ -145,11 +598,44 @@ static void cbw_child_perm(BlockDriverState *bs, BdrvChild *c,
     }
 }
 
+static QemuOptsList runtime_opts = {
+    .name = "copy-before-write",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = CBW_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "memory for holding guest writes, default 0 (disabled)",
+        },
+        {
+            .name = CBW_OPT_CACHE_COMPRESS,
+            .type = QEMU_OPT_BOOL,
+            .help = "compress guest writes held in memory, default off",
+        },
+        { /* end of list */ }
+    },
+};
+
 static int cbw_open(BlockDriverState *bs, QDict *options, int flags,
                     Error **errp)
 {
     BDRVCopyBeforeWriteState *s = bs->opaque;
     BdrvDirtyBitmap *copy_bitmap;
+    QemuOpts *opts;
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    s->cache_size = qemu_opt_get_size(opts, CBW_OPT_CACHE_SIZE, 0);
+    s->cache_compress = qemu_opt_get_bool(opts, CBW_OPT_CACHE_COMPRESS, false);
+    qemu_opts_del(opts);
+
+    QTAILQ_INIT(&s->cache_queued);
+    QTAILQ_INIT(&s->cache_in_flight);
+    QTAILQ_INIT(&s->cache_failed);
+    qemu_co_queue_init(&s->cache_wait);
 
     bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
                                BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
@@ -187,6 +673,11 @@ static void cbw_close(BlockDriverState *bs)
 {
     BDRVCopyBeforeWriteState *s = bs->opaque;
 
+    /* The node is drained, which waits for all cached writes */
+    assert(QTAILQ_EMPTY(&s->cache_queued));
+    assert(QTAILQ_EMPTY(&s->cache_in_flight));
+    assert(QTAILQ_EMPTY(&s->cache_failed));
+
     block_copy_state_free(s->bcs);
     s->bcs = NULL;
 }
@@ -203,6 +694,8 @@ BlockDriver bdrv_cbw_filter = {
     .bdrv_co_pwrite_zeroes      = cbw_co_pwrite_zeroes,
     .bdrv_co_pdiscard           = cbw_co_pdiscard,
     .bdrv_co_flush              = cbw_co_flush,
+    .bdrv_co_block_status       = cbw_co_block_status,
+    .bdrv_co_drain_begin        = cbw_co_drain_begin,
 
     .bdrv_refresh_filename      = cbw_refresh_filename,
 
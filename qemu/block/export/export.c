@@ -357,6 +357,10 @@ BlockExportInfoList *qmp_query_block_exports(Error **errp)
             .shutting_down  = !exp->user_owned,
         };
 
+        if (exp->drv->query) {
+            exp->drv->query(exp, info);
+        }
+
         QAPI_LIST_APPEND(tail, info);
     }
 
@@ -42,6 +42,9 @@
 /* Prevent overly long bounce buffer allocations */
 #define FUSE_MAX_BOUNCE_BYTES (MIN(BDRV_REQUEST_MAX_BYTES, 64 * 1024 * 1024))
 
+/* Stop reading from the FUSE session while this many requests are pending */
+#define FUSE_MAX_IN_FLIGHT 64
+
 
 typedef struct FuseExport {
     BlockExport common;
@@ -49,6 +52,10 @@ typedef struct FuseExport {
     struct fuse_session *fuse_session;
     struct fuse_buf fuse_buf;
     bool mounted, fd_handler_set_up;
+    unsigned int in_flight;
+
+    /* Serializes resizing the export against concurrent requests */
+    CoMutex resize_lock;
 
     char *mountpoint;
     bool writable;
@@ -61,6 +68,20 @@ typedef struct FuseExport {
     gid_t st_gid;
 } FuseExport;
 
+/* A request handled in a coroutine, see fuse_request_start() */
+typedef struct FuseRequest {
+    FuseExport *exp;
+    fuse_req_t req;
+    fuse_ino_t inode;
+    int64_t offset;
+    size_t size;
+    void *buf;
+
+    int mode;               /* fallocate() */
+    struct stat statbuf;    /* setattr() */
+    int to_set;
+} FuseRequest;
+
 static GHashTable *exports;
 static const struct fuse_lowlevel_ops fuse_ops;
 
@@ -72,6 +93,7 @@ static void init_exports_table(void);
 static int setup_fuse_export(FuseExport *exp, const char *mountpoint,
                              bool allow_other, Error **errp);
 static void read_from_fuse_export(void *opaque);
+static void fuse_export_update_fd_handler(FuseExport *exp);
 
 static bool is_regular_file(const char *path, Error **errp);
 
@@ -130,6 +152,7 @@ static int fuse_export_create(BlockExport *blk_exp,
     exp->mountpoint = g_strdup(args->mountpoint);
     exp->writable = blk_exp_args->writable;
     exp->growable = args->growable;
+    qemu_co_mutex_init(&exp->resize_lock);
 
     /* set default */
     if (!args->has_allow_other) {
@@ -221,10 +244,8 @@ static int setup_fuse_export(FuseExport *exp, const char *mountpoint,
 
     g_hash_table_insert(exports, g_strdup(mountpoint), NULL);
 
-    aio_set_fd_handler(exp->common.ctx,
-                       fuse_session_fd(exp->fuse_session), true,
-                       read_from_fuse_export, NULL, NULL, exp);
     exp->fd_handler_set_up = true;
+    fuse_export_update_fd_handler(exp);
 
     return 0;
 
@@ -233,6 +254,23 @@ fail:
     return ret;
 }
 
+/**
+ * Install the FD handler for the FUSE session, unless the maximum number of
+ * requests is in flight already.
+ */
+static void fuse_export_update_fd_handler(FuseExport *exp)
+{
+    if (!exp->fd_handler_set_up) {
+        return;
+    }
+
+    aio_set_fd_handler(exp->common.ctx,
+                       fuse_session_fd(exp->fuse_session), true,
+                       exp->in_flight < FUSE_MAX_IN_FLIGHT ?
+                       read_from_fuse_export : NULL,
+                       NULL, NULL, exp);
+}
+
 /**
  * Callback to be invoked when the FUSE session FD can be read from.
  * (This is basically the FUSE event loop.)
@@ -335,6 +373,17 @@ static void fuse_init(void *userdata, struct fuse_conn_info *conn)
     conn->max_read = FUSE_MAX_BOUNCE_BYTES;
 
     conn->max_write = MIN_NON_ZERO(BDRV_REQUEST_MAX_BYTES, conn->max_write);
+
+    /*
+     * Requests are processed concurrently, so let the kernel keep as many
+     * of them in flight.  Its default only allows for 12 background
+     * requests, which covers readahead and asynchronous direct I/O.
+     */
+    conn->max_background = FUSE_MAX_IN_FLIGHT;
+    conn->congestion_threshold = FUSE_MAX_IN_FLIGHT * 3 / 4;
+    if (conn->capable & FUSE_CAP_ASYNC_DIO) {
+        conn->want |= FUSE_CAP_ASYNC_DIO;
+    }
 }
 
 /**
@@ -387,8 +436,42 @@ static void fuse_getattr(fuse_req_t req, fuse_ino_t inode,
     fuse_reply_attr(req, &statbuf, 1.);
 }
 
-static int fuse_do_truncate(const FuseExport *exp, int64_t size,
-                            bool req_zero_write, PreallocMode prealloc)
+/**
+ * Start processing @r in a coroutine of its own, so that many requests can
+ * be in flight at the same time.  The coroutine must finish with
+ * fuse_co_request_end().
+ */
+static void fuse_request_start(FuseRequest *r, CoroutineEntry *entry)
+{
+    FuseExport *exp = r->exp;
+
+    blk_exp_ref(&exp->common);
+    if (++exp->in_flight == FUSE_MAX_IN_FLIGHT) {
+        fuse_export_update_fd_handler(exp);
+    }
+
+    qemu_coroutine_enter(qemu_coroutine_create(entry, r));
+}
+
+static void coroutine_fn fuse_co_request_end(FuseRequest *r)
+{
+    FuseExport *exp = r->exp;
+
+    if (exp->in_flight-- == FUSE_MAX_IN_FLIGHT) {
+        fuse_export_update_fd_handler(exp);
+    }
+
+    qemu_vfree(r->buf);
+    g_free(r);
+    blk_exp_unref(&exp->common);
+}
+
+/**
+ * Resize the export.  Called with exp->resize_lock held.
+ */
+static int coroutine_fn fuse_do_truncate(const FuseExport *exp, int64_t size,
+                                         bool req_zero_write,
+                                         PreallocMode prealloc)
 {
     uint64_t blk_perm, blk_shared_perm;
     BdrvRequestFlags truncate_flags = 0;
@@ -420,6 +503,76 @@ static int fuse_do_truncate(const FuseExport *exp, int64_t size,
     return ret;
 }
 
+static int coroutine_fn fuse_co_truncate(FuseExport *exp, int64_t size,
+                                         bool req_zero_write,
+                                         PreallocMode prealloc)
+{
+    int ret;
+
+    qemu_co_mutex_lock(&exp->resize_lock);
+    ret = fuse_do_truncate(exp, size, req_zero_write, prealloc);
+    qemu_co_mutex_unlock(&exp->resize_lock);
+
+    return ret;
+}
+
+/**
+ * Grow the export to at least @size bytes.  Concurrent requests may grow it
+ * as well, so never shrink it here.
+ */
+static int coroutine_fn fuse_co_grow(FuseExport *exp, int64_t size,
+                                     bool req_zero_write,
+                                     PreallocMode prealloc)
+{
+    int64_t length;
+    int ret = 0;
+
+    qemu_co_mutex_lock(&exp->resize_lock);
+    length = blk_getlength(exp->common.blk);
+    if (length < 0) {
+        ret = length;
+    } else if (size > length) {
+        ret = fuse_do_truncate(exp, size, req_zero_write, prealloc);
+    }
+    qemu_co_mutex_unlock(&exp->resize_lock);
+
+    return ret;
+}
+
+static void coroutine_fn fuse_co_setattr(void *opaque)
+{
+    FuseRequest *r = opaque;
+    FuseExport *exp = r->exp;
+    int ret;
+
+    if (r->to_set & FUSE_SET_ATTR_SIZE) {
+        ret = fuse_co_truncate(exp, r->statbuf.st_size, true,
+                               PREALLOC_MODE_OFF);
+        if (ret < 0) {
+            fuse_reply_err(r->req, -ret);
+            goto out;
+        }
+    }
+
+    if (r->to_set & FUSE_SET_ATTR_MODE) {
+        /* Ignore FUSE-supplied file type, only change the mode */
+        exp->st_mode = (r->statbuf.st_mode & 07777) | S_IFREG;
+    }
+
+    if (r->to_set & FUSE_SET_ATTR_UID) {
+        exp->st_uid = r->statbuf.st_uid;
+    }
+
+    if (r->to_set & FUSE_SET_ATTR_GID) {
+        exp->st_gid = r->statbuf.st_gid;
+    }
+
+    fuse_getattr(r->req, r->inode, NULL);
+
+out:
+    fuse_co_request_end(r);
+}
+
 /**
  * Let clients set file attributes.  Only resizing and changing
  * permissions (st_mode, st_uid, st_gid) is allowed.
@@ -432,8 +585,8 @@ static void fuse_setattr(fuse_req_t req, fuse_ino_t inode, struct stat *statbuf,
                          int to_set, struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
+    FuseRequest *r;
     int supported_attrs;
-    int ret;
 
     supported_attrs = FUSE_SET_ATTR_SIZE | FUSE_SET_ATTR_MODE;
     if (exp->allow_other) {
@@ -467,33 +620,18 @@ static void fuse_setattr(fuse_req_t req, fuse_ino_t inode, struct stat *statbuf,
         }
     }
 
-    if (to_set & FUSE_SET_ATTR_SIZE) {
-        if (!exp->writable) {
-            fuse_reply_err(req, EACCES);
-            return;
-        }
-
-        ret = fuse_do_truncate(exp, statbuf->st_size, true, PREALLOC_MODE_OFF);
-        if (ret < 0) {
-            fuse_reply_err(req, -ret);
-            return;
-        }
-    }
-
-    if (to_set & FUSE_SET_ATTR_MODE) {
-        /* Ignore FUSE-supplied file type, only change the mode */
-        exp->st_mode = (statbuf->st_mode & 07777) | S_IFREG;
-    }
-
-    if (to_set & FUSE_SET_ATTR_UID) {
-        exp->st_uid = statbuf->st_uid;
-    }
-
-    if (to_set & FUSE_SET_ATTR_GID) {
-        exp->st_gid = statbuf->st_gid;
+    if ((to_set & FUSE_SET_ATTR_SIZE) && !exp->writable) {
+        fuse_reply_err(req, EACCES);
+        return;
     }
 
-    fuse_getattr(req, inode, fi);
+    r = g_new0(FuseRequest, 1);
+    r->exp = exp;
+    r->req = req;
+    r->inode = inode;
+    r->statbuf = *statbuf;
+    r->to_set = to_set;
+    fuse_request_start(r, fuse_co_setattr);
 }
 
 /**
@@ -505,73 +643,75 @@ static void fuse_open(fuse_req_t req, fuse_ino_t inode,
     fuse_reply_open(req, fi);
 }
 
-/**
- * Handle client reads from the exported image.
- */
-static void fuse_read(fuse_req_t req, fuse_ino_t inode,
-                      size_t size, off_t offset, struct fuse_file_info *fi)
+static void coroutine_fn fuse_co_read(void *opaque)
 {
-    FuseExport *exp = fuse_req_userdata(req);
+    FuseRequest *r = opaque;
+    FuseExport *exp = r->exp;
     int64_t length;
-    void *buf;
+    size_t size = r->size;
     int ret;
 
-    /* Limited by max_read, should not happen */
-    if (size > FUSE_MAX_BOUNCE_BYTES) {
-        fuse_reply_err(req, EINVAL);
-        return;
-    }
-
     /**
      * Clients will expect short reads at EOF, so we have to limit
      * offset+size to the image length.
      */
     length = blk_getlength(exp->common.blk);
     if (length < 0) {
-        fuse_reply_err(req, -length);
-        return;
+        fuse_reply_err(r->req, -length);
+        goto out;
     }
 
-    if (offset + size > length) {
-        size = length - offset;
+    if (r->offset + size > length) {
+        size = length - r->offset;
     }
 
-    buf = qemu_try_blockalign(blk_bs(exp->common.blk), size);
-    if (!buf) {
-        fuse_reply_err(req, ENOMEM);
-        return;
+    r->buf = qemu_try_blockalign(blk_bs(exp->common.blk), size);
+    if (!r->buf) {
+        fuse_reply_err(r->req, ENOMEM);
+        goto out;
     }
 
-    ret = blk_pread(exp->common.blk, offset, buf, size);
+    ret = blk_co_pread(exp->common.blk, r->offset, size, r->buf, 0);
     if (ret >= 0) {
-        fuse_reply_buf(req, buf, size);
+        fuse_reply_buf(r->req, r->buf, size);
     } else {
-        fuse_reply_err(req, -ret);
+        fuse_reply_err(r->req, -ret);
     }
 
-    qemu_vfree(buf);
+out:
+    fuse_co_request_end(r);
 }
 
 /**
- * Handle client writes to the exported image.
+ * Handle client reads from the exported image.
  */
-static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
-                       size_t size, off_t offset, struct fuse_file_info *fi)
+static void fuse_read(fuse_req_t req, fuse_ino_t inode,
+                      size_t size, off_t offset, struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
-    int64_t length;
-    int ret;
+    FuseRequest *r;
 
-    /* Limited by max_write, should not happen */
-    if (size > BDRV_REQUEST_MAX_BYTES) {
+    /* Limited by max_read, should not happen */
+    if (size > FUSE_MAX_BOUNCE_BYTES) {
         fuse_reply_err(req, EINVAL);
         return;
     }
 
-    if (!exp->writable) {
-        fuse_reply_err(req, EACCES);
-        return;
-    }
+    r = g_new0(FuseRequest, 1);
+    r->exp = exp;
+    r->req = req;
+    r->offset = offset;
+    r->size = size;
+    fuse_request_start(r, fuse_co_read);
+}
+
+static void coroutine_fn fuse_co_write(void *opaque)
+{
+    FuseRequest *r = opaque;
+    FuseExport *exp = r->exp;
+    int64_t length;
+    size_t size = r->size;
+    int ret;
 
     /**
      * Clients will expect short writes at EOF, so we have to limit
@@ -579,50 +719,85 @@ static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
      */
     length = blk_getlength(exp->common.blk);
     if (length < 0) {
-        fuse_reply_err(req, -length);
-        return;
+        fuse_reply_err(r->req, -length);
+        goto out;
     }
 
-    if (offset + size > length) {
+    if (r->offset + size > length) {
         if (exp->growable) {
-            ret = fuse_do_truncate(exp, offset + size, true, PREALLOC_MODE_OFF);
+            ret = fuse_co_grow(exp, r->offset + size, true, PREALLOC_MODE_OFF);
             if (ret < 0) {
-                fuse_reply_err(req, -ret);
-                return;
+                fuse_reply_err(r->req, -ret);
+                goto out;
             }
         } else {
-            size = length - offset;
+            size = length - r->offset;
         }
     }
 
-    ret = blk_pwrite(exp->common.blk, offset, buf, size, 0);
+    ret = blk_co_pwrite(exp->common.blk, r->offset, size, r->buf, 0);
     if (ret >= 0) {
-        fuse_reply_write(req, size);
+        fuse_reply_write(r->req, size);
     } else {
-        fuse_reply_err(req, -ret);
+        fuse_reply_err(r->req, -ret);
     }
+
+out:
+    fuse_co_request_end(r);
 }
 
 /**
- * Let clients perform various fallocate() operations.
+ * Handle client writes to the exported image.
  */
-static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
-                           off_t offset, off_t length,
-                           struct fuse_file_info *fi)
+static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
+                       size_t size, off_t offset, struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
-    int64_t blk_len;
-    int ret;
+    FuseRequest *r;
+    void *bounce;
+
+    /* Limited by max_write, should not happen */
+    if (size > BDRV_REQUEST_MAX_BYTES) {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
 
     if (!exp->writable) {
         fuse_reply_err(req, EACCES);
         return;
     }
 
+    /* @buf points into exp->fuse_buf, which the next request reuses */
+    bounce = qemu_try_blockalign(blk_bs(exp->common.blk), size);
+    if (!bounce) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    memcpy(bounce, buf, size);
+
+    r = g_new0(FuseRequest, 1);
+    r->exp = exp;
+    r->req = req;
+    r->offset = offset;
+    r->size = size;
+    r->buf = bounce;
+    fuse_request_start(r, fuse_co_write);
+}
+
+static void coroutine_fn fuse_co_fallocate(void *opaque)
+{
+    FuseRequest *r = opaque;
+    FuseExport *exp = r->exp;
+    int mode = r->mode;
+    int64_t offset = r->offset;
+    int64_t length = r->size;
+    int64_t blk_len;
+    int ret;
+
     blk_len = blk_getlength(exp->common.blk);
     if (blk_len < 0) {
-        fuse_reply_err(req, -blk_len);
-        return;
+        fuse_reply_err(r->req, -blk_len);
+        goto out;
     }
 
     if (mode & FALLOC_FL_KEEP_SIZE) {
@@ -631,14 +806,14 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
 
     if (mode & FALLOC_FL_PUNCH_HOLE) {
         if (!(mode & FALLOC_FL_KEEP_SIZE)) {
-            fuse_reply_err(req, EINVAL);
-            return;
+            fuse_reply_err(r->req, EINVAL);
+            goto out;
         }
 
         do {
             int size = MIN(length, BDRV_REQUEST_MAX_BYTES);
 
-            ret = blk_pdiscard(exp->common.blk, offset, size);
+            ret = blk_co_pdiscard(exp->common.blk, offset, size);
             offset += size;
             length -= size;
         } while (ret == 0 && length > 0);
@@ -647,19 +822,18 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
     else if (mode & FALLOC_FL_ZERO_RANGE) {
         if (!(mode & FALLOC_FL_KEEP_SIZE) && offset + length > blk_len) {
             /* No need for zeroes, we are going to write them ourselves */
-            ret = fuse_do_truncate(exp, offset + length, false,
-                                   PREALLOC_MODE_OFF);
+            ret = fuse_co_grow(exp, offset + length, false, PREALLOC_MODE_OFF);
             if (ret < 0) {
-                fuse_reply_err(req, -ret);
-                return;
+                fuse_reply_err(r->req, -ret);
+                goto out;
             }
         }
 
         do {
             int size = MIN(length, BDRV_REQUEST_MAX_BYTES);
 
-            ret = blk_pwrite_zeroes(exp->common.blk,
-                                    offset, size, 0);
+            ret = blk_co_pwrite_zeroes(exp->common.blk,
+                                       offset, size, 0);
             offset += size;
             length -= size;
         } while (ret == 0 && length > 0);
@@ -668,26 +842,63 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
     else if (!mode) {
         /* We can only fallocate at the EOF with a truncate */
         if (offset < blk_len) {
-            fuse_reply_err(req, EOPNOTSUPP);
-            return;
+            fuse_reply_err(r->req, EOPNOTSUPP);
+            goto out;
         }
 
         if (offset > blk_len) {
             /* No preallocation needed here */
-            ret = fuse_do_truncate(exp, offset, true, PREALLOC_MODE_OFF);
+            ret = fuse_co_grow(exp, offset, true, PREALLOC_MODE_OFF);
             if (ret < 0) {
-                fuse_reply_err(req, -ret);
-                return;
+                fuse_reply_err(r->req, -ret);
+                goto out;
             }
         }
 
-        ret = fuse_do_truncate(exp, offset + length, true,
-                               PREALLOC_MODE_FALLOC);
+        ret = fuse_co_grow(exp, offset + length, true, PREALLOC_MODE_FALLOC);
     } else {
         ret = -EOPNOTSUPP;
     }
 
-    fuse_reply_err(req, ret < 0 ? -ret : 0);
+    fuse_reply_err(r->req, ret < 0 ? -ret : 0);
+
+out:
+    fuse_co_request_end(r);
+}
+
+/**
+ * Let clients perform various fallocate() operations.
+ */
+static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
+                           off_t offset, off_t length,
+                           struct fuse_file_info *fi)
+{
+    FuseExport *exp = fuse_req_userdata(req);
+    FuseRequest *r;
+
+    if (!exp->writable) {
+        fuse_reply_err(req, EACCES);
+        return;
+    }
+
+    r = g_new0(FuseRequest, 1);
+    r->exp = exp;
+    r->req = req;
+    r->mode = mode;
+    r->offset = offset;
+    r->size = length;
+    fuse_request_start(r, fuse_co_fallocate);
+}
+
+static void coroutine_fn fuse_co_fsync(void *opaque)
+{
+    FuseRequest *r = opaque;
+    int ret;
+
+    ret = blk_co_flush(r->exp->common.blk);
+    fuse_reply_err(r->req, ret < 0 ? -ret : 0);
+
+    fuse_co_request_end(r);
 }
 
 /**
@@ -696,11 +907,11 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
 static void fuse_fsync(fuse_req_t req, fuse_ino_t inode, int datasync,
                        struct fuse_file_info *fi)
 {
-    FuseExport *exp = fuse_req_userdata(req);
-    int ret;
+    FuseRequest *r = g_new0(FuseRequest, 1);
 
-    ret = blk_flush(exp->common.blk);
-    fuse_reply_err(req, ret < 0 ? -ret : 0);
+    r->exp = fuse_req_userdata(req);
+    r->req = req;
+    fuse_request_start(r, fuse_co_fsync);
 }
 
 /**
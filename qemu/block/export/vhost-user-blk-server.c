@@ -44,6 +44,8 @@ typedef struct VuBlkReq {
     struct virtio_blk_outhdr out;
     VuServer *server;
     struct VuVirtq *vq;
+    int vq_idx;
+    uint64_t bytes;     /* data transferred, for the statistics */
 } VuBlkReq;
 
 /* vhost user block device */
@@ -54,12 +56,40 @@ typedef struct {
     QIOChannelSocket *sioc;
     struct virtio_blk_config blkcfg;
     bool writable;
+    uint16_t num_queues;
+    VhostUserBlkQueueStats *queue_stats;    /* one per virtqueue */
 } VuBlkExport;
 
+static void vu_blk_req_account(VuBlkReq *req, bool done)
+{
+    VuBlkExport *vexp = container_of(req->server, VuBlkExport, vu_server);
+    VhostUserBlkQueueStats *stats = &vexp->queue_stats[req->vq_idx];
+    uint32_t type;
+
+    stats->in_flight--;
+    if (!done) {
+        /* Malformed request, the headers may not even have been parsed */
+        stats->failed++;
+        return;
+    }
+
+    type = le32_to_cpu(req->out.type) & ~VIRTIO_BLK_T_BARRIER;
+    stats->completed++;
+    if (req->in->status != VIRTIO_BLK_S_OK) {
+        stats->failed++;
+    } else if (type == VIRTIO_BLK_T_IN) {
+        stats->rd_bytes += req->bytes;
+    } else if (type == VIRTIO_BLK_T_OUT) {
+        stats->wr_bytes += req->bytes;
+    }
+}
+
 static void vu_blk_req_complete(VuBlkReq *req)
 {
     VuDev *vu_dev = &req->server->vu_dev;
 
+    vu_blk_req_account(req, true);
+
     /* IO size with 1 extra status byte */
     vu_queue_push(vu_dev, req->vq, &req->elem, req->size + 1);
     vu_queue_notify(vu_dev, req->vq);
@@ -249,6 +279,7 @@ static void coroutine_fn vu_blk_virtio_process_req(void *opaque)
         }
         if (ret >= 0) {
             req->in->status = VIRTIO_BLK_S_OK;
+            req->bytes = qiov.size;
         } else {
             req->in->status = VIRTIO_BLK_S_IOERR;
         }
@@ -289,14 +320,19 @@ static void coroutine_fn vu_blk_virtio_process_req(void *opaque)
     return;
 
 err:
+    vu_blk_req_account(req, false);
     free(req);
 }
 
 static void vu_blk_process_vq(VuDev *vu_dev, int idx)
 {
     VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+    VuBlkExport *vexp = container_of(server, VuBlkExport, vu_server);
     VuVirtq *vq = vu_get_queue(vu_dev, idx);
 
+    /* Submit all requests of this kick to the host in one batch */
+    blk_io_plug(vexp->export.blk);
+
     while (1) {
         VuBlkReq *req;
 
@@ -307,11 +343,16 @@ static void vu_blk_process_vq(VuDev *vu_dev, int idx)
 
         req->server = server;
         req->vq = vq;
+        req->vq_idx = idx;
+        req->bytes = 0;
+        vexp->queue_stats[idx].in_flight++;
 
         Coroutine *co =
             qemu_coroutine_create(vu_blk_virtio_process_req, req);
         qemu_coroutine_enter(co);
     }
+
+    blk_io_unplug(vexp->export.blk);
 }
 
 static void vu_blk_queue_set_started(VuDev *vu_dev, int idx, bool started)
@@ -503,6 +544,9 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
     vu_blk_initialize_config(blk_bs(exp->blk), &vexp->blkcfg,
                              logical_block_size, num_queues);
 
+    vexp->num_queues = num_queues;
+    vexp->queue_stats = g_new0(VhostUserBlkQueueStats, num_queues);
+
     blk_add_aio_context_notifier(exp->blk, blk_aio_attached, blk_aio_detach,
                                  vexp);
 
@@ -510,6 +554,7 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
                                  num_queues, &vu_blk_iface, errp)) {
         blk_remove_aio_context_notifier(exp->blk, blk_aio_attached,
                                         blk_aio_detach, vexp);
+        g_free(vexp->queue_stats);
         return -EADDRNOTAVAIL;
     }
 
@@ -522,6 +567,22 @@ static void vu_blk_exp_delete(BlockExport *exp)
 
     blk_remove_aio_context_notifier(exp->blk, blk_aio_attached, blk_aio_detach,
                                     vexp);
+    g_free(vexp->queue_stats);
+}
+
+static void vu_blk_exp_query(BlockExport *exp, BlockExportInfo *info)
+{
+    VuBlkExport *vexp = container_of(exp, VuBlkExport, export);
+    VhostUserBlkQueueStatsList **tail = &info->u.vhost_user_blk.queues;
+    uint16_t i;
+
+    for (i = 0; i < vexp->num_queues; i++) {
+        VhostUserBlkQueueStats *stats = g_new(VhostUserBlkQueueStats, 1);
+
+        *stats = vexp->queue_stats[i];
+        stats->index = i;
+        QAPI_LIST_APPEND(tail, stats);
+    }
 }
 
 const BlockExportDriver blk_exp_vhost_user_blk = {
@@ -530,4 +591,5 @@ const BlockExportDriver blk_exp_vhost_user_blk = {
     .create             = vu_blk_exp_create,
     .delete             = vu_blk_exp_delete,
     .request_shutdown   = vu_blk_exp_request_shutdown,
+    .query              = vu_blk_exp_query,
 };
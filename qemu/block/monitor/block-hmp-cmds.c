@@ -510,7 +510,7 @@ void hmp_block_stream(Monitor *mon, const QDict *qdict)
                      false, NULL, false, NULL,
                      qdict_haskey(qdict, "speed"), speed, true,
                      BLOCKDEV_ON_ERROR_REPORT, false, NULL, false, false, false,
-                     false, &error);
+                     false, false, NULL, &error);
 
     hmp_handle_error(mon, error);
 }
@@ -802,7 +802,7 @@ void hmp_info_blockstats(Monitor *mon, const QDict *qdict)
 {
     BlockStatsList *stats_list, *stats;
 
-    stats_list = qmp_query_blockstats(false, false, NULL);
+    stats_list = qmp_query_blockstats(false, false, false, false, NULL);
 
     for (stats = stats_list; stats; stats = stats->next) {
         if (!stats->value->has_device) {
@@ -424,6 +424,49 @@ static void bdrv_latency_histogram_stats(BlockLatencyHistogram *hist,
     }
 }
 
+static BlockIoDetailedStats *bdrv_io_detailed_stats(BlockAcctDetailedStats *d)
+{
+    BlockIoDetailedStats *info = g_new0(BlockIoDetailedStats, 1);
+    BlockLatencySizeClassList **latency_tail = &info->latency;
+    uint64List **depth_tail = &info->queue_depth;
+    int i, j;
+
+    for (i = 0; i < BLOCK_ACCT_SIZE_CLASSES; i++) {
+        BlockLatencySizeClass *size_class = g_new0(BlockLatencySizeClass, 1);
+        uint64List **bins_tail = &size_class->bins;
+
+        size_class->size_limit = block_acct_size_class_limit(i);
+        size_class->has_size_limit = size_class->size_limit != 0;
+        for (j = 0; j < BLOCK_ACCT_LATENCY_BINS; j++) {
+            QAPI_LIST_APPEND(bins_tail, stat64_get(&d->latency[i][j]));
+        }
+        QAPI_LIST_APPEND(latency_tail, size_class);
+    }
+
+    for (i = 0; i < BLOCK_ACCT_DEPTH_BINS; i++) {
+        QAPI_LIST_APPEND(depth_tail, stat64_get(&d->queue_depth[i]));
+    }
+
+    return info;
+}
+
+/*
+ * The detailed stats are plain atomic counters, so unlike the rest of
+ * BlockDeviceStats they may be read without holding the AioContext.
+ */
+static BlockDetailedStats *bdrv_query_blk_detailed_stats(BlockBackend *blk)
+{
+    BlockAcctStats *stats = blk_get_stats(blk);
+    BlockDetailedStats *ds = g_new0(BlockDetailedStats, 1);
+
+    ds->rd = bdrv_io_detailed_stats(&stats->detailed[BLOCK_ACCT_READ]);
+    ds->wr = bdrv_io_detailed_stats(&stats->detailed[BLOCK_ACCT_WRITE]);
+    ds->flush = bdrv_io_detailed_stats(&stats->detailed[BLOCK_ACCT_FLUSH]);
+    ds->unmap = bdrv_io_detailed_stats(&stats->detailed[BLOCK_ACCT_UNMAP]);
+
+    return ds;
+}
+
 static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
 {
     BlockAcctStats *stats = blk_get_stats(blk);
@@ -613,6 +656,8 @@ BlockInfoList *qmp_query_block(Error **errp)
 
 BlockStatsList *qmp_query_blockstats(bool has_query_nodes,
                                      bool query_nodes,
+                                     bool has_detailed,
+                                     bool detailed,
                                      Error **errp)
 {
     BlockStatsList *head = NULL, **tail = &head;
@@ -654,6 +699,11 @@ BlockStatsList *qmp_query_blockstats(bool has_query_nodes,
             bdrv_query_blk_stats(s->stats, blk);
             aio_context_release(ctx);
 
+            if (has_detailed && detailed) {
+                s->stats->has_detailed = true;
+                s->stats->detailed = bdrv_query_blk_detailed_stats(blk);
+            }
+
             QAPI_LIST_APPEND(tail, s);
         }
     }
@@ -661,6 +711,52 @@ BlockStatsList *qmp_query_blockstats(bool has_query_nodes,
     return head;
 }
 
+BlockIoHistogramsList *qmp_query_block_io_histograms(bool has_id,
+                                                     const char *id,
+                                                     Error **errp)
+{
+    BlockIoHistogramsList *head = NULL, **tail = &head;
+    BlockBackend *blk;
+
+    for (blk = blk_all_next(NULL); blk; blk = blk_all_next(blk)) {
+        BlockIoHistograms *h;
+        char *qdev;
+
+        if (!*blk_name(blk) && !blk_get_attached_dev(blk)) {
+            continue;
+        }
+
+        qdev = blk_get_attached_dev_id(blk);
+        if (has_id && strcmp(id, blk_name(blk)) &&
+            !(qdev && !strcmp(id, qdev))) {
+            g_free(qdev);
+            continue;
+        }
+
+        h = g_new0(BlockIoHistograms, 1);
+        if (*blk_name(blk)) {
+            h->has_device = true;
+            h->device = g_strdup(blk_name(blk));
+        }
+        if (qdev && *qdev) {
+            h->has_qdev = true;
+            h->qdev = qdev;
+        } else {
+            g_free(qdev);
+        }
+        h->stats = bdrv_query_blk_detailed_stats(blk);
+
+        QAPI_LIST_APPEND(tail, h);
+    }
+
+    if (has_id && !head) {
+        error_set(errp, ERROR_CLASS_DEVICE_NOT_FOUND,
+                  "Device '%s' not found", id);
+    }
+
+    return head;
+}
+
 void bdrv_snapshot_dump(QEMUSnapshotInfo *sn)
 {
     char clock_buf[128];
@@ -30,6 +30,7 @@
 #include "qemu/cutils.h"
 
 #include "qcow2.h"
+#include "block/aio_task.h"
 
 /* NOTICE: BME here means Bitmaps Extension and used as a namespace for
  * _internal_ constants. Please do not use this _internal_ abbreviation for
@@ -278,33 +279,103 @@ static int free_bitmap_clusters(BlockDriverState *bs, Qcow2BitmapTable *tb)
     return 0;
 }
 
-/* load_bitmap_data
- * @bitmap_table entries must satisfy specification constraints.
- * @bitmap must be cleared */
-static int load_bitmap_data(BlockDriverState *bs,
-                            const uint64_t *bitmap_table,
-                            uint32_t bitmap_table_size,
-                            BdrvDirtyBitmap *bitmap)
+/*
+ * Bitmap data clusters are independent of each other, so they are read and
+ * written by up to BITMAP_MAX_WORKERS parallel requests.
+ */
+#define BITMAP_MAX_WORKERS QCOW2_MAX_WORKERS
+
+typedef struct Qcow2BitmapTask {
+    AioTask task;
+
+    BlockDriverState *bs;
+    BdrvDirtyBitmap *bitmap;
+    uint64_t data_offset; /* offset of the data cluster in the image */
+    uint64_t offset;      /* offset of the covered range in the bitmap */
+    uint64_t count;
+    uint8_t *buf;         /* serialized data, only for writes */
+} Qcow2BitmapTask;
+
+typedef struct Qcow2BitmapCo {
+    BlockDriverState *bs;
+    BdrvDirtyBitmap *bitmap;
+    uint64_t *bitmap_table;
+    uint32_t bitmap_table_size;
+    Error **errp;
+    int ret;
+} Qcow2BitmapCo;
+
+/*
+ * Run @entry with @bmco as argument: directly when already in coroutine
+ * context, otherwise in a new coroutine, polling until it has finished.
+ */
+static int bitmap_co_run(CoroutineEntry *entry, Qcow2BitmapCo *bmco)
 {
-    int ret = 0;
+    bmco->ret = -EINPROGRESS;
+
+    if (qemu_in_coroutine()) {
+        entry(bmco);
+    } else {
+        bdrv_coroutine_enter(bmco->bs, qemu_coroutine_create(entry, bmco));
+        BDRV_POLL_WHILE(bmco->bs, bmco->ret == -EINPROGRESS);
+    }
+
+    return bmco->ret;
+}
+
+static coroutine_fn int load_bitmap_data_task_entry(AioTask *task)
+{
+    Qcow2BitmapTask *t = container_of(task, Qcow2BitmapTask, task);
+    BDRVQcow2State *s = t->bs->opaque;
+    uint64_t data_size;
+    uint8_t *buf;
+    int ret;
+
+    buf = g_malloc(s->cluster_size);
+    ret = bdrv_co_pread(t->bs->file, t->data_offset, s->cluster_size, buf, 0);
+    if (ret < 0) {
+        goto out;
+    }
+
+    /*
+     * Other writers may store all-zero data clusters. The bitmap is already
+     * cleared, so those need not be deserialized.
+     */
+    data_size = bdrv_dirty_bitmap_serialization_size(t->bitmap, t->offset,
+                                                     t->count);
+    if (!buffer_is_zero(buf, data_size)) {
+        bdrv_dirty_bitmap_deserialize_part(t->bitmap, buf, t->offset,
+                                           t->count, false);
+    }
+
+out:
+    g_free(buf);
+    return ret;
+}
+
+static void coroutine_fn load_bitmap_data_entry(void *opaque)
+{
+    Qcow2BitmapCo *bmco = opaque;
+    BlockDriverState *bs = bmco->bs;
     BDRVQcow2State *s = bs->opaque;
+    BdrvDirtyBitmap *bitmap = bmco->bitmap;
+    AioTaskPool *pool;
     uint64_t offset, limit;
     uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
-    uint8_t *buf = NULL;
-    uint64_t i, tab_size =
-            size_to_clusters(s,
-                bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
+    uint64_t i;
+    int ret;
 
-    if (tab_size != bitmap_table_size || tab_size > BME_MAX_TABLE_SIZE) {
-        return -EINVAL;
-    }
+    pool = aio_task_pool_new(BITMAP_MAX_WORKERS);
 
-    buf = g_malloc(s->cluster_size);
     limit = bdrv_dirty_bitmap_serialization_coverage(s->cluster_size, bitmap);
-    for (i = 0, offset = 0; i < tab_size; ++i, offset += limit) {
+    for (i = 0, offset = 0;
+         i < bmco->bitmap_table_size && aio_task_pool_status(pool) == 0;
+         ++i, offset += limit)
+    {
         uint64_t count = MIN(bm_size - offset, limit);
-        uint64_t entry = bitmap_table[i];
+        uint64_t entry = bmco->bitmap_table[i];
         uint64_t data_offset = entry & BME_TABLE_ENTRY_OFFSET_MASK;
+        Qcow2BitmapTask *task;
 
         assert(check_table_entry(entry, s->cluster_size) == 0);
 
@@ -316,23 +387,57 @@ static int load_bitmap_data(BlockDriverState *bs,
                 /* No need to deserialize zeros because the dirty bitmap is
                  * already cleared */
             }
-        } else {
-            ret = bdrv_pread(bs->file, data_offset, buf, s->cluster_size);
-            if (ret < 0) {
-                goto finish;
-            }
-            bdrv_dirty_bitmap_deserialize_part(bitmap, buf, offset, count,
-                                               false);
+            continue;
         }
+
+        task = g_new(Qcow2BitmapTask, 1);
+        *task = (Qcow2BitmapTask) {
+            .task.func = load_bitmap_data_task_entry,
+            .bs = bs,
+            .bitmap = bitmap,
+            .data_offset = data_offset,
+            .offset = offset,
+            .count = count,
+        };
+        aio_task_pool_start_task(pool, &task->task);
     }
-    ret = 0;
 
-    bdrv_dirty_bitmap_deserialize_finish(bitmap);
+    aio_task_pool_wait_all(pool);
+    ret = aio_task_pool_status(pool);
+    aio_task_pool_free(pool);
 
-finish:
-    g_free(buf);
+    if (ret == 0) {
+        bdrv_dirty_bitmap_deserialize_finish(bitmap);
+    }
 
-    return ret;
+    bmco->ret = ret;
+}
+
+/* load_bitmap_data
+ * @bitmap_table entries must satisfy specification constraints.
+ * @bitmap must be cleared */
+static int load_bitmap_data(BlockDriverState *bs,
+                            const uint64_t *bitmap_table,
+                            uint32_t bitmap_table_size,
+                            BdrvDirtyBitmap *bitmap)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
+    uint64_t tab_size =
+            size_to_clusters(s,
+                bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
+    Qcow2BitmapCo bmco = {
+        .bs = bs,
+        .bitmap = bitmap,
+        .bitmap_table = (uint64_t *)bitmap_table,
+        .bitmap_table_size = bitmap_table_size,
+    };
+
+    if (tab_size != bitmap_table_size || tab_size > BME_MAX_TABLE_SIZE) {
+        return -EINVAL;
+    }
+
+    return bitmap_co_run(load_bitmap_data_entry, &bmco);
 }
 
 static BdrvDirtyBitmap *load_bitmap(BlockDriverState *bs,
@@ -1264,49 +1369,49 @@ out:
     return ret;
 }
 
-/* store_bitmap_data()
- * Store bitmap to image, filling bitmap table accordingly.
- */
-static uint64_t *store_bitmap_data(BlockDriverState *bs,
-                                   BdrvDirtyBitmap *bitmap,
-                                   uint32_t *bitmap_table_size, Error **errp)
+static coroutine_fn int store_bitmap_data_task_entry(AioTask *task)
 {
+    Qcow2BitmapTask *t = container_of(task, Qcow2BitmapTask, task);
+    BDRVQcow2State *s = t->bs->opaque;
     int ret;
+
+    ret = bdrv_co_pwrite(t->bs->file, t->data_offset, s->cluster_size,
+                         t->buf, 0);
+    g_free(t->buf);
+
+    return ret;
+}
+
+static void coroutine_fn store_bitmap_data_entry(void *opaque)
+{
+    Qcow2BitmapCo *bmco = opaque;
+    BlockDriverState *bs = bmco->bs;
     BDRVQcow2State *s = bs->opaque;
+    BdrvDirtyBitmap *bitmap = bmco->bitmap;
+    uint64_t *tb = bmco->bitmap_table;
+    Error **errp = bmco->errp;
+    AioTaskPool *pool;
     int64_t offset;
     uint64_t limit;
     uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
     const char *bm_name = bdrv_dirty_bitmap_name(bitmap);
-    uint8_t *buf = NULL;
-    uint64_t *tb;
-    uint64_t tb_size =
-            size_to_clusters(s,
-                bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
-
-    if (tb_size > BME_MAX_TABLE_SIZE ||
-        tb_size * s->cluster_size > BME_MAX_PHYS_SIZE)
-    {
-        error_setg(errp, "Bitmap '%s' is too big", bm_name);
-        return NULL;
-    }
+    int ret = 0;
 
-    tb = g_try_new0(uint64_t, tb_size);
-    if (tb == NULL) {
-        error_setg(errp, "No memory");
-        return NULL;
-    }
+    pool = aio_task_pool_new(BITMAP_MAX_WORKERS);
 
-    buf = g_malloc(s->cluster_size);
     limit = bdrv_dirty_bitmap_serialization_coverage(s->cluster_size, bitmap);
-    assert(DIV_ROUND_UP(bm_size, limit) == tb_size);
+    assert(DIV_ROUND_UP(bm_size, limit) == bmco->bitmap_table_size);
 
     offset = 0;
-    while ((offset = bdrv_dirty_bitmap_next_dirty(bitmap, offset, INT64_MAX))
+    while (aio_task_pool_status(pool) == 0 &&
+           (offset = bdrv_dirty_bitmap_next_dirty(bitmap, offset, INT64_MAX))
            >= 0)
     {
         uint64_t cluster = offset / limit;
         uint64_t end, write_size;
         int64_t off;
+        uint8_t *buf;
+        Qcow2BitmapTask *task;
 
         /*
          * We found the first dirty offset, but want to write out the
@@ -1315,6 +1420,14 @@ static uint64_t *store_bitmap_data(BlockDriverState *bs,
          */
         offset = QEMU_ALIGN_DOWN(offset, limit);
         end = MIN(bm_size, offset + limit);
+
+        if (bdrv_dirty_bitmap_next_zero(bitmap, offset, end - offset) < 0) {
+            /* Fully dirty: the table entry alone can describe it */
+            tb[cluster] = BME_TABLE_ENTRY_FLAG_ALL_ONES;
+            offset = end;
+            continue;
+        }
+
         write_size = bdrv_dirty_bitmap_serialization_size(bitmap, offset,
                                                           end - offset);
         assert(write_size <= s->cluster_size);
@@ -1324,42 +1437,97 @@ static uint64_t *store_bitmap_data(BlockDriverState *bs,
             error_setg_errno(errp, -off,
                              "Failed to allocate clusters for bitmap '%s'",
                              bm_name);
-            goto fail;
+            ret = off;
+            break;
         }
         tb[cluster] = off;
 
+        ret = qcow2_pre_write_overlap_check(bs, 0, off, s->cluster_size, false);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
+            break;
+        }
+
+        buf = g_malloc(s->cluster_size);
         bdrv_dirty_bitmap_serialize_part(bitmap, buf, offset, end - offset);
         if (write_size < s->cluster_size) {
             memset(buf + write_size, 0, s->cluster_size - write_size);
         }
 
-        ret = qcow2_pre_write_overlap_check(bs, 0, off, s->cluster_size, false);
-        if (ret < 0) {
-            error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
-            goto fail;
-        }
+        task = g_new(Qcow2BitmapTask, 1);
+        *task = (Qcow2BitmapTask) {
+            .task.func = store_bitmap_data_task_entry,
+            .bs = bs,
+            .bitmap = bitmap,
+            .data_offset = off,
+            .offset = offset,
+            .count = end - offset,
+            .buf = buf,
+        };
+        aio_task_pool_start_task(pool, &task->task);
 
-        ret = bdrv_pwrite(bs->file, off, buf, s->cluster_size);
+        offset = end;
+    }
+
+    aio_task_pool_wait_all(pool);
+    if (ret == 0) {
+        ret = aio_task_pool_status(pool);
         if (ret < 0) {
             error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
                              bm_name);
-            goto fail;
         }
+    }
+    aio_task_pool_free(pool);
 
-        offset = end;
+    bmco->ret = ret;
+}
+
+/* store_bitmap_data()
+ * Store bitmap to image, filling bitmap table accordingly.
+ */
+static uint64_t *store_bitmap_data(BlockDriverState *bs,
+                                   BdrvDirtyBitmap *bitmap,
+                                   uint32_t *bitmap_table_size, Error **errp)
+{
+    int ret;
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
+    const char *bm_name = bdrv_dirty_bitmap_name(bitmap);
+    uint64_t *tb;
+    uint64_t tb_size =
+            size_to_clusters(s,
+                bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
+    Qcow2BitmapCo bmco = {
+        .bs = bs,
+        .bitmap = bitmap,
+        .errp = errp,
+    };
+
+    if (tb_size > BME_MAX_TABLE_SIZE ||
+        tb_size * s->cluster_size > BME_MAX_PHYS_SIZE)
+    {
+        error_setg(errp, "Bitmap '%s' is too big", bm_name);
+        return NULL;
     }
 
-    *bitmap_table_size = tb_size;
-    g_free(buf);
+    tb = g_try_new0(uint64_t, tb_size);
+    if (tb == NULL) {
+        error_setg(errp, "No memory");
+        return NULL;
+    }
 
-    return tb;
+    bmco.bitmap_table = tb;
+    bmco.bitmap_table_size = tb_size;
+    ret = bitmap_co_run(store_bitmap_data_entry, &bmco);
+    if (ret < 0) {
+        clear_bitmap_table(bs, tb, tb_size);
+        g_free(tb);
+        return NULL;
+    }
 
-fail:
-    clear_bitmap_table(bs, tb, tb_size);
-    g_free(buf);
-    g_free(tb);
+    *bitmap_table_size = tb_size;
 
-    return NULL;
+    return tb;
 }
 
 /* store_bitmap()
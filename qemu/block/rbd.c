@@ -18,6 +18,7 @@
 #include "qemu/error-report.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
+#include "qemu/units.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
 #include "crypto/secret.h"
@@ -79,6 +80,33 @@ typedef enum {
     RBD_AIO_WRITE_ZEROES
 } RBDAIOCmd;
 
+/* Requests queued while plugged are submitted once this many are pending */
+#define RBD_MAX_BATCH 32
+
+/* Adjacent requests are not merged beyond this size */
+#define RBD_MAX_MERGE_BYTES (4 * MiB)
+
+typedef struct RBDTask {
+    BlockDriverState *bs;
+    Coroutine *co;
+    bool complete;
+    int64_t ret;
+
+    RBDAIOCmd cmd;
+    uint64_t offset;
+    uint64_t bytes;
+    QEMUIOVector *qiov;
+    QSIMPLEQ_ENTRY(RBDTask) next;
+} RBDTask;
+
+/* A librbd request, issued on behalf of one or more adjacent tasks */
+typedef struct RBDAioReq {
+    QSIMPLEQ_HEAD(, RBDTask) tasks;
+    uint64_t offset;
+    bool merged;        /* allocated by qemu_rbd_submit_pending() */
+    QEMUIOVector qiov;  /* only used if @merged */
+} RBDAioReq;
+
 typedef struct BDRVRBDState {
     rados_t cluster;
     rados_ioctx_t io_ctx;
@@ -88,14 +116,12 @@ typedef struct BDRVRBDState {
     char *namespace;
     uint64_t image_size;
     uint64_t object_size;
-} BDRVRBDState;
 
-typedef struct RBDTask {
-    BlockDriverState *bs;
-    Coroutine *co;
-    bool complete;
-    int64_t ret;
-} RBDTask;
+    EventNotifier e;    /* librbd event socket */
+    bool plugged;
+    unsigned int in_queue;
+    QSIMPLEQ_HEAD(, RBDTask) pending;
+} BDRVRBDState;
 
 typedef struct RBDDiffIterateReq {
     uint64_t offs;
@@ -107,6 +133,9 @@ static int qemu_rbd_connect(rados_t *cluster, rados_ioctx_t *io_ctx,
                             BlockdevOptionsRbd *opts, bool cache,
                             const char *keypairs, const char *secretid,
                             Error **errp);
+static void qemu_rbd_attach_aio_context(BlockDriverState *bs,
+                                        AioContext *new_context);
+static void qemu_rbd_detach_aio_context(BlockDriverState *bs);
 
 static char *qemu_rbd_strchr(char *src, char delim)
 {
@@ -989,12 +1018,31 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
     s->image_size = info.size;
     s->object_size = info.obj_size;
 
+    r = event_notifier_init(&s->e, false);
+    if (r < 0) {
+        error_setg_errno(errp, -r, "failed to initialize event notifier");
+        goto failed_post_open;
+    }
+#ifdef CONFIG_EVENTFD
+    r = rbd_set_image_notification(s->image, event_notifier_get_fd(&s->e),
+                                   EVENT_TYPE_EVENTFD);
+#else
+    r = rbd_set_image_notification(s->image, s->e.wfd, EVENT_TYPE_PIPE);
+#endif
+    if (r < 0) {
+        error_setg_errno(errp, -r, "failed to set up image notification for %s",
+                         s->image_name);
+        goto failed_notifier;
+    }
+    QSIMPLEQ_INIT(&s->pending);
+    qemu_rbd_attach_aio_context(bs, bdrv_get_aio_context(bs));
+
     /* If we are using an rbd snapshot, we must be r/o, otherwise
      * leave as-is */
     if (s->snap != NULL) {
         r = bdrv_apply_auto_read_only(bs, "rbd snapshots are read-only", errp);
         if (r < 0) {
-            goto failed_post_open;
+            goto failed_attached;
         }
     }
 
@@ -1008,6 +1056,10 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
     r = 0;
     goto out;
 
+failed_attached:
+    qemu_rbd_detach_aio_context(bs);
+failed_notifier:
+    event_notifier_cleanup(&s->e);
 failed_post_open:
     rbd_close(s->image);
 failed_open:
@@ -1046,7 +1098,10 @@ static void qemu_rbd_close(BlockDriverState *bs)
 {
     BDRVRBDState *s = bs->opaque;
 
+    assert(QSIMPLEQ_EMPTY(&s->pending));
+    qemu_rbd_detach_aio_context(bs);
     rbd_close(s->image);
+    event_notifier_cleanup(&s->e);
     rados_ioctx_destroy(s->io_ctx);
     g_free(s->snap);
     g_free(s->image_name);
@@ -1069,46 +1124,72 @@ static int qemu_rbd_resize(BlockDriverState *bs, uint64_t size)
     return 0;
 }
 
-static void qemu_rbd_finish_bh(void *opaque)
+/*
+ * Complete all tasks of @req. Must not access @req or its tasks after
+ * waking them up, as both may live on the stack of the woken coroutines.
+ *
+ * When submission fails synchronously, this runs in the coroutine of one
+ * of the tasks. That coroutine is not woken up, it is not waiting: it sees
+ * the task complete and returns the error right away.
+ */
+static void qemu_rbd_complete_req(RBDAioReq *req, int64_t ret)
 {
-    RBDTask *task = opaque;
-    task->complete = true;
-    aio_co_wake(task->co);
+    RBDTask *task, *next_task;
+    bool merged = req->merged;
+
+    QSIMPLEQ_FOREACH_SAFE(task, &req->tasks, next, next_task) {
+        if (ret < 0 || task->cmd != RBD_AIO_READ) {
+            task->ret = ret;
+        } else {
+            /* The number of bytes read, split up between the tasks */
+            int64_t task_ret = ret - (int64_t)(task->offset - req->offset);
+            task->ret = MIN(MAX(task_ret, 0), (int64_t)task->bytes);
+        }
+        task->complete = true;
+        if (task->co != qemu_coroutine_self()) {
+            aio_co_wake(task->co);
+        }
+    }
+
+    if (merged) {
+        qemu_iovec_destroy(&req->qiov);
+        g_free(req);
+    }
 }
 
 /*
- * This is the completion callback function for all rbd aio calls
- * started from qemu_rbd_start_co().
- *
- * Note: this function is being called from a non qemu thread so
- * we need to be careful about what we do here. Generally we only
- * schedule a BH, and do the rest of the io completion handling
- * from qemu_rbd_finish_bh() which runs in a qemu context.
+ * librbd signals completed requests through the image's event socket, so
+ * all of them can be collected at once here, in the AioContext of @bs,
+ * rather than scheduling a BH from a librbd thread for each one.
  */
-static void qemu_rbd_completion_cb(rbd_completion_t c, RBDTask *task)
+static void qemu_rbd_completion_cb(EventNotifier *e)
 {
-    task->ret = rbd_aio_get_return_value(c);
-    rbd_aio_release(c);
-    aio_bh_schedule_oneshot(bdrv_get_aio_context(task->bs),
-                            qemu_rbd_finish_bh, task);
+    BDRVRBDState *s = container_of(e, BDRVRBDState, e);
+    rbd_completion_t comps[RBD_MAX_BATCH];
+    int i, n;
+
+    event_notifier_test_and_clear(e);
+    do {
+        n = rbd_poll_io_events(s->image, comps, RBD_MAX_BATCH);
+        for (i = 0; i < n; i++) {
+            RBDAioReq *req = rbd_aio_get_arg(comps[i]);
+            int64_t ret = rbd_aio_get_return_value(comps[i]);
+
+            rbd_aio_release(comps[i]);
+            qemu_rbd_complete_req(req, ret);
+        }
+    } while (n == RBD_MAX_BATCH);
 }
 
-static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
-                                          uint64_t offset,
-                                          uint64_t bytes,
-                                          QEMUIOVector *qiov,
-                                          int flags,
-                                          RBDAIOCmd cmd)
+static int qemu_rbd_submit(BDRVRBDState *s, RBDAioReq *req, RBDAIOCmd cmd,
+                           uint64_t offset, uint64_t bytes,
+                           QEMUIOVector *qiov, int flags)
 {
-    BDRVRBDState *s = bs->opaque;
-    RBDTask task = { .bs = bs, .co = qemu_coroutine_self() };
     rbd_completion_t c;
     int r;
 
-    assert(!qiov || qiov->size == bytes);
-
-    r = rbd_aio_create_completion(&task,
-                                  (rbd_callback_t) qemu_rbd_completion_cb, &c);
+    /* No callback, completions are collected by qemu_rbd_completion_cb() */
+    r = rbd_aio_create_completion(req, NULL, &c);
     if (r < 0) {
         return r;
     }
@@ -1147,7 +1228,122 @@ static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
                      " bytes %" PRIu64 " flags %d r %d (%s)", cmd, offset,
                      bytes, flags, r, strerror(-r));
         rbd_aio_release(c);
-        return r;
+    }
+
+    return r;
+}
+
+static bool qemu_rbd_can_merge(RBDAioReq *req, RBDTask *task)
+{
+    RBDTask *first = QSIMPLEQ_FIRST(&req->tasks);
+
+    return task->cmd == first->cmd &&
+           task->offset == req->offset + req->qiov.size &&
+           req->qiov.niov + task->qiov->niov <= IOV_MAX &&
+           req->qiov.size + task->bytes <= RBD_MAX_MERGE_BYTES;
+}
+
+/*
+ * Submit the requests queued while plugged, merging adjacent reads and
+ * adjacent writes into a single librbd request each.
+ */
+static void qemu_rbd_submit_pending(BDRVRBDState *s)
+{
+    while (!QSIMPLEQ_EMPTY(&s->pending)) {
+        RBDTask *task = QSIMPLEQ_FIRST(&s->pending);
+        RBDAIOCmd cmd = task->cmd;
+        RBDAioReq *req;
+        int r;
+
+        req = g_new0(RBDAioReq, 1);
+        req->offset = task->offset;
+        req->merged = true;
+        QSIMPLEQ_INIT(&req->tasks);
+        qemu_iovec_init(&req->qiov, task->qiov->niov);
+
+        do {
+            QSIMPLEQ_REMOVE_HEAD(&s->pending, next);
+            s->in_queue--;
+            QSIMPLEQ_INSERT_TAIL(&req->tasks, task, next);
+            qemu_iovec_concat(&req->qiov, task->qiov, 0, task->qiov->size);
+            task = QSIMPLEQ_FIRST(&s->pending);
+        } while (task && qemu_rbd_can_merge(req, task));
+
+        r = qemu_rbd_submit(s, req, cmd, req->offset, req->qiov.size,
+                            &req->qiov, 0);
+        if (r < 0) {
+            qemu_rbd_complete_req(req, r);
+        }
+    }
+}
+
+static void qemu_rbd_detach_aio_context(BlockDriverState *bs)
+{
+    BDRVRBDState *s = bs->opaque;
+
+    aio_set_event_notifier(bdrv_get_aio_context(bs), &s->e, false,
+                           NULL, NULL);
+}
+
+static void qemu_rbd_attach_aio_context(BlockDriverState *bs,
+                                        AioContext *new_context)
+{
+    BDRVRBDState *s = bs->opaque;
+
+    aio_set_event_notifier(new_context, &s->e, false,
+                           qemu_rbd_completion_cb, NULL);
+}
+
+static void qemu_rbd_io_plug(BlockDriverState *bs)
+{
+    BDRVRBDState *s = bs->opaque;
+
+    s->plugged = true;
+}
+
+static void qemu_rbd_io_unplug(BlockDriverState *bs)
+{
+    BDRVRBDState *s = bs->opaque;
+
+    s->plugged = false;
+    qemu_rbd_submit_pending(s);
+}
+
+static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
+                                          uint64_t offset,
+                                          uint64_t bytes,
+                                          QEMUIOVector *qiov,
+                                          int flags,
+                                          RBDAIOCmd cmd)
+{
+    BDRVRBDState *s = bs->opaque;
+    RBDTask task = {
+        .bs = bs,
+        .co = qemu_coroutine_self(),
+        .cmd = cmd,
+        .offset = offset,
+        .bytes = bytes,
+        .qiov = qiov,
+    };
+    RBDAioReq req = { .offset = offset };
+    int r;
+
+    assert(!qiov || qiov->size == bytes);
+
+    if (s->plugged && !flags &&
+        (cmd == RBD_AIO_READ || cmd == RBD_AIO_WRITE))
+    {
+        QSIMPLEQ_INSERT_TAIL(&s->pending, &task, next);
+        if (++s->in_queue >= RBD_MAX_BATCH) {
+            qemu_rbd_submit_pending(s);
+        }
+    } else {
+        QSIMPLEQ_INIT(&req.tasks);
+        QSIMPLEQ_INSERT_TAIL(&req.tasks, &task, next);
+        r = qemu_rbd_submit(s, &req, cmd, offset, bytes, qiov, flags);
+        if (r < 0) {
+            return r;
+        }
     }
 
     while (!task.complete) {
@@ -1607,6 +1803,11 @@ static BlockDriver bdrv_rbd = {
 #endif
     .bdrv_co_block_status   = qemu_rbd_co_block_status,
 
+    .bdrv_attach_aio_context = qemu_rbd_attach_aio_context,
+    .bdrv_detach_aio_context = qemu_rbd_detach_aio_context,
+    .bdrv_io_plug           = qemu_rbd_io_plug,
+    .bdrv_io_unplug         = qemu_rbd_io_unplug,
+
     .bdrv_snapshot_create   = qemu_rbd_snap_create,
     .bdrv_snapshot_delete   = qemu_rbd_snap_remove,
     .bdrv_snapshot_list     = qemu_rbd_snap_list,
@@ -15,6 +15,7 @@
 #include "trace.h"
 #include "block/block_int.h"
 #include "block/blockjob_int.h"
+#include "block/aio_task.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qerror.h"
 #include "qapi/qmp/qdict.h"
@@ -22,14 +23,14 @@
 #include "sysemu/block-backend.h"
 #include "block/copy-on-read.h"
 
-enum {
-    /*
-     * Maximum chunk size to feed to copy-on-read.  This should be
-     * large enough to process multiple clusters in a single call, so
-     * that populating contiguous regions of the image is efficient.
-     */
-    STREAM_CHUNK = 512 * 1024, /* in bytes */
-};
+/* A populate request that failed and waits for the job's error policy */
+typedef struct StreamFailedRequest {
+    int64_t offset;
+    int64_t bytes;
+    int ret;
+    bool retry;     /* policy decided to retry once the job resumes */
+    QSIMPLEQ_ENTRY(StreamFailedRequest) next;
+} StreamFailedRequest;
 
 typedef struct StreamBlockJob {
     BlockJob common;
@@ -40,8 +41,17 @@ typedef struct StreamBlockJob {
     BlockdevOnError on_error;
     char *backing_file_str;
     bool bs_read_only;
+    BlockJobPerf perf;
+    QSIMPLEQ_HEAD(, StreamFailedRequest) failed_requests;
 } StreamBlockJob;
 
+typedef struct StreamTask {
+    AioTask task;
+    StreamBlockJob *s;
+    int64_t offset;
+    int64_t bytes;
+} StreamTask;
+
 static int coroutine_fn stream_populate(BlockBackend *blk,
                                         int64_t offset, uint64_t bytes)
 {
@@ -105,16 +115,61 @@ static void stream_clean(Job *job)
     g_free(s->backing_file_str);
 }
 
+/*
+ * Populate one chunk through the copy-on-read filter.  Failures are not
+ * reported to the pool but queued for stream_run(), as the error policy has
+ * to be applied from the job coroutine.
+ */
+static coroutine_fn int stream_task_entry(AioTask *task)
+{
+    StreamTask *t = container_of(task, StreamTask, task);
+    StreamBlockJob *s = t->s;
+    StreamFailedRequest *req;
+    int ret;
+
+    ret = stream_populate(s->common.blk, t->offset, t->bytes);
+    if (ret < 0) {
+        req = g_new(StreamFailedRequest, 1);
+        *req = (StreamFailedRequest) {
+            .offset = t->offset,
+            .bytes = t->bytes,
+            .ret = ret,
+        };
+        QSIMPLEQ_INSERT_TAIL(&s->failed_requests, req, next);
+        return 0;
+    }
+
+    job_progress_update(&s->common.job, t->bytes);
+    return 0;
+}
+
+static void coroutine_fn stream_start_task(StreamBlockJob *s,
+                                           AioTaskPool *pool,
+                                           int64_t offset, int64_t bytes)
+{
+    StreamTask *t = g_new(StreamTask, 1);
+
+    *t = (StreamTask) {
+        .task.func = stream_task_entry,
+        .s = s,
+        .offset = offset,
+        .bytes = bytes,
+    };
+
+    aio_task_pool_start_task(pool, &t->task);
+}
+
 static int coroutine_fn stream_run(Job *job, Error **errp)
 {
     StreamBlockJob *s = container_of(job, StreamBlockJob, common.job);
-    BlockBackend *blk = s->common.blk;
     BlockDriverState *unfiltered_bs = bdrv_skip_filters(s->target_bs);
     int64_t len;
     int64_t offset = 0;
     uint64_t delay_ns = 0;
     int error = 0;
     int64_t n = 0; /* bytes */
+    AioTaskPool *pool;
+    StreamFailedRequest *req;
 
     if (unfiltered_bs == s->base_overlay) {
         /* Nothing to stream */
@@ -127,21 +182,67 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
     }
     job_progress_set_remaining(&s->common.job, len);
 
-    for ( ; offset < len; offset += n) {
+    pool = aio_task_pool_new(s->perf.max_workers);
+
+    for (;;) {
         bool copy;
         int ret;
 
         /* Note that even when no rate limit is applied we need to yield
-         * with no pending I/O here so that bdrv_drain_all() returns.
+         * here so that bdrv_drain_all() returns.  Requests still in flight
+         * are waited for by the drain itself.
          */
         job_sleep_ns(&s->common.job, delay_ns);
+        delay_ns = 0;
         if (job_is_cancelled(&s->common.job)) {
             break;
         }
 
+        req = QSIMPLEQ_FIRST(&s->failed_requests);
+        if (req && !req->retry) {
+            BlockErrorAction action =
+                block_job_error_action(&s->common, s->on_error, true,
+                                       -req->ret);
+            if (action == BLOCK_ERROR_ACTION_STOP) {
+                /* Retry after the pause point */
+                req->retry = true;
+                continue;
+            }
+            if (error == 0) {
+                error = req->ret;
+            }
+            if (action == BLOCK_ERROR_ACTION_REPORT) {
+                break;
+            }
+            QSIMPLEQ_REMOVE_HEAD(&s->failed_requests, next);
+            job_progress_update(&s->common.job, req->bytes);
+            g_free(req);
+            continue;
+        }
+        if (req) {
+            QSIMPLEQ_REMOVE_HEAD(&s->failed_requests, next);
+            stream_start_task(s, pool, req->offset, req->bytes);
+            delay_ns = block_job_ratelimit_get_delay(&s->common, req->bytes);
+            g_free(req);
+            continue;
+        }
+
+        if (offset >= len) {
+            if (aio_task_pool_empty(pool)) {
+                break;
+            }
+            /* Failed requests may still have to be retried */
+            aio_task_pool_wait_one(pool);
+            continue;
+        }
+
         copy = false;
 
-        ret = bdrv_is_allocated(unfiltered_bs, offset, STREAM_CHUNK, &n);
+        /*
+         * Ask about the whole rest of the image so that areas which need no
+         * copying are skipped in one step.
+         */
+        ret = bdrv_is_allocated(unfiltered_bs, offset, len - offset, &n);
         if (ret == 1) {
             /* Allocated in the top, no need to copy.  */
         } else if (ret >= 0) {
@@ -158,14 +259,10 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
             copy = (ret > 0);
         }
         trace_stream_one_iteration(s, offset, n, ret);
-        if (copy) {
-            ret = stream_populate(blk, offset, n);
-        }
         if (ret < 0) {
             BlockErrorAction action =
                 block_job_error_action(&s->common, s->on_error, true, -ret);
             if (action == BLOCK_ERROR_ACTION_STOP) {
-                n = 0;
                 continue;
             }
             if (error == 0) {
@@ -174,15 +271,29 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
             if (action == BLOCK_ERROR_ACTION_REPORT) {
                 break;
             }
+            /* Without block status there is no size to skip, so go on
+             * with a single chunk */
+            n = MIN(len - offset, s->perf.max_chunk);
+            copy = false;
         }
 
-        /* Publish progress */
-        job_progress_update(&s->common.job, n);
         if (copy) {
+            n = MIN(n, s->perf.max_chunk);
+            stream_start_task(s, pool, offset, n);
             delay_ns = block_job_ratelimit_get_delay(&s->common, n);
         } else {
-            delay_ns = 0;
+            /* Publish progress */
+            job_progress_update(&s->common.job, n);
         }
+        offset += n;
+    }
+
+    aio_task_pool_wait_all(pool);
+    aio_task_pool_free(pool);
+
+    while ((req = QSIMPLEQ_FIRST(&s->failed_requests))) {
+        QSIMPLEQ_REMOVE_HEAD(&s->failed_requests, next);
+        g_free(req);
     }
 
     /* Do not remove the backing file if an error was there but ignored. */
@@ -207,6 +318,7 @@ void stream_start(const char *job_id, BlockDriverState *bs,
                   int creation_flags, int64_t speed,
                   BlockdevOnError on_error,
                   const char *filter_node_name,
+                  BlockJobPerf *perf,
                   Error **errp)
 {
     StreamBlockJob *s = NULL;
@@ -339,6 +451,8 @@ void stream_start(const char *job_id, BlockDriverState *bs,
     s->bs_read_only = bs_read_only;
 
     s->on_error = on_error;
+    s->perf = *perf;
+    QSIMPLEQ_INIT(&s->failed_requests);
     trace_stream_start(bs, base, s);
     job_start(&s->common.job);
     return;
@@ -62,6 +62,7 @@
 #include "qemu/help_option.h"
 #include "qemu/main-loop.h"
 #include "qemu/throttle-options.h"
+#include "qemu/units.h"
 
 QTAILQ_HEAD(, BlockDriverState) monitor_bdrv_states =
     QTAILQ_HEAD_INITIALIZER(monitor_bdrv_states);
@@ -2467,6 +2468,45 @@ void coroutine_fn qmp_block_resize(bool has_device, const char *device,
     bdrv_co_unlock(bs);
 }
 
+/*
+ * Fill @perf with the defaults for block-stream and block-commit, overridden
+ * by whatever the user set in @x_perf.
+ */
+static bool block_job_perf_init(BlockJobPerf *perf, BlockJobPerf *x_perf,
+                                Error **errp)
+{
+    *perf = (BlockJobPerf) {
+        .max_workers = 8,
+        .max_chunk = 512 * KiB,
+    };
+
+    if (x_perf) {
+        if (x_perf->has_max_workers) {
+            perf->max_workers = x_perf->max_workers;
+        }
+        if (x_perf->has_max_chunk) {
+            perf->max_chunk = x_perf->max_chunk;
+        }
+    }
+
+    if (perf->max_workers < 1 || perf->max_workers > INT_MAX) {
+        error_setg(errp, "max-workers must be between 1 and %d", INT_MAX);
+        return false;
+    }
+
+    if (perf->max_chunk < BDRV_SECTOR_SIZE ||
+        perf->max_chunk > BDRV_REQUEST_MAX_BYTES ||
+        !QEMU_IS_ALIGNED(perf->max_chunk, BDRV_SECTOR_SIZE)) {
+        error_setg(errp, "max-chunk must be a multiple of %d between %d and %"
+                   PRId64, BDRV_SECTOR_SIZE, BDRV_SECTOR_SIZE,
+                   (int64_t)QEMU_ALIGN_DOWN(BDRV_REQUEST_MAX_BYTES,
+                                            BDRV_SECTOR_SIZE));
+        return false;
+    }
+
+    return true;
+}
+
 void qmp_block_stream(bool has_job_id, const char *job_id, const char *device,
                       bool has_base, const char *base,
                       bool has_base_node, const char *base_node,
@@ -2477,6 +2517,7 @@ void qmp_block_stream(bool has_job_id, const char *job_id, const char *device,
                       bool has_filter_node_name, const char *filter_node_name,
                       bool has_auto_finalize, bool auto_finalize,
                       bool has_auto_dismiss, bool auto_dismiss,
+                      bool has_x_perf, BlockJobPerf *x_perf,
                       Error **errp)
 {
     BlockDriverState *bs, *iter, *iter_end;
@@ -2484,8 +2525,13 @@ void qmp_block_stream(bool has_job_id, const char *job_id, const char *device,
     BlockDriverState *bottom_bs = NULL;
     AioContext *aio_context;
     Error *local_err = NULL;
+    BlockJobPerf perf;
     int job_flags = JOB_DEFAULT;
 
+    if (!block_job_perf_init(&perf, x_perf, errp)) {
+        return;
+    }
+
     if (has_base && has_base_node) {
         error_setg(errp, "'base' and 'base-node' cannot be specified "
                    "at the same time");
@@ -2590,7 +2636,7 @@ void qmp_block_stream(bool has_job_id, const char *job_id, const char *device,
 
     stream_start(has_job_id ? job_id : NULL, bs, base_bs, backing_file,
                  bottom_bs, job_flags, has_speed ? speed : 0, on_error,
-                 filter_node_name, &local_err);
+                 filter_node_name, &perf, &local_err);
     if (local_err) {
         error_propagate(errp, local_err);
         goto out;
@@ -2613,6 +2659,7 @@ void qmp_block_commit(bool has_job_id, const char *job_id, const char *device,
                       bool has_filter_node_name, const char *filter_node_name,
                       bool has_auto_finalize, bool auto_finalize,
                       bool has_auto_dismiss, bool auto_dismiss,
+                      bool has_x_perf, BlockJobPerf *x_perf,
                       Error **errp)
 {
     BlockDriverState *bs;
@@ -2620,6 +2667,7 @@ void qmp_block_commit(bool has_job_id, const char *job_id, const char *device,
     BlockDriverState *base_bs, *top_bs;
     AioContext *aio_context;
     Error *local_err = NULL;
+    BlockJobPerf perf;
     int job_flags = JOB_DEFAULT;
     uint64_t top_perm, top_shared;
 
@@ -2657,6 +2705,10 @@ void qmp_block_commit(bool has_job_id, const char *job_id, const char *device,
         return;
     }
 
+    if (!block_job_perf_init(&perf, x_perf, errp)) {
+        return;
+    }
+
     aio_context = bdrv_get_aio_context(bs);
     aio_context_acquire(aio_context);
 
@@ -2780,7 +2832,7 @@ void qmp_block_commit(bool has_job_id, const char *job_id, const char *device,
         }
         commit_start(has_job_id ? job_id : NULL, bs, base_bs, top_bs, job_flags,
                      speed, on_error, has_backing_file ? backing_file : NULL,
-                     filter_node_name, &local_err);
+                     filter_node_name, &perf, &local_err);
     }
     if (local_err != NULL) {
         error_propagate(errp, local_err);
@@ -622,6 +622,8 @@ static void vfio_msi_enable(VFIOPCIDevice *vdev)
 retry:
     vdev->msi_vectors = g_new0(VFIOMSIVector, vdev->nr_vectors);
 
+    /* Push the KVM routes of all vectors at once, before enabling them */
+    kvm_irqchip_begin_route_changes(kvm_state);
     for (i = 0; i < vdev->nr_vectors; i++) {
         VFIOMSIVector *vector = &vdev->msi_vectors[i];
 
@@ -642,6 +644,7 @@ retry:
          */
         vfio_add_kvm_msi_virq(vdev, vector, i, false);
     }
+    kvm_irqchip_commit_route_changes(kvm_state);
 
     /* Set interrupt type prior to possible interrupts */
     vdev->interrupt = VFIO_INT_MSI;
@@ -736,6 +736,8 @@ static int kvm_virtio_pci_vector_use(VirtIOPCIProxy *proxy, int nvqs)
     unsigned int vector;
     int ret, queue_no;
 
+    /* Push all new routes to KVM at once */
+    kvm_irqchip_begin_route_changes(kvm_state);
     for (queue_no = 0; queue_no < nvqs; queue_no++) {
         if (!virtio_queue_get_num(vdev, queue_no)) {
             break;
@@ -759,6 +761,7 @@ static int kvm_virtio_pci_vector_use(VirtIOPCIProxy *proxy, int nvqs)
             }
         }
     }
+    kvm_irqchip_commit_route_changes(kvm_state);
     return 0;
 
 undo:
@@ -772,6 +775,7 @@ undo:
         }
         kvm_virtio_pci_vq_vector_release(proxy, vector);
     }
+    kvm_irqchip_commit_route_changes(kvm_state);
     return ret;
 }
 
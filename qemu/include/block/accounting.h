@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-builtin-types.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -78,6 +79,29 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
+/*
+ * Fixed-layout histograms that are always collected, independent of the
+ * user-configurable @BlockLatencyHistogram above.  They are updated with
+ * atomic counters only, so they are cheap enough to keep enabled and can be
+ * read without taking @BlockAcctStats.lock.
+ *
+ * Requests are split into size classes [0, 4K], (4K, 16K], (16K, 64K],
+ * (64K, 256K], (256K, 1M] and (1M, +inf).  Latency bin 0 counts requests
+ * that took less than 1 microsecond, bin N > 0 those that took
+ * [2^(N-1), 2^N) microseconds; the last bin is unbounded.  The queue depth
+ * histogram counts how many requests of any type the BlockBackend already
+ * had in flight at submission time, using the same power-of-two binning.
+ */
+#define BLOCK_ACCT_SIZE_CLASSES     6
+#define BLOCK_ACCT_SIZE_CLASS_MIN   (4 * 1024)
+#define BLOCK_ACCT_LATENCY_BINS     24
+#define BLOCK_ACCT_DEPTH_BINS       10
+
+typedef struct BlockAcctDetailedStats {
+    Stat64 latency[BLOCK_ACCT_SIZE_CLASSES][BLOCK_ACCT_LATENCY_BINS];
+    Stat64 queue_depth[BLOCK_ACCT_DEPTH_BINS];
+} BlockAcctDetailedStats;
+
 struct BlockAcctStats {
     QemuMutex lock;
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
@@ -91,6 +115,8 @@ struct BlockAcctStats {
     bool account_invalid;
     bool account_failed;
     BlockLatencyHistogram latency_histogram[BLOCK_MAX_IOTYPE];
+    const unsigned int *in_flight;
+    BlockAcctDetailedStats detailed[BLOCK_MAX_IOTYPE];
 };
 
 typedef struct BlockAcctCookie {
@@ -99,7 +125,7 @@ typedef struct BlockAcctCookie {
     enum BlockAcctType type;
 } BlockAcctCookie;
 
-void block_acct_init(BlockAcctStats *stats);
+void block_acct_init(BlockAcctStats *stats, const unsigned int *in_flight);
 void block_acct_setup(BlockAcctStats *stats, bool account_invalid,
                      bool account_failed);
 void block_acct_cleanup(BlockAcctStats *stats);
@@ -119,5 +145,6 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+uint64_t block_acct_size_class_limit(int size_class);
 
 #endif
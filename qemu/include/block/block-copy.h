@@ -91,6 +91,9 @@ void block_copy_call_cancel(BlockCopyCallState *call_state);
 
 BdrvDirtyBitmap *block_copy_dirty_bitmap(BlockCopyState *s);
 int64_t block_copy_cluster_size(BlockCopyState *s);
+void block_copy_get_stats(BlockCopyState *s, uint64_t *data_bytes,
+                          uint64_t *zero_bytes);
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip);
+void block_copy_set_detect_zeroes(BlockCopyState *s, bool detect);
 
 #endif /* BLOCK_COPY_H */
@@ -54,6 +54,12 @@ struct BlockJobDriver {
     void (*attached_aio_context)(BlockJob *job, AioContext *new_context);
 
     void (*set_speed)(BlockJob *job, int64_t speed);
+
+    /*
+     * If the callback is not NULL, it will be invoked from block_job_query()
+     * to fill in job type specific information.
+     */
+    void (*query)(BlockJob *job, BlockJobInfo *info);
 };
 
 /**
@@ -45,6 +45,12 @@ typedef struct BlockExportDriver {
      * shutting down.
      */
     void (*request_shutdown)(BlockExport *);
+
+    /*
+     * Fills in the driver-specific part of @info for query-block-exports.
+     * Optional.
+     */
+    void (*query)(BlockExport *, BlockExportInfo *info);
 } BlockExportDriver;
 
 struct BlockExport {
@@ -334,9 +334,15 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
 }
 
 #if !defined(_WIN32)
-static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
-                                                          ram_addr_t start,
-                                                          ram_addr_t pages)
+/*
+ * Pages counted for the dirty rate calculation are added to @dirty_pages,
+ * so that callers running outside the BQL can sum them up themselves.
+ */
+static inline void
+cpu_physical_memory_set_dirty_lebitmap_count(unsigned long *bitmap,
+                                             ram_addr_t start,
+                                             ram_addr_t pages,
+                                             uint64_t *dirty_pages)
 {
     unsigned long i, j;
     unsigned long page_number, c;
@@ -377,7 +383,7 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
                                 temp);
                         if (unlikely(
                             global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
-                            total_dirty_pages += ctpopl(temp);
+                            *dirty_pages += ctpopl(temp);
                         }
                     }
 
@@ -410,7 +416,7 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
             if (bitmap[i] != 0) {
                 c = leul_to_cpu(bitmap[i]);
                 if (unlikely(global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
-                    total_dirty_pages += ctpopl(c);
+                    *dirty_pages += ctpopl(c);
                 }
                 do {
                     j = ctzl(c);
@@ -425,6 +431,14 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
         }
     }
 }
+
+static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
+                                                          ram_addr_t start,
+                                                          ram_addr_t pages)
+{
+    cpu_physical_memory_set_dirty_lebitmap_count(bitmap, start, pages,
+                                                 &total_dirty_pages);
+}
 #endif /* not _WIN32 */
 
 bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
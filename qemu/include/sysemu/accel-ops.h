@@ -35,6 +35,9 @@ struct AccelOpsClass {
     void (*synchronize_post_init)(CPUState *cpu);
     void (*synchronize_state)(CPUState *cpu);
     void (*synchronize_pre_loadvm)(CPUState *cpu);
+    /* Optional, otherwise the per-CPU hooks are called for each CPU */
+    void (*synchronize_all_post_reset)(void);
+    void (*synchronize_all_post_init)(void);
 
     void (*handle_interrupt)(CPUState *cpu, int mask);
 
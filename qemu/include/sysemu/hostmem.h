@@ -18,6 +18,7 @@
 #include "qom/object.h"
 #include "exec/memory.h"
 #include "qemu/bitmap.h"
+#include "qemu/thread.h"
 
 #define TYPE_MEMORY_BACKEND "memory-backend"
 OBJECT_DECLARE_TYPE(HostMemoryBackend, HostMemoryBackendClass,
@@ -56,6 +57,7 @@ struct HostMemoryBackendClass {
  * @size: amount of memory backend provides
  * @mr: MemoryRegion representing host memory belonging to backend
  * @prealloc_threads: number of threads to be used for preallocatining RAM
+ * @prealloc_async: preallocate in the background, also while the guest runs
  */
 struct HostMemoryBackend {
     /* private */
@@ -65,7 +67,12 @@ struct HostMemoryBackend {
     uint64_t size;
     bool merge, dump, use_canonical_path;
     bool prealloc, is_mapped, share, reserve;
+    bool prealloc_async, prealloc_pending;
     uint32_t prealloc_threads;
+    QemuThread prealloc_thread;
+    QEMUBH *prealloc_bh;
+    int64_t prealloc_ns;
+    Error *prealloc_err;
     DECLARE_BITMAP(host_nodes, MAX_NODES + 1);
     HostMemPolicy policy;
 
@@ -79,5 +86,9 @@ void host_memory_backend_set_mapped(HostMemoryBackend *backend, bool mapped);
 bool host_memory_backend_is_mapped(HostMemoryBackend *backend);
 size_t host_memory_backend_pagesize(HostMemoryBackend *memdev);
 char *host_memory_backend_get_name(HostMemoryBackend *backend);
+bool host_memory_backend_can_prealloc_range(HostMemoryBackend *backend);
+void host_memory_backend_prealloc_range(HostMemoryBackend *backend,
+                                        uint64_t offset, uint64_t size,
+                                        Error **errp);
 
 #endif
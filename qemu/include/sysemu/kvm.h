@@ -481,6 +481,26 @@ int kvm_irqchip_update_msi_route(KVMState *s, int virq, MSIMessage msg,
 void kvm_irqchip_commit_routes(KVMState *s);
 void kvm_irqchip_release_virq(KVMState *s, int virq);
 
+/**
+ * kvm_irqchip_begin_route_changes - Start a batch of routing changes
+ * @s:      KVM state
+ *
+ * Until the matching kvm_irqchip_commit_route_changes(), calls to
+ * kvm_irqchip_commit_routes() only record that the routing table needs
+ * to be pushed to KVM.  Batches may nest; the table is pushed once when
+ * the outermost batch is committed.
+ */
+void kvm_irqchip_begin_route_changes(KVMState *s);
+
+/**
+ * kvm_irqchip_commit_route_changes - End a batch of routing changes
+ * @s:      KVM state
+ *
+ * Push the routing table to KVM if this ends the outermost batch and the
+ * table was changed since it was last pushed.
+ */
+void kvm_irqchip_commit_route_changes(KVMState *s);
+
 int kvm_irqchip_add_adapter_route(KVMState *s, AdapterInfo *adapter);
 int kvm_irqchip_add_hv_sint_route(KVMState *s, uint32_t vcpu, uint32_t sint);
 
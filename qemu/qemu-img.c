@@ -201,6 +201,10 @@ static void QEMU_NORETURN help(void)
            "       process (defaults to 8)\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
            "\n"
+           "Parameters to rebase subcommand:\n"
+           "  '-m' specifies how many coroutines work in parallel during the rebase\n"
+           "       process (defaults to 8)\n"
+           "\n"
            "Parameters to snapshot subcommand:\n"
            "  'snapshot' is the name of the snapshot to create, apply or delete\n"
            "  '-a' applies a snapshot (revert disk to saved state)\n"
@@ -212,6 +216,8 @@ static void QEMU_NORETURN help(void)
            "  '-f' first image format\n"
            "  '-F' second image format\n"
            "  '-s' run in Strict mode - fail on different image size or sector allocation\n"
+           "  '-m' specifies how many coroutines work in parallel during the compare\n"
+           "       process (defaults to 8)\n"
            "\n"
            "Parameters to dd subcommand:\n"
            "  'bs=BYTES' read and write up to BYTES bytes at a time "
@@ -1132,6 +1138,11 @@ static int64_t find_nonzero(const uint8_t *buf, int64_t n)
     int64_t i;
     int64_t end = QEMU_ALIGN_DOWN(n, BDRV_SECTOR_SIZE);
 
+    /* Checking the whole buffer at once is much faster in the common case */
+    if (buffer_is_zero(buf, n)) {
+        return -1;
+    }
+
     for (i = 0; i < end; i += BDRV_SECTOR_SIZE) {
         if (!buffer_is_zero(buf + i, BDRV_SECTOR_SIZE)) {
             return i;
@@ -1250,6 +1261,12 @@ static int compare_buffers(const uint8_t *buf1, const uint8_t *buf2,
 
     assert(bytes > 0);
 
+    /* Identical buffers are the common case, compare them in one go */
+    if (!memcmp(buf1, buf2, bytes)) {
+        *pnum = bytes;
+        return 0;
+    }
+
     res = !!memcmp(buf1, buf2, i);
     while (i < bytes) {
         int64_t len = MIN(bytes - i, BDRV_SECTOR_SIZE);
@@ -1265,43 +1282,240 @@ static int compare_buffers(const uint8_t *buf1, const uint8_t *buf2,
 }
 
 #define IO_BUF_SIZE (2 * MiB)
+#define MAX_COROUTINES 16
+
+typedef struct ImgCompareState {
+    BlockBackend *blk1, *blk2;
+    const char *filename1, *filename2;
+    int64_t total_size1, total_size2;
+    int64_t total_size;     /* size of the common area */
+    int64_t progress_base;  /* size of the larger image */
+    bool strict;
+    bool quiet;
+    int running_coroutines;
+    CoMutex lock;
+    int64_t offset;         /* next offset to check, protected by @lock */
+
+    /*
+     * Chunks are compared out of order, so the first failure is only
+     * known once all earlier chunks are done. Keep the one at the lowest
+     * offset and report it at the end.
+     */
+    int64_t fail_offset;    /* INT64_MAX if nothing failed */
+    int fail_ret;
+    bool fail_is_error;     /* report as error rather than as result */
+    char *fail_msg;
+} ImgCompareState;
+
+static void GCC_FMT_ATTR(5, 6)
+img_compare_fail(ImgCompareState *s, int64_t offset, int ret, bool is_error,
+                 const char *fmt, ...)
+{
+    va_list ap;
+
+    if (offset >= s->fail_offset) {
+        return;
+    }
+
+    s->fail_offset = offset;
+    s->fail_ret = ret;
+    s->fail_is_error = is_error;
+    g_free(s->fail_msg);
+    va_start(ap, fmt);
+    s->fail_msg = g_strdup_vprintf(fmt, ap);
+    va_end(ap);
+}
+
+static int coroutine_fn img_compare_read(ImgCompareState *s, BlockBackend *blk,
+                                         const char *filename, int64_t offset,
+                                         int64_t bytes, uint8_t *buf)
+{
+    int ret = blk_co_pread(blk, offset, bytes, buf, 0);
+
+    if (ret < 0) {
+        img_compare_fail(s, offset, 4, true,
+                         "Error while reading offset %" PRId64 " of %s: %s",
+                         offset, filename, strerror(-ret));
+    }
+    return ret;
+}
 
 /*
- * Check if passed sectors are empty (not allocated or contain only 0 bytes)
- *
- * Intended for use by 'qemu-img compare': Returns 0 in case sectors are
- * filled with 0, 1 if sectors contain non-zero data (this is a comparison
- * failure), and 4 on error (the exit status for read errors), after emitting
- * an error message.
- *
- * @param blk:  BlockBackend for the image
- * @param offset: Starting offset to check
- * @param bytes: Number of bytes to check
- * @param filename: Name of disk file we are checking (logging purpose)
- * @param buffer: Allocated buffer for storing read data
- * @param quiet: Flag for quiet mode
+ * Check that the passed range only contains zero bytes, recording a content
+ * mismatch at the first non-zero byte otherwise. @buf must be large enough
+ * for @bytes.
  */
-static int check_empty_sectors(BlockBackend *blk, int64_t offset,
-                               int64_t bytes, const char *filename,
-                               uint8_t *buffer, bool quiet)
+static void coroutine_fn img_compare_check_empty(ImgCompareState *s,
+                                                 BlockBackend *blk,
+                                                 const char *filename,
+                                                 int64_t offset, int64_t bytes,
+                                                 uint8_t *buf)
 {
-    int ret = 0;
     int64_t idx;
 
-    ret = blk_pread(blk, offset, buffer, bytes);
-    if (ret < 0) {
-        error_report("Error while reading offset %" PRId64 " of %s: %s",
-                     offset, filename, strerror(-ret));
-        return 4;
+    if (img_compare_read(s, blk, filename, offset, bytes, buf) < 0) {
+        return;
     }
-    idx = find_nonzero(buffer, bytes);
+    idx = find_nonzero(buf, bytes);
     if (idx >= 0) {
-        qprintf(quiet, "Content mismatch at offset %" PRId64 "!\n",
-                offset + idx);
-        return 1;
+        img_compare_fail(s, offset + idx, 1, false,
+                         "Content mismatch at offset %" PRId64 "!",
+                         offset + idx);
     }
+}
 
-    return 0;
+/*
+ * Query the block status at s->offset and decide how the chunk starting
+ * there must be checked. Returns the chunk length; *blk_a and *blk_b are
+ * the images to read (both for a comparison, one for an emptiness check,
+ * none if the chunk can be skipped). Returns 0 after recording a failure.
+ *
+ * Called with s->lock held.
+ */
+static int64_t coroutine_fn img_compare_next_chunk(ImgCompareState *s,
+                                                   BlockBackend **blk_a,
+                                                   BlockBackend **blk_b)
+{
+    int64_t offset = s->offset;
+    int64_t pnum1, pnum2, chunk;
+    int status1, status2;
+    bool allocated1, allocated2;
+
+    *blk_a = *blk_b = NULL;
+
+    if (offset >= s->total_size) {
+        /* Only the larger image is left */
+        BlockBackend *blk_over;
+        const char *filename_over;
+        int ret;
+
+        if (s->total_size1 > s->total_size2) {
+            blk_over = s->blk1;
+            filename_over = s->filename1;
+        } else {
+            blk_over = s->blk2;
+            filename_over = s->filename2;
+        }
+
+        ret = bdrv_block_status_above(blk_bs(blk_over), NULL, offset,
+                                      s->progress_base - offset, &chunk,
+                                      NULL, NULL);
+        if (ret < 0) {
+            img_compare_fail(s, offset, 3, true,
+                             "Sector allocation test failed for %s",
+                             filename_over);
+            return 0;
+        }
+        if (ret & BDRV_BLOCK_ALLOCATED && !(ret & BDRV_BLOCK_ZERO)) {
+            *blk_a = blk_over;
+            chunk = MIN(chunk, IO_BUF_SIZE);
+        }
+        return chunk;
+    }
+
+    status1 = bdrv_block_status_above(blk_bs(s->blk1), NULL, offset,
+                                      s->total_size1 - offset, &pnum1, NULL,
+                                      NULL);
+    if (status1 < 0) {
+        img_compare_fail(s, offset, 3, true,
+                         "Sector allocation test failed for %s", s->filename1);
+        return 0;
+    }
+    allocated1 = status1 & BDRV_BLOCK_ALLOCATED;
+
+    status2 = bdrv_block_status_above(blk_bs(s->blk2), NULL, offset,
+                                      s->total_size2 - offset, &pnum2, NULL,
+                                      NULL);
+    if (status2 < 0) {
+        img_compare_fail(s, offset, 3, true,
+                         "Sector allocation test failed for %s", s->filename2);
+        return 0;
+    }
+    allocated2 = status2 & BDRV_BLOCK_ALLOCATED;
+
+    assert(pnum1 && pnum2);
+    chunk = MIN(pnum1, pnum2);
+
+    if (s->strict) {
+        if (status1 != status2) {
+            img_compare_fail(s, offset, 1, false, "Strict mode: Offset %" PRId64
+                             " block status mismatch!", offset);
+            return 0;
+        }
+    }
+    if ((status1 & BDRV_BLOCK_ZERO) && (status2 & BDRV_BLOCK_ZERO)) {
+        /* nothing to do */
+    } else if (allocated1 == allocated2) {
+        if (allocated1) {
+            *blk_a = s->blk1;
+            *blk_b = s->blk2;
+            chunk = MIN(chunk, IO_BUF_SIZE);
+        }
+    } else {
+        *blk_a = allocated1 ? s->blk1 : s->blk2;
+        chunk = MIN(chunk, IO_BUF_SIZE);
+    }
+
+    return chunk;
+}
+
+static void coroutine_fn img_compare_co(void *opaque)
+{
+    ImgCompareState *s = opaque;
+    uint8_t *buf1, *buf2;
+
+    s->running_coroutines++;
+    buf1 = blk_blockalign(s->blk1, IO_BUF_SIZE);
+    buf2 = blk_blockalign(s->blk2, IO_BUF_SIZE);
+
+    while (1) {
+        BlockBackend *blk_a, *blk_b;
+        int64_t offset, chunk;
+
+        qemu_co_mutex_lock(&s->lock);
+        offset = s->offset;
+        if (offset >= MIN(s->progress_base, s->fail_offset)) {
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+        chunk = img_compare_next_chunk(s, &blk_a, &blk_b);
+        if (chunk == 0) {
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+        s->offset += chunk;
+        qemu_co_mutex_unlock(&s->lock);
+
+        if (blk_a && blk_b) {
+            int64_t pnum;
+            int ret;
+
+            if (img_compare_read(s, s->blk1, s->filename1, offset, chunk,
+                                 buf1) < 0 ||
+                img_compare_read(s, s->blk2, s->filename2, offset, chunk,
+                                 buf2) < 0)
+            {
+                break;
+            }
+            ret = compare_buffers(buf1, buf2, chunk, &pnum);
+            if (ret || pnum != chunk) {
+                img_compare_fail(s, offset + (ret ? 0 : pnum), 1, false,
+                                 "Content mismatch at offset %" PRId64 "!",
+                                 offset + (ret ? 0 : pnum));
+                break;
+            }
+        } else if (blk_a) {
+            img_compare_check_empty(s, blk_a,
+                                    blk_a == s->blk1 ? s->filename1
+                                                     : s->filename2,
+                                    offset, chunk, buf1);
+        }
+        qemu_progress_print(((float) chunk / s->progress_base) * 100, 100);
+    }
+
+    qemu_vfree(buf1);
+    qemu_vfree(buf2);
+    s->running_coroutines--;
 }
 
 /*
@@ -1315,22 +1529,16 @@ static int img_compare(int argc, char **argv)
 {
     const char *fmt1 = NULL, *fmt2 = NULL, *cache, *filename1, *filename2;
     BlockBackend *blk1, *blk2;
-    BlockDriverState *bs1, *bs2;
     int64_t total_size1, total_size2;
-    uint8_t *buf1 = NULL, *buf2 = NULL;
-    int64_t pnum1, pnum2;
-    int allocated1, allocated2;
     int ret = 0; /* return value - 0 Ident, 1 Different, >1 Error */
     bool progress = false, quiet = false, strict = false;
     int flags;
     bool writethrough;
-    int64_t total_size;
-    int64_t offset = 0;
-    int64_t chunk;
-    int c;
-    uint64_t progress_base;
+    int c, i;
+    long num_coroutines = 8;
     bool image_opts = false;
     bool force_share = false;
+    ImgCompareState s;
 
     cache = BDRV_DEFAULT_CACHE;
     for (;;) {
@@ -1341,7 +1549,7 @@ static int img_compare(int argc, char **argv)
             {"force-share", no_argument, 0, 'U'},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, ":hf:F:T:pqsU",
+        c = getopt_long(argc, argv, ":hf:F:T:m:pqsU",
                         long_options, NULL);
         if (c == -1) {
             break;
@@ -1365,6 +1573,14 @@ static int img_compare(int argc, char **argv)
         case 'T':
             cache = optarg;
             break;
+        case 'm':
+            if (qemu_strtol(optarg, NULL, 0, &num_coroutines) ||
+                num_coroutines < 1 || num_coroutines > MAX_COROUTINES) {
+                error_report("Invalid number of coroutines. Allowed number of"
+                             " coroutines is between 1 and %d", MAX_COROUTINES);
+                return 2;
+            }
+            break;
         case 'p':
             progress = true;
             break;
@@ -1434,11 +1650,7 @@ static int img_compare(int argc, char **argv)
         ret = 2;
         goto out2;
     }
-    bs1 = blk_bs(blk1);
-    bs2 = blk_bs(blk2);
 
-    buf1 = blk_blockalign(blk1, IO_BUF_SIZE);
-    buf2 = blk_blockalign(blk2, IO_BUF_SIZE);
     total_size1 = blk_getlength(blk1);
     if (total_size1 < 0) {
         error_report("Can't get size of %s: %s",
@@ -1453,8 +1665,6 @@ static int img_compare(int argc, char **argv)
         ret = 4;
         goto out;
     }
-    total_size = MIN(total_size1, total_size2);
-    progress_base = MAX(total_size1, total_size2);
 
     qemu_progress_print(0, 100);
 
@@ -1464,131 +1674,47 @@ static int img_compare(int argc, char **argv)
         goto out;
     }
 
-    while (offset < total_size) {
-        int status1, status2;
-
-        status1 = bdrv_block_status_above(bs1, NULL, offset,
-                                          total_size1 - offset, &pnum1, NULL,
-                                          NULL);
-        if (status1 < 0) {
-            ret = 3;
-            error_report("Sector allocation test failed for %s", filename1);
-            goto out;
-        }
-        allocated1 = status1 & BDRV_BLOCK_ALLOCATED;
-
-        status2 = bdrv_block_status_above(bs2, NULL, offset,
-                                          total_size2 - offset, &pnum2, NULL,
-                                          NULL);
-        if (status2 < 0) {
-            ret = 3;
-            error_report("Sector allocation test failed for %s", filename2);
-            goto out;
-        }
-        allocated2 = status2 & BDRV_BLOCK_ALLOCATED;
-
-        assert(pnum1 && pnum2);
-        chunk = MIN(pnum1, pnum2);
-
-        if (strict) {
-            if (status1 != status2) {
-                ret = 1;
-                qprintf(quiet, "Strict mode: Offset %" PRId64
-                        " block status mismatch!\n", offset);
-                goto out;
-            }
-        }
-        if ((status1 & BDRV_BLOCK_ZERO) && (status2 & BDRV_BLOCK_ZERO)) {
-            /* nothing to do */
-        } else if (allocated1 == allocated2) {
-            if (allocated1) {
-                int64_t pnum;
+    s = (ImgCompareState) {
+        .blk1 = blk1,
+        .blk2 = blk2,
+        .filename1 = filename1,
+        .filename2 = filename2,
+        .total_size1 = total_size1,
+        .total_size2 = total_size2,
+        .total_size = MIN(total_size1, total_size2),
+        .progress_base = MAX(total_size1, total_size2),
+        .strict = strict,
+        .quiet = quiet,
+        .fail_offset = INT64_MAX,
+    };
+    qemu_co_mutex_init(&s.lock);
 
-                chunk = MIN(chunk, IO_BUF_SIZE);
-                ret = blk_pread(blk1, offset, buf1, chunk);
-                if (ret < 0) {
-                    error_report("Error while reading offset %" PRId64
-                                 " of %s: %s",
-                                 offset, filename1, strerror(-ret));
-                    ret = 4;
-                    goto out;
-                }
-                ret = blk_pread(blk2, offset, buf2, chunk);
-                if (ret < 0) {
-                    error_report("Error while reading offset %" PRId64
-                                 " of %s: %s",
-                                 offset, filename2, strerror(-ret));
-                    ret = 4;
-                    goto out;
-                }
-                ret = compare_buffers(buf1, buf2, chunk, &pnum);
-                if (ret || pnum != chunk) {
-                    qprintf(quiet, "Content mismatch at offset %" PRId64 "!\n",
-                            offset + (ret ? 0 : pnum));
-                    ret = 1;
-                    goto out;
-                }
-            }
-        } else {
-            chunk = MIN(chunk, IO_BUF_SIZE);
-            if (allocated1) {
-                ret = check_empty_sectors(blk1, offset, chunk,
-                                          filename1, buf1, quiet);
-            } else {
-                ret = check_empty_sectors(blk2, offset, chunk,
-                                          filename2, buf1, quiet);
-            }
-            if (ret) {
-                goto out;
-            }
-        }
-        offset += chunk;
-        qemu_progress_print(((float) chunk / progress_base) * 100, 100);
+    for (i = 0; i < num_coroutines; i++) {
+        qemu_coroutine_enter(qemu_coroutine_create(img_compare_co, &s));
+    }
+    while (s.running_coroutines) {
+        main_loop_wait(false);
     }
 
-    if (total_size1 != total_size2) {
-        BlockBackend *blk_over;
-        const char *filename_over;
-
+    if (total_size1 != total_size2 && s.fail_offset >= s.total_size) {
         qprintf(quiet, "Warning: Image size mismatch!\n");
-        if (total_size1 > total_size2) {
-            blk_over = blk1;
-            filename_over = filename1;
-        } else {
-            blk_over = blk2;
-            filename_over = filename2;
-        }
-
-        while (offset < progress_base) {
-            ret = bdrv_block_status_above(blk_bs(blk_over), NULL, offset,
-                                          progress_base - offset, &chunk,
-                                          NULL, NULL);
-            if (ret < 0) {
-                ret = 3;
-                error_report("Sector allocation test failed for %s",
-                             filename_over);
-                goto out;
+    }
 
-            }
-            if (ret & BDRV_BLOCK_ALLOCATED && !(ret & BDRV_BLOCK_ZERO)) {
-                chunk = MIN(chunk, IO_BUF_SIZE);
-                ret = check_empty_sectors(blk_over, offset, chunk,
-                                          filename_over, buf1, quiet);
-                if (ret) {
-                    goto out;
-                }
-            }
-            offset += chunk;
-            qemu_progress_print(((float) chunk / progress_base) * 100, 100);
+    if (s.fail_offset != INT64_MAX) {
+        if (s.fail_is_error) {
+            error_report("%s", s.fail_msg);
+        } else {
+            qprintf(quiet, "%s\n", s.fail_msg);
         }
+        ret = s.fail_ret;
+        g_free(s.fail_msg);
+        goto out;
     }
 
     qprintf(quiet, "Images are identical.\n");
     ret = 0;
 
 out:
-    qemu_vfree(buf1);
-    qemu_vfree(buf2);
     blk_unref(blk2);
 out2:
     blk_unref(blk1);
@@ -1620,7 +1746,6 @@ enum ImgConvertBlockStatus {
     BLK_BACKING_FILE,
 };
 
-#define MAX_COROUTINES 16
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
 typedef struct ImgConvertState {
@@ -3132,6 +3257,66 @@ static inline bool entry_mergeable(const MapEntry *curr, const MapEntry *next)
     return true;
 }
 
+/*
+ * img_map() prefetches block status with several coroutines. Each one
+ * handles every num_workers'th segment of the image and waits for its
+ * entries to be printed before going on with the next one.
+ */
+#define MAP_SEGMENT_SIZE (1 * GiB)
+
+typedef struct ImgMapState ImgMapState;
+
+typedef struct ImgMapWorker {
+    ImgMapState *s;
+    Coroutine *co;      /* NULL once the worker has finished */
+    int64_t segment;
+    GArray *entries;    /* MapEntry list of @segment */
+    int ret;
+    bool done;          /* @entries is complete and waits to be printed */
+} ImgMapWorker;
+
+struct ImgMapState {
+    BlockDriverState *bs;
+    int64_t start;
+    int64_t end;
+    int64_t nb_segments;
+    int num_workers;
+    bool quit;
+    ImgMapWorker workers[MAX_COROUTINES];
+};
+
+static void coroutine_fn img_map_co(void *opaque)
+{
+    ImgMapWorker *w = opaque;
+    ImgMapState *s = w->s;
+
+    for (; w->segment < s->nb_segments; w->segment += s->num_workers) {
+        int64_t offset = s->start + w->segment * MAP_SEGMENT_SIZE;
+        int64_t end = MIN(s->end, offset + MAP_SEGMENT_SIZE);
+
+        g_array_set_size(w->entries, 0);
+        w->ret = 0;
+        while (offset < end) {
+            MapEntry e;
+
+            w->ret = get_block_status(s->bs, offset, end - offset, &e);
+            if (w->ret < 0) {
+                break;
+            }
+            g_array_append_val(w->entries, e);
+            offset += e.length;
+        }
+
+        w->done = true;
+        qemu_coroutine_yield();
+        if (s->quit) {
+            break;
+        }
+    }
+
+    w->co = NULL;
+}
+
 static int img_map(int argc, char **argv)
 {
     int c;
@@ -3140,12 +3325,16 @@ static int img_map(int argc, char **argv)
     BlockDriverState *bs;
     const char *filename, *fmt, *output;
     int64_t length;
-    MapEntry curr = { .length = 0 }, next;
+    MapEntry curr = { .length = 0 };
     int ret = 0;
     bool image_opts = false;
     bool force_share = false;
     int64_t start_offset = 0;
     int64_t max_length = -1;
+    long num_coroutines = 8;
+    ImgMapState s = { 0 };
+    int64_t segment;
+    int i;
 
     fmt = NULL;
     output = NULL;
@@ -3162,7 +3351,7 @@ static int img_map(int argc, char **argv)
             {"max-length", required_argument, 0, 'l'},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, ":f:s:l:hU",
+        c = getopt_long(argc, argv, ":f:s:l:m:hU",
                         long_options, &option_index);
         if (c == -1) {
             break;
@@ -3198,6 +3387,14 @@ static int img_map(int argc, char **argv)
                 return 1;
             }
             break;
+        case 'm':
+            if (qemu_strtol(optarg, NULL, 0, &num_coroutines) ||
+                num_coroutines < 1 || num_coroutines > MAX_COROUTINES) {
+                error_report("Invalid number of coroutines. Allowed number of"
+                             " coroutines is between 1 and %d", MAX_COROUTINES);
+                return 1;
+            }
+            break;
         case OPTION_OBJECT:
             user_creatable_process_cmdline(optarg);
             break;
@@ -3241,29 +3438,59 @@ static int img_map(int argc, char **argv)
         length = MIN(start_offset + max_length, length);
     }
 
+    s.bs = bs;
+    s.start = start_offset;
+    s.end = length;
+    s.nb_segments = start_offset < length ?
+                    DIV_ROUND_UP(length - start_offset, MAP_SEGMENT_SIZE) : 0;
+    s.num_workers = MIN(num_coroutines, s.nb_segments);
+    for (i = 0; i < s.num_workers; i++) {
+        ImgMapWorker *w = &s.workers[i];
+
+        *w = (ImgMapWorker) {
+            .s = &s,
+            .co = qemu_coroutine_create(img_map_co, w),
+            .segment = i,
+            .entries = g_array_new(false, false, sizeof(MapEntry)),
+        };
+        qemu_coroutine_enter(w->co);
+    }
+
     curr.start = start_offset;
-    while (curr.start + curr.length < length) {
-        int64_t offset = curr.start + curr.length;
-        int64_t n = length - offset;
+    for (segment = 0; segment < s.nb_segments; segment++) {
+        ImgMapWorker *w = &s.workers[segment % s.num_workers];
+
+        while (!w->done) {
+            main_loop_wait(false);
+        }
+        assert(w->segment == segment);
 
-        ret = get_block_status(bs, offset, n, &next);
+        ret = w->ret;
         if (ret < 0) {
             error_report("Could not read file metadata: %s", strerror(-ret));
             goto out;
         }
 
-        if (entry_mergeable(&curr, &next)) {
-            curr.length += next.length;
-            continue;
-        }
+        for (i = 0; i < w->entries->len; i++) {
+            MapEntry *next = &g_array_index(w->entries, MapEntry, i);
 
-        if (curr.length > 0) {
-            ret = dump_map_entry(output_format, &curr, &next);
-            if (ret < 0) {
-                goto out;
+            if (entry_mergeable(&curr, next)) {
+                curr.length += next->length;
+                continue;
             }
+
+            if (curr.length > 0) {
+                ret = dump_map_entry(output_format, &curr, next);
+                if (ret < 0) {
+                    goto out;
+                }
+            }
+            curr = *next;
         }
-        curr = next;
+
+        /* Let the worker go on with its next segment */
+        w->done = false;
+        qemu_coroutine_enter(w->co);
     }
 
     ret = dump_map_entry(output_format, &curr, NULL);
@@ -3272,6 +3499,18 @@ static int img_map(int argc, char **argv)
     }
 
 out:
+    s.quit = true;
+    for (i = 0; i < s.num_workers; i++) {
+        ImgMapWorker *w = &s.workers[i];
+
+        while (w->co && !w->done) {
+            main_loop_wait(false);
+        }
+        if (w->co) {
+            qemu_coroutine_enter(w->co);
+        }
+        g_array_free(w->entries, true);
+    }
     blk_unref(blk);
     return ret < 0;
 }
@@ -3434,11 +3673,199 @@ static int img_snapshot(int argc, char **argv)
     return 0;
 }
 
+typedef struct ImgRebaseState {
+    BlockBackend *blk;
+    BlockBackend *blk_old_backing;
+    BlockBackend *blk_new_backing;
+    BlockDriverState *unfiltered_bs;
+    BlockDriverState *prefix_chain_bs;
+    int64_t size;
+    int64_t old_backing_size;
+    int64_t new_backing_size;
+    int running_coroutines;
+    CoMutex lock;
+    int64_t offset;     /* next offset to check, protected by @lock */
+    int ret;
+} ImgRebaseState;
+
+/*
+ * Find out how the range at @offset must be handled. On return, *pnum is
+ * the length of the range, and *old_is_zero and *new_is_zero say whether
+ * the old and new backing file are known to read as zeroes there.
+ *
+ * Returns 1 if the range must be compared, 0 if it can be skipped and a
+ * negative errno on failure.
+ *
+ * Called with s->lock held.
+ */
+static int coroutine_fn img_rebase_next_chunk(ImgRebaseState *s,
+                                              int64_t offset, int64_t *pnum,
+                                              bool *old_is_zero,
+                                              bool *new_is_zero)
+{
+    int64_t n = MIN(IO_BUF_SIZE, s->size - offset);
+    int ret;
+
+    *pnum = n;
+
+    /* If the cluster is allocated, we don't need to take action */
+    ret = bdrv_is_allocated(s->unfiltered_bs, offset, n, pnum);
+    if (ret < 0) {
+        goto fail;
+    } else if (ret) {
+        return 0;
+    }
+
+    if (s->prefix_chain_bs) {
+        /*
+         * If cluster wasn't changed since prefix_chain, we don't need
+         * to take action
+         */
+        ret = bdrv_is_allocated_above(bdrv_cow_bs(s->unfiltered_bs),
+                                      s->prefix_chain_bs, false,
+                                      offset, *pnum, pnum);
+        if (ret < 0) {
+            goto fail;
+        } else if (!ret) {
+            return 0;
+        }
+    }
+
+    /* Backing files may be smaller than the COW image */
+    if (offset >= s->old_backing_size) {
+        *old_is_zero = true;
+    } else {
+        n = MIN(*pnum, s->old_backing_size - offset);
+        ret = bdrv_block_status_above(blk_bs(s->blk_old_backing), NULL,
+                                      offset, n, pnum, NULL, NULL);
+        if (ret < 0) {
+            goto fail;
+        }
+        *old_is_zero = ret & BDRV_BLOCK_ZERO;
+    }
+
+    if (!s->blk_new_backing || offset >= s->new_backing_size) {
+        *new_is_zero = true;
+    } else {
+        n = MIN(*pnum, s->new_backing_size - offset);
+        ret = bdrv_block_status_above(blk_bs(s->blk_new_backing), NULL,
+                                      offset, n, pnum, NULL, NULL);
+        if (ret < 0) {
+            goto fail;
+        }
+        *new_is_zero = ret & BDRV_BLOCK_ZERO;
+    }
+
+    /* Ranges that read as zeroes from both backing files can't differ */
+    return !(*old_is_zero && *new_is_zero);
+
+fail:
+    error_report("error while reading image metadata: %s", strerror(-ret));
+    return ret;
+}
+
+static int coroutine_fn img_rebase_copy(ImgRebaseState *s, int64_t offset,
+                                        int64_t n, bool old_is_zero,
+                                        bool new_is_zero, uint8_t *buf_old,
+                                        uint8_t *buf_new)
+{
+    int64_t written = 0;
+    int ret;
+
+    if (old_is_zero) {
+        memset(buf_old, 0, n);
+    } else {
+        ret = blk_co_pread(s->blk_old_backing, offset, n, buf_old, 0);
+        if (ret < 0) {
+            error_report("error while reading from old backing file");
+            return ret;
+        }
+    }
+
+    if (new_is_zero) {
+        memset(buf_new, 0, n);
+    } else {
+        ret = blk_co_pread(s->blk_new_backing, offset, n, buf_new, 0);
+        if (ret < 0) {
+            error_report("error while reading from new backing file");
+            return ret;
+        }
+    }
+
+    /* If they differ, we need to write to the COW file */
+    while (written < n) {
+        int64_t pnum;
+
+        if (compare_buffers(buf_old + written, buf_new + written,
+                            n - written, &pnum))
+        {
+            if (old_is_zero) {
+                ret = blk_co_pwrite_zeroes(s->blk, offset + written, pnum, 0);
+            } else {
+                ret = blk_co_pwrite(s->blk, offset + written, pnum,
+                                    buf_old + written, 0);
+            }
+            if (ret < 0) {
+                error_report("Error while writing to COW image: %s",
+                             strerror(-ret));
+                return ret;
+            }
+        }
+
+        written += pnum;
+    }
+
+    return 0;
+}
+
+static void coroutine_fn img_rebase_co(void *opaque)
+{
+    ImgRebaseState *s = opaque;
+    uint8_t *buf_old, *buf_new;
+
+    s->running_coroutines++;
+    buf_old = blk_blockalign(s->blk, IO_BUF_SIZE);
+    buf_new = blk_blockalign(s->blk, IO_BUF_SIZE);
+
+    while (1) {
+        bool old_is_zero = false, new_is_zero = false;
+        int64_t offset, n;
+        int ret;
+
+        qemu_co_mutex_lock(&s->lock);
+        if (s->ret < 0 || s->offset >= s->size) {
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+        offset = s->offset;
+        ret = img_rebase_next_chunk(s, offset, &n, &old_is_zero, &new_is_zero);
+        if (ret < 0) {
+            s->ret = ret;
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+        s->offset += n;
+        qemu_co_mutex_unlock(&s->lock);
+
+        if (ret > 0) {
+            ret = img_rebase_copy(s, offset, n, old_is_zero, new_is_zero,
+                                  buf_old, buf_new);
+            if (ret < 0) {
+                s->ret = ret;
+                break;
+            }
+        }
+        qemu_progress_print(((float) n / s->size) * 100, 100);
+    }
+
+    qemu_vfree(buf_old);
+    qemu_vfree(buf_new);
+    s->running_coroutines--;
+}
+
 static int img_rebase(int argc, char **argv)
 {
     BlockBackend *blk = NULL, *blk_old_backing = NULL, *blk_new_backing = NULL;
-    uint8_t *buf_old = NULL;
-    uint8_t *buf_new = NULL;
     BlockDriverState *bs = NULL, *prefix_chain_bs = NULL;
     BlockDriverState *unfiltered_bs;
     char *filename;
@@ -3451,6 +3878,7 @@ static int img_rebase(int argc, char **argv)
     bool quiet = false;
     Error *local_err = NULL;
     bool image_opts = false;
+    long num_coroutines = 8;
 
     /* Parse commandline parameters */
     fmt = NULL;
@@ -3466,7 +3894,7 @@ static int img_rebase(int argc, char **argv)
             {"force-share", no_argument, 0, 'U'},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, ":hf:F:b:upt:T:qU",
+        c = getopt_long(argc, argv, ":hf:F:b:upt:T:m:qU",
                         long_options, NULL);
         if (c == -1) {
             break;
@@ -3502,6 +3930,14 @@ static int img_rebase(int argc, char **argv)
         case 'T':
             src_cache = optarg;
             break;
+        case 'm':
+            if (qemu_strtol(optarg, NULL, 0, &num_coroutines) ||
+                num_coroutines < 1 || num_coroutines > MAX_COROUTINES) {
+                error_report("Invalid number of coroutines. Allowed number of"
+                             " coroutines is between 1 and %d", MAX_COROUTINES);
+                return 1;
+            }
+            break;
         case 'q':
             quiet = true;
             break;
@@ -3667,143 +4103,62 @@ static int img_rebase(int argc, char **argv)
      * the image is the same as the original one at any time.
      */
     if (!unsafe) {
-        int64_t size;
-        int64_t old_backing_size = 0;
-        int64_t new_backing_size = 0;
-        uint64_t offset;
-        int64_t n;
-        float local_progress = 0;
-
-        buf_old = blk_blockalign(blk, IO_BUF_SIZE);
-        buf_new = blk_blockalign(blk, IO_BUF_SIZE);
+        ImgRebaseState s = {
+            .blk = blk,
+            .blk_old_backing = blk_old_backing,
+            .blk_new_backing = blk_new_backing,
+            .unfiltered_bs = unfiltered_bs,
+            .prefix_chain_bs = prefix_chain_bs,
+        };
+        int i;
 
-        size = blk_getlength(blk);
-        if (size < 0) {
+        s.size = blk_getlength(blk);
+        if (s.size < 0) {
             error_report("Could not get size of '%s': %s",
-                         filename, strerror(-size));
+                         filename, strerror(-s.size));
             ret = -1;
             goto out;
         }
         if (blk_old_backing) {
-            old_backing_size = blk_getlength(blk_old_backing);
-            if (old_backing_size < 0) {
+            s.old_backing_size = blk_getlength(blk_old_backing);
+            if (s.old_backing_size < 0) {
                 char backing_name[PATH_MAX];
 
                 bdrv_get_backing_filename(bs, backing_name,
                                           sizeof(backing_name));
                 error_report("Could not get size of '%s': %s",
-                             backing_name, strerror(-old_backing_size));
+                             backing_name, strerror(-s.old_backing_size));
                 ret = -1;
                 goto out;
             }
         }
         if (blk_new_backing) {
-            new_backing_size = blk_getlength(blk_new_backing);
-            if (new_backing_size < 0) {
+            s.new_backing_size = blk_getlength(blk_new_backing);
+            if (s.new_backing_size < 0) {
                 error_report("Could not get size of '%s': %s",
-                             out_baseimg, strerror(-new_backing_size));
+                             out_baseimg, strerror(-s.new_backing_size));
                 ret = -1;
                 goto out;
             }
         }
 
-        if (size != 0) {
-            local_progress = (float)100 / (size / MIN(size, IO_BUF_SIZE));
+        /*
+         * Block status of the image and both backing files is checked
+         * first, so that only ranges which may actually differ are read.
+         * Several coroutines read, compare and write such ranges in
+         * parallel.
+         */
+        qemu_co_mutex_init(&s.lock);
+        for (i = 0; i < num_coroutines; i++) {
+            qemu_coroutine_enter(qemu_coroutine_create(img_rebase_co, &s));
+        }
+        while (s.running_coroutines) {
+            main_loop_wait(false);
         }
 
-        for (offset = 0; offset < size; offset += n) {
-            bool buf_old_is_zero = false;
-
-            /* How many bytes can we handle with the next read? */
-            n = MIN(IO_BUF_SIZE, size - offset);
-
-            /* If the cluster is allocated, we don't need to take action */
-            ret = bdrv_is_allocated(unfiltered_bs, offset, n, &n);
-            if (ret < 0) {
-                error_report("error while reading image metadata: %s",
-                             strerror(-ret));
-                goto out;
-            }
-            if (ret) {
-                continue;
-            }
-
-            if (prefix_chain_bs) {
-                /*
-                 * If cluster wasn't changed since prefix_chain, we don't need
-                 * to take action
-                 */
-                ret = bdrv_is_allocated_above(bdrv_cow_bs(unfiltered_bs),
-                                              prefix_chain_bs, false,
-                                              offset, n, &n);
-                if (ret < 0) {
-                    error_report("error while reading image metadata: %s",
-                                 strerror(-ret));
-                    goto out;
-                }
-                if (!ret) {
-                    continue;
-                }
-            }
-
-            /*
-             * Read old and new backing file and take into consideration that
-             * backing files may be smaller than the COW image.
-             */
-            if (offset >= old_backing_size) {
-                memset(buf_old, 0, n);
-                buf_old_is_zero = true;
-            } else {
-                if (offset + n > old_backing_size) {
-                    n = old_backing_size - offset;
-                }
-
-                ret = blk_pread(blk_old_backing, offset, buf_old, n);
-                if (ret < 0) {
-                    error_report("error while reading from old backing file");
-                    goto out;
-                }
-            }
-
-            if (offset >= new_backing_size || !blk_new_backing) {
-                memset(buf_new, 0, n);
-            } else {
-                if (offset + n > new_backing_size) {
-                    n = new_backing_size - offset;
-                }
-
-                ret = blk_pread(blk_new_backing, offset, buf_new, n);
-                if (ret < 0) {
-                    error_report("error while reading from new backing file");
-                    goto out;
-                }
-            }
-
-            /* If they differ, we need to write to the COW file */
-            uint64_t written = 0;
-
-            while (written < n) {
-                int64_t pnum;
-
-                if (compare_buffers(buf_old + written, buf_new + written,
-                                    n - written, &pnum))
-                {
-                    if (buf_old_is_zero) {
-                        ret = blk_pwrite_zeroes(blk, offset + written, pnum, 0);
-                    } else {
-                        ret = blk_pwrite(blk, offset + written,
-                                         buf_old + written, pnum, 0);
-                    }
-                    if (ret < 0) {
-                        error_report("Error while writing to COW image: %s",
-                            strerror(-ret));
-                        goto out;
-                    }
-                }
-
-                written += pnum;
-            }
-            qemu_progress_print(local_progress, 100);
+        ret = s.ret;
+        if (ret < 0) {
+            goto out;
         }
     }
 
@@ -3844,8 +4199,6 @@ out:
         blk_unref(blk_old_backing);
         blk_unref(blk_new_backing);
     }
-    qemu_vfree(buf_old);
-    qemu_vfree(buf_new);
 
     blk_unref(blk);
     if (ret) {
@@ -144,6 +144,11 @@ void cpu_synchronize_all_post_reset(void)
 {
     CPUState *cpu;
 
+    if (cpus_accel->synchronize_all_post_reset) {
+        cpus_accel->synchronize_all_post_reset();
+        return;
+    }
+
     CPU_FOREACH(cpu) {
         cpu_synchronize_post_reset(cpu);
     }
@@ -153,6 +158,11 @@ void cpu_synchronize_all_post_init(void)
 {
     CPUState *cpu;
 
+    if (cpus_accel->synchronize_all_post_init) {
+        cpus_accel->synchronize_all_post_init();
+        return;
+    }
+
     CPU_FOREACH(cpu) {
         cpu_synchronize_post_init(cpu);
     }
@@ -30,6 +30,8 @@
 #define TCG_GUEST_DEFAULT_MO      (TCG_MO_ALL & ~TCG_MO_ST_LD)
 
 #define KVM_HAVE_MCE_INJECTION 1
+/* kvm_arch_put_registers() only touches the vCPU it is given */
+#define KVM_HAVE_UNLOCKED_PUT_REGISTERS 1
 
 /* support for self modifying code even if the modified instruction is
    close to the modifying instruction */